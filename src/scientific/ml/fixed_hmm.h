@@ -0,0 +1,432 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#ifndef SCIENTIFIC_ML_FIXED_HMM_H
+#define SCIENTIFIC_ML_FIXED_HMM_H
+
+#include "max_plus.h"
+#include "smart_hmm.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace scientific { namespace ml {
+
+// Scorer of character sequences, finding log10 probabilities of their Viterbi paths
+// in some HMM, see Hmm::find_viterbi_score
+class HmmScorer
+{
+  public:
+    virtual ~HmmScorer()
+    {
+    }
+    // Find log10 probability of Viterbi path for given sequence,
+    // followed by optional terminator
+    virtual double
+    score( const char* sequence, std::size_t length, const char* terminator ) const = 0;
+    // Find log10 probabilities of Viterbi paths for many sequences at once
+    virtual void score( const char* const* sequences,
+                        const std::size_t* lengths,
+                        std::size_t count,
+                        double* scores,
+                        const char* terminator ) const = 0;
+    // Find log10 probability of Viterbi path, stopping as soon as it is known
+    // to be lower than given limit, see Hmm::find_viterbi_score_bounded
+    virtual double score_bounded( const char* sequence,
+                                  std::size_t length,
+                                  const char* terminator,
+                                  double limit,
+                                  double beam,
+                                  bool& stopped ) const = 0;
+};
+
+// Scorer using HMM of any size
+class DynamicHmmScorer : public HmmScorer
+{
+  private:
+    Hmm<char, std::string> hmm_;
+
+  public:
+    explicit DynamicHmmScorer( const Hmm<char, std::string>& hmm )
+        : hmm_( hmm )
+    {
+    }
+    double score( const char* sequence, std::size_t length, const char* terminator ) const
+      override
+    {
+        return hmm_.find_viterbi_score( sequence, length, terminator );
+    }
+    void score( const char* const* sequences,
+                const std::size_t* lengths,
+                std::size_t count,
+                double* scores,
+                const char* terminator ) const override
+    {
+        hmm_.find_viterbi_scores( sequences, lengths, count, scores, terminator );
+    }
+    double score_bounded( const char* sequence,
+                          std::size_t length,
+                          const char* terminator,
+                          double limit,
+                          double beam,
+                          bool& stopped ) const override
+    {
+        return hmm_.find_viterbi_score_bounded(
+          sequence, length, terminator, limit, beam, stopped );
+    }
+};
+
+// Scorer using HMM of N states and alphabet of at most A characters.
+// With sizes known at compile time, loops over states are fully unrolled,
+// rolling vectors stay in registers and tables are kept in aligned arrays
+// of constant size. Scoring is compiled for AVX-512, AVX2 and baseline
+// instruction set, one of which is selected for the CPU at construction.
+// Models of less than 2 * max_plus::LANES states score batches of sequences
+// in groups, with lane-interleaved kernels as Hmm::find_viterbi_scores.
+// Scores are the same as of Hmm::find_viterbi_score and bounded scores
+// are the same as of Hmm::find_viterbi_score_bounded
+template<unsigned N, unsigned A>
+class FixedHmm : public HmmScorer
+{
+    static_assert( N > 0 && A > 0 && A < 256, "Invalid HMM size" );
+
+  private:
+    using ScoreFunction = double ( FixedHmm::* )(
+      const char*, std::size_t, const char*, double, double, bool& ) const;
+    using BatchFunction = void ( FixedHmm::* )(
+      const char* const*, const std::size_t*, std::size_t, double*, const char* ) const;
+
+    alignas( 64 ) double log_initial_states_[N];   // log10 of initial states probabilities
+    alignas( 64 ) double log_transitions_[N][N];   // log10 of transitions, [from][to]
+    alignas( 64 ) double log_emissions_[A + 1][N]; // log10 of emissions, [symbol][state],
+                                                   // symbol A stands for unknown characters
+    uint8_t symbols_[256];                         // Symbol of each character
+    ScoreFunction score_function_;                 // Scoring compiled for the CPU
+    ScoreFunction bounded_function_;               // Bounded scoring compiled for the CPU
+    BatchFunction batch_function_;                 // Batch scoring compiled for the CPU
+
+    // Get symbol of given character
+    unsigned symbol( char c ) const
+    {
+        return symbols_[uint8_t( c )];
+    }
+
+    // Viterbi recurrence with given max-plus kernel, which is inlined
+    // and specialized for N states in each instruction set variant.
+    // Limit and beam are used by bounded variant only
+    template<max_plus::Kernel step, bool bounded>
+    __attribute__( ( always_inline ) ) inline double score_inline( const char* sequence,
+                                                                   std::size_t length,
+                                                                   const char* terminator,
+                                                                   double limit,
+                                                                   double beam,
+                                                                   bool& stopped ) const
+    {
+        stopped                 = false;
+        const std::size_t total = length + ( terminator ? 1 : 0 );
+        if( total == 0 ) {
+            return -std::numeric_limits<double>::infinity();
+        }
+        alignas( 64 ) double current[N];
+        alignas( 64 ) double next[N];
+
+        const double* emission = log_emissions_[symbol( length ? sequence[0] : *terminator )];
+        for( unsigned i = 0; i < N; ++i ) {
+            current[i] = log_initial_states_[i] + emission[i];
+        }
+        for( std::size_t t = 1; t < total; ++t ) {
+            if( bounded ) {
+                double best = max_plus::prune( current, N, beam );
+                if( best < limit ) {
+                    stopped = true;
+                    return best;
+                }
+            }
+            emission = log_emissions_[symbol( t < length ? sequence[t] : *terminator )];
+            if( N <= 16 ) {
+                // Whole product in a few registers, kernel computes it block by block
+                step( current, &log_transitions_[0][0], emission, N, next );
+            } else {
+                // Bigger products are vectorized by compiler over all states at once,
+                // so every source state is broadcast only once
+                for( unsigned i = 0; i < N; ++i ) {
+                    next[i] = current[0] + log_transitions_[0][i];
+                }
+                for( unsigned k = 1; k < N; ++k ) {
+                    // Paths through pruned states are not extended
+                    if( bounded && current[k] == -std::numeric_limits<double>::infinity() ) {
+                        continue;
+                    }
+                    for( unsigned i = 0; i < N; ++i ) {
+                        double candidate = current[k] + log_transitions_[k][i];
+                        next[i]          = next[i] < candidate ? candidate : next[i];
+                    }
+                }
+                for( unsigned i = 0; i < N; ++i ) {
+                    next[i] += emission[i];
+                }
+            }
+            std::copy_n( next, N, current );
+        }
+        return *std::max_element( current, current + N );
+    }
+
+    // Viterbi recurrence of groups of max_plus::LANES sequences with given batch
+    // kernel, as in Hmm::find_viterbi_scores. With N states known at compile time
+    // rolling vectors and emissions of a group are kept on stack
+    template<max_plus::Kernel step, max_plus::BatchKernel step_batch>
+    __attribute__( ( always_inline ) ) inline void
+    score_batch_inline( const char* const* sequences,
+                        const std::size_t* lengths,
+                        std::size_t count,
+                        double* scores,
+                        const char* terminator ) const
+    {
+        constexpr unsigned L = max_plus::LANES;
+        // Single sequences of many states fill vectors on their own, and scoring
+        // them one by one keeps rolling vectors in registers, see dfw3bench
+        if constexpr( N >= 2 * L ) {
+            bool stopped;
+            for( std::size_t s = 0; s < count; ++s ) {
+                scores[s] = score_inline<step, false>(
+                  sequences[s], lengths[s], terminator, 0, 0, stopped );
+            }
+            return;
+        }
+        alignas( 64 ) double rolling[2 * N * L]; // State-major and sequence-minor
+        alignas( 64 ) double emission[N * L];
+        double* current = rolling;
+        double* next    = rolling + N * L;
+
+        for( std::size_t first = 0; first < count; first += L ) {
+            const unsigned lanes = std::min<std::size_t>( L, count - first );
+            std::size_t total[L]; // Number of elements of group sequences
+            std::size_t steps = 0;
+            for( unsigned l = 0; l < L; ++l ) {
+                total[l] = l < lanes ? lengths[first + l] + ( terminator ? 1 : 0 ) : 0;
+                steps    = std::max( steps, total[l] );
+                if( l < lanes && total[l] == 0 ) {
+                    scores[first + l] = -std::numeric_limits<double>::infinity();
+                }
+            }
+            for( std::size_t t = 0; t < steps; ++t ) {
+                // Lanes of finished and missing sequences repeat the first symbol,
+                // their scores are not used
+                for( unsigned l = 0; l < L; ++l ) {
+                    unsigned s = 0;
+                    if( t < total[l] ) {
+                        s = symbol( t < lengths[first + l] ? sequences[first + l][t]
+                                                           : *terminator );
+                    }
+                    for( unsigned i = 0; i < N; ++i ) {
+                        emission[i * L + l] = log_emissions_[s][i];
+                    }
+                }
+                if( t == 0 ) {
+                    for( unsigned i = 0; i < N * L; ++i ) {
+                        current[i] = log_initial_states_[i / L] + emission[i];
+                    }
+                } else {
+                    step_batch( current, &log_transitions_[0][0], emission, N, next );
+                    std::swap( current, next );
+                }
+                // Collect scores of sequences ending at this element
+                for( unsigned l = 0; l < lanes; ++l ) {
+                    if( total[l] == t + 1 ) {
+                        double best = current[l];
+                        for( unsigned i = 1; i < N; ++i ) {
+                            best = std::max( best, current[i * L + l] );
+                        }
+                        scores[first + l] = best;
+                    }
+                }
+            }
+        }
+    }
+
+    void score_batch_baseline( const char* const* sequences,
+                               const std::size_t* lengths,
+                               std::size_t count,
+                               double* scores,
+                               const char* terminator ) const
+    {
+        score_batch_inline<max_plus::step_portable, max_plus::step_batch_portable>(
+          sequences, lengths, count, scores, terminator );
+    }
+#ifdef SCIENTIFIC_ML_MAX_PLUS_X86
+    __attribute__( ( target( "sse4.2" ) ) ) void
+    score_batch_sse42( const char* const* sequences,
+                       const std::size_t* lengths,
+                       std::size_t count,
+                       double* scores,
+                       const char* terminator ) const
+    {
+        score_batch_inline<max_plus::step_sse42, max_plus::step_batch_sse42>(
+          sequences, lengths, count, scores, terminator );
+    }
+    __attribute__( ( target( "avx2" ) ) ) void
+    score_batch_avx2( const char* const* sequences,
+                      const std::size_t* lengths,
+                      std::size_t count,
+                      double* scores,
+                      const char* terminator ) const
+    {
+        score_batch_inline<max_plus::step_avx2, max_plus::step_batch_avx2>(
+          sequences, lengths, count, scores, terminator );
+    }
+    __attribute__( ( target( "avx512f" ) ) ) void
+    score_batch_avx512( const char* const* sequences,
+                        const std::size_t* lengths,
+                        std::size_t count,
+                        double* scores,
+                        const char* terminator ) const
+    {
+        score_batch_inline<max_plus::step_avx512, max_plus::step_batch_avx512>(
+          sequences, lengths, count, scores, terminator );
+    }
+#endif
+
+    template<bool bounded>
+    double score_baseline( const char* sequence,
+                           std::size_t length,
+                           const char* terminator,
+                           double limit,
+                           double beam,
+                           bool& stopped ) const
+    {
+        return score_inline<max_plus::step_portable, bounded>(
+          sequence, length, terminator, limit, beam, stopped );
+    }
+#ifdef SCIENTIFIC_ML_MAX_PLUS_X86
+    template<bool bounded>
+    __attribute__( ( target( "sse4.2" ) ) ) double score_sse42( const char* sequence,
+                                                              std::size_t length,
+                                                              const char* terminator,
+                                                              double limit,
+                                                              double beam,
+                                                              bool& stopped ) const
+    {
+        return score_inline<max_plus::step_sse42, bounded>(
+          sequence, length, terminator, limit, beam, stopped );
+    }
+    template<bool bounded>
+    __attribute__( ( target( "avx2" ) ) ) double score_avx2( const char* sequence,
+                                                           std::size_t length,
+                                                           const char* terminator,
+                                                           double limit,
+                                                           double beam,
+                                                           bool& stopped ) const
+    {
+        return score_inline<max_plus::step_avx2, bounded>(
+          sequence, length, terminator, limit, beam, stopped );
+    }
+    template<bool bounded>
+    __attribute__( ( target( "avx512f" ) ) ) double score_avx512( const char* sequence,
+                                                                std::size_t length,
+                                                                const char* terminator,
+                                                                double limit,
+                                                                double beam,
+                                                                bool& stopped ) const
+    {
+        return score_inline<max_plus::step_avx512, bounded>(
+          sequence, length, terminator, limit, beam, stopped );
+    }
+#endif
+
+  public:
+    // Check if given HMM has N states and at most A characters
+    static bool fits( const Hmm<char, std::string>& hmm )
+    {
+        return hmm.get_log_initial_states().size() == N && hmm.get_alphabet().size() <= A;
+    }
+
+    // Copy log-space tables of given HMM, which must fit
+    explicit FixedHmm( const Hmm<char, std::string>& hmm )
+    {
+        if( not fits( hmm ) ) {
+            throw std::invalid_argument( "HMM does not fit fixed size scorer!" );
+        }
+        const std::string alphabet = hmm.get_alphabet();
+        std::copy_n( hmm.get_log_initial_states().data(), N, log_initial_states_ );
+        std::copy_n( hmm.get_log_transitions().data(), N * N, &log_transitions_[0][0] );
+        std::fill_n( &log_emissions_[0][0], A * N, -std::numeric_limits<double>::infinity() );
+        std::copy_n(
+          hmm.get_log_emissions().data(), alphabet.size() * N, &log_emissions_[0][0] );
+        std::copy_n( &hmm.get_log_emissions()[alphabet.size() * N], N, log_emissions_[A] );
+        // First occurence of character wins, as in Hmm
+        std::memset( symbols_, A, sizeof( symbols_ ) );
+        for( unsigned s = alphabet.size(); s-- > 0; ) {
+            symbols_[uint8_t( alphabet[s] )] = s;
+        }
+
+        score_function_   = &FixedHmm::score_baseline<false>;
+        bounded_function_ = &FixedHmm::score_baseline<true>;
+        batch_function_   = &FixedHmm::score_batch_baseline;
+#ifdef SCIENTIFIC_ML_MAX_PLUS_X86
+        switch( max_plus::best_isa() ) {
+            case max_plus::Isa::SSE42:
+                score_function_   = &FixedHmm::score_sse42<false>;
+                bounded_function_ = &FixedHmm::score_sse42<true>;
+                batch_function_   = &FixedHmm::score_batch_sse42;
+                break;
+            case max_plus::Isa::AVX2:
+                score_function_   = &FixedHmm::score_avx2<false>;
+                bounded_function_ = &FixedHmm::score_avx2<true>;
+                batch_function_   = &FixedHmm::score_batch_avx2;
+                break;
+            case max_plus::Isa::AVX512:
+                score_function_   = &FixedHmm::score_avx512<false>;
+                bounded_function_ = &FixedHmm::score_avx512<true>;
+                batch_function_   = &FixedHmm::score_batch_avx512;
+                break;
+            default:
+                break;
+        }
+#endif
+    }
+
+    double score( const char* sequence, std::size_t length, const char* terminator ) const
+      override
+    {
+        bool stopped;
+        return ( this->*score_function_ )( sequence, length, terminator, 0, 0, stopped );
+    }
+
+    void score( const char* const* sequences,
+                const std::size_t* lengths,
+                std::size_t count,
+                double* scores,
+                const char* terminator ) const override
+    {
+        ( this->*batch_function_ )( sequences, lengths, count, scores, terminator );
+    }
+
+    double score_bounded( const char* sequence,
+                          std::size_t length,
+                          const char* terminator,
+                          double limit,
+                          double beam,
+                          bool& stopped ) const override
+    {
+        return ( this->*bounded_function_ )(
+          sequence, length, terminator, limit, beam, stopped );
+    }
+};
+
+}} // namespace scientific::ml
+
+#endif // SCIENTIFIC_ML_FIXED_HMM_H
@@ -0,0 +1,364 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#ifndef SCIENTIFIC_ML_MAX_PLUS_H
+#define SCIENTIFIC_ML_MAX_PLUS_H
+
+#include <algorithm>
+#include <limits>
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <immintrin.h>
+#define SCIENTIFIC_ML_MAX_PLUS_X86
+#endif
+
+namespace scientific { namespace ml { namespace max_plus {
+
+// One step of Viterbi recurrence in log space, i.e. max-plus product
+// of vector and matrix followed by addition of emissions:
+//   next[i] = max_k( current[k] + transitions[k * n + i] ) + emission[i]
+// Transitions are stored source-major, so every source state k contributes
+// a contiguous row and the product vectorizes over destination states i.
+// Max and addition are exact, so all kernels give bit-identical results.
+using Kernel = void ( * )( const double* current,
+                           const double* transitions,
+                           const double* emission,
+                           unsigned n,
+                           double* next );
+
+// Number of sequences scored together by batch kernels
+static constexpr unsigned LANES = 8;
+
+// Same step for LANES independent sequences sharing transitions, stored
+// in structure-of-arrays layout, with state i of sequence l at [i * LANES + l]:
+//   next[i][l] = max_k( current[k][l] + transitions[k * n + i] ) + emissions[i][l]
+// Here the product vectorizes over sequences, so it uses whole vectors
+// regardless of the number of states
+using BatchKernel = void ( * )( const double* current,
+                                const double* transitions,
+                                const double* emissions,
+                                unsigned n,
+                                double* next );
+
+enum class Isa
+{
+    SCALAR,
+    SSE42,
+    AVX2,
+    AVX512
+};
+
+// Portable kernel, also used for remainders of vector kernels
+inline void step_scalar( const double* current,
+                         const double* transitions,
+                         const double* emission,
+                         unsigned n,
+                         double* next,
+                         unsigned first = 0 )
+{
+    for( unsigned i = first; i < n; ++i ) {
+        double best = -std::numeric_limits<double>::infinity();
+        for( unsigned k = 0; k < n; ++k ) {
+            best = std::max( best, current[k] + transitions[k * n + i] );
+        }
+        next[i] = best + emission[i];
+    }
+}
+
+inline void step_portable( const double* current,
+                           const double* transitions,
+                           const double* emission,
+                           unsigned n,
+                           double* next )
+{
+    step_scalar( current, transitions, emission, n, next );
+}
+
+inline void step_batch_portable( const double* current,
+                                 const double* transitions,
+                                 const double* emissions,
+                                 unsigned n,
+                                 double* next )
+{
+    for( unsigned i = 0; i < n; ++i ) {
+        double best[LANES];
+        std::fill( best, best + LANES, -std::numeric_limits<double>::infinity() );
+        for( unsigned k = 0; k < n; ++k ) {
+            for( unsigned l = 0; l < LANES; ++l ) {
+                best[l] = std::max( best[l], current[k * LANES + l] + transitions[k * n + i] );
+            }
+        }
+        for( unsigned l = 0; l < LANES; ++l ) {
+            next[i * LANES + l] = best[l] + emissions[i * LANES + l];
+        }
+    }
+}
+
+#ifdef SCIENTIFIC_ML_MAX_PLUS_X86
+
+// Vector kernels keep one block of destination states in registers
+// while iterating over all source states, so next is written only once
+
+__attribute__( ( target( "sse4.2" ) ) ) inline void step_sse42( const double* current,
+                                                                const double* transitions,
+                                                                const double* emission,
+                                                                unsigned n,
+                                                                double* next )
+{
+    unsigned i = 0;
+    for( ; i + 4 <= n; i += 4 ) {
+        __m128d best0 = _mm_set1_pd( -std::numeric_limits<double>::infinity() );
+        __m128d best1 = best0;
+        for( unsigned k = 0; k < n; ++k ) {
+            __m128d c         = _mm_set1_pd( current[k] );
+            const double* row = transitions + k * n + i;
+
+            best0 = _mm_max_pd( best0, _mm_add_pd( c, _mm_loadu_pd( row ) ) );
+            best1 = _mm_max_pd( best1, _mm_add_pd( c, _mm_loadu_pd( row + 2 ) ) );
+        }
+        _mm_storeu_pd( next + i, _mm_add_pd( best0, _mm_loadu_pd( emission + i ) ) );
+        _mm_storeu_pd( next + i + 2, _mm_add_pd( best1, _mm_loadu_pd( emission + i + 2 ) ) );
+    }
+    step_scalar( current, transitions, emission, n, next, i );
+}
+
+__attribute__( ( target( "avx2" ) ) ) inline void step_avx2( const double* current,
+                                                             const double* transitions,
+                                                             const double* emission,
+                                                             unsigned n,
+                                                             double* next )
+{
+    unsigned i = 0;
+    for( ; i + 8 <= n; i += 8 ) {
+        __m256d best0 = _mm256_set1_pd( -std::numeric_limits<double>::infinity() );
+        __m256d best1 = best0;
+        for( unsigned k = 0; k < n; ++k ) {
+            __m256d c         = _mm256_set1_pd( current[k] );
+            const double* row = transitions + k * n + i;
+
+            best0 = _mm256_max_pd( best0, _mm256_add_pd( c, _mm256_loadu_pd( row ) ) );
+            best1 = _mm256_max_pd( best1, _mm256_add_pd( c, _mm256_loadu_pd( row + 4 ) ) );
+        }
+        _mm256_storeu_pd( next + i, _mm256_add_pd( best0, _mm256_loadu_pd( emission + i ) ) );
+        _mm256_storeu_pd( next + i + 4,
+                          _mm256_add_pd( best1, _mm256_loadu_pd( emission + i + 4 ) ) );
+    }
+    for( ; i + 4 <= n; i += 4 ) {
+        __m256d best = _mm256_set1_pd( -std::numeric_limits<double>::infinity() );
+        for( unsigned k = 0; k < n; ++k ) {
+            best = _mm256_max_pd( best,
+                                  _mm256_add_pd( _mm256_set1_pd( current[k] ),
+                                                 _mm256_loadu_pd( transitions + k * n + i ) ) );
+        }
+        _mm256_storeu_pd( next + i, _mm256_add_pd( best, _mm256_loadu_pd( emission + i ) ) );
+    }
+    step_scalar( current, transitions, emission, n, next, i );
+}
+
+__attribute__( ( target( "avx512f" ) ) ) inline void step_avx512( const double* current,
+                                                                  const double* transitions,
+                                                                  const double* emission,
+                                                                  unsigned n,
+                                                                  double* next )
+{
+    for( unsigned i = 0; i < n; i += 8 ) {
+        // Last block is masked, so any number of states is handled without remainder
+        __mmask8 valid = n - i >= 8 ? __mmask8( 0xFF ) : __mmask8( ( 1u << ( n - i ) ) - 1 );
+        __m512d best   = _mm512_set1_pd( -std::numeric_limits<double>::infinity() );
+        for( unsigned k = 0; k < n; ++k ) {
+            __m512d c   = _mm512_set1_pd( current[k] );
+            __m512d row = _mm512_maskz_loadu_pd( valid, transitions + k * n + i );
+            best        = _mm512_mask_max_pd( best, valid, best, _mm512_add_pd( c, row ) );
+        }
+        __m512d e = _mm512_maskz_loadu_pd( valid, emission + i );
+        _mm512_mask_storeu_pd( next + i, valid, _mm512_add_pd( best, e ) );
+    }
+}
+
+// Batch kernels keep all lanes of one destination state in registers
+
+__attribute__( ( target( "sse4.2" ) ) ) inline void
+step_batch_sse42( const double* current,
+                  const double* transitions,
+                  const double* emissions,
+                  unsigned n,
+                  double* next )
+{
+    for( unsigned i = 0; i < n; ++i ) {
+        __m128d best[LANES / 2];
+        for( unsigned v = 0; v < LANES / 2; ++v ) {
+            best[v] = _mm_set1_pd( -std::numeric_limits<double>::infinity() );
+        }
+        for( unsigned k = 0; k < n; ++k ) {
+            __m128d t = _mm_set1_pd( transitions[k * n + i] );
+            for( unsigned v = 0; v < LANES / 2; ++v ) {
+                __m128d c = _mm_loadu_pd( current + k * LANES + 2 * v );
+                best[v]   = _mm_max_pd( best[v], _mm_add_pd( c, t ) );
+            }
+        }
+        for( unsigned v = 0; v < LANES / 2; ++v ) {
+            __m128d e = _mm_loadu_pd( emissions + i * LANES + 2 * v );
+            _mm_storeu_pd( next + i * LANES + 2 * v, _mm_add_pd( best[v], e ) );
+        }
+    }
+}
+
+__attribute__( ( target( "avx2" ) ) ) inline void step_batch_avx2( const double* current,
+                                                                   const double* transitions,
+                                                                   const double* emissions,
+                                                                   unsigned n,
+                                                                   double* next )
+{
+    for( unsigned i = 0; i < n; ++i ) {
+        __m256d best0 = _mm256_set1_pd( -std::numeric_limits<double>::infinity() );
+        __m256d best1 = best0;
+        for( unsigned k = 0; k < n; ++k ) {
+            __m256d t  = _mm256_set1_pd( transitions[k * n + i] );
+            __m256d c0 = _mm256_loadu_pd( current + k * LANES );
+            __m256d c1 = _mm256_loadu_pd( current + k * LANES + 4 );
+            best0      = _mm256_max_pd( best0, _mm256_add_pd( c0, t ) );
+            best1      = _mm256_max_pd( best1, _mm256_add_pd( c1, t ) );
+        }
+        __m256d e0 = _mm256_loadu_pd( emissions + i * LANES );
+        __m256d e1 = _mm256_loadu_pd( emissions + i * LANES + 4 );
+        _mm256_storeu_pd( next + i * LANES, _mm256_add_pd( best0, e0 ) );
+        _mm256_storeu_pd( next + i * LANES + 4, _mm256_add_pd( best1, e1 ) );
+    }
+}
+
+__attribute__( ( target( "avx512f" ) ) ) inline void
+step_batch_avx512( const double* current,
+                   const double* transitions,
+                   const double* emissions,
+                   unsigned n,
+                   double* next )
+{
+    static_assert( LANES == 8, "AVX-512 batch kernel requires 8 lanes" );
+    for( unsigned i = 0; i < n; ++i ) {
+        __m512d best = _mm512_set1_pd( -std::numeric_limits<double>::infinity() );
+        for( unsigned k = 0; k < n; ++k ) {
+            __m512d t = _mm512_set1_pd( transitions[k * n + i] );
+            __m512d c = _mm512_loadu_pd( current + k * LANES );
+            best      = _mm512_mask_max_pd( best, 0xFF, best, _mm512_add_pd( c, t ) );
+        }
+        __m512d e = _mm512_loadu_pd( emissions + i * LANES );
+        _mm512_storeu_pd( next + i * LANES, _mm512_add_pd( best, e ) );
+    }
+}
+
+#endif // SCIENTIFIC_ML_MAX_PLUS_X86
+
+// Check if given instruction set is supported by the CPU. Kernels are selected
+// by initializers of namespace scope variables, which may run before CPU model
+// is detected by libgcc, so it is initialized here
+inline bool supported( Isa isa )
+{
+#ifdef SCIENTIFIC_ML_MAX_PLUS_X86
+    __builtin_cpu_init();
+#endif
+    switch( isa ) {
+        case Isa::SCALAR:
+            return true;
+#ifdef SCIENTIFIC_ML_MAX_PLUS_X86
+        case Isa::SSE42:
+            return __builtin_cpu_supports( "sse4.2" );
+        case Isa::AVX2:
+            return __builtin_cpu_supports( "avx2" );
+        case Isa::AVX512:
+            return __builtin_cpu_supports( "avx512f" );
+#endif
+        default:
+            return false;
+    }
+}
+
+// Get kernel for given instruction set, which must be supported
+inline Kernel kernel( Isa isa )
+{
+    switch( isa ) {
+#ifdef SCIENTIFIC_ML_MAX_PLUS_X86
+        case Isa::SSE42:
+            return step_sse42;
+        case Isa::AVX2:
+            return step_avx2;
+        case Isa::AVX512:
+            return step_avx512;
+#endif
+        default:
+            return step_portable;
+    }
+}
+
+// Get batch kernel for given instruction set, which must be supported
+inline BatchKernel batch_kernel( Isa isa )
+{
+    switch( isa ) {
+#ifdef SCIENTIFIC_ML_MAX_PLUS_X86
+        case Isa::SSE42:
+            return step_batch_sse42;
+        case Isa::AVX2:
+            return step_batch_avx2;
+        case Isa::AVX512:
+            return step_batch_avx512;
+#endif
+        default:
+            return step_batch_portable;
+    }
+}
+
+// Get the widest instruction set supported by the CPU
+inline Isa best_isa()
+{
+    for( Isa isa: { Isa::AVX512, Isa::AVX2, Isa::SSE42 } ) {
+        if( supported( isa ) ) {
+            return isa;
+        }
+    }
+    return Isa::SCALAR;
+}
+
+inline const char* isa_name( Isa isa )
+{
+    switch( isa ) {
+        case Isa::SSE42:
+            return "sse4.2";
+        case Isa::AVX2:
+            return "avx2";
+        case Isa::AVX512:
+            return "avx512";
+        default:
+            return "scalar";
+    }
+}
+
+// Beam pruning of rolling vector of n best path probabilities: values lower
+// than the maximum by more than beam are set to -infinity, so that paths through
+// them are never extended. Infinite beam prunes nothing. Returns the maximum
+inline double prune( double* current, unsigned n, double beam )
+{
+    const double best      = *std::max_element( current, current + n );
+    const double threshold = best - beam;
+    for( unsigned i = 0; i < n; ++i ) {
+        current[i] = current[i] < threshold ? -std::numeric_limits<double>::infinity()
+                                            : current[i];
+    }
+    return best;
+}
+
+// Kernels selected once, at program startup
+inline const Kernel step            = kernel( best_isa() );
+inline const BatchKernel step_batch = batch_kernel( best_isa() );
+
+}}} // namespace scientific::ml::max_plus
+
+#endif // SCIENTIFIC_ML_MAX_PLUS_H
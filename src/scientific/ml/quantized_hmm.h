@@ -0,0 +1,530 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#ifndef SCIENTIFIC_ML_QUANTIZED_HMM_H
+#define SCIENTIFIC_ML_QUANTIZED_HMM_H
+
+#include "fixed_hmm.h"
+#include "max_plus.h"
+#include "smart_hmm.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+namespace scientific { namespace ml {
+
+// Scorer using HMM of N states and alphabet of at most A characters, as FixedHmm,
+// with log10 probabilities quantized to float or to int16_t fixed point numbers.
+// Tables take two or four times less cache than doubles, and the same registers
+// hold two or four times more states. Scores of all states are kept in a few
+// vector registers of width native to each instruction set variant.
+//
+// Fixed point scores are log10 probabilities multiplied by scale, chosen so that
+// every table entry not lower than -LOG10_RANGE is at least MIN_FINITE. Lower ones
+// are considered impossible and quantized to IMPOSSIBLE score, so low that every
+// sum with it is lower than any sum of possible scores. After every addition sums
+// lower than possible ones are set back to IMPOSSIBLE, so they never overflow and
+// impossible paths never win the max over possible ones. After every step of
+// Viterbi recurrence scores are shifted, so that the best one is 0, the shift is
+// accumulated in double and paths less probable than the best one by more than
+// FLOOR are pruned, i.e. made impossible, as with finite beam in
+// Hmm::find_viterbi_score_bounded. Scores are never raised, and sequences
+// impossible in the HMM get -infinity scores, as in Hmm.
+template<unsigned N, unsigned A, class T>
+class QuantizedHmm : public HmmScorer
+{
+    static_assert( N > 0 && A > 0 && A < 256, "Invalid HMM size" );
+    static_assert( ( N & ( N - 1 ) ) == 0, "Number of states must be a power of 2" );
+    static_assert( std::is_same<T, float>::value || std::is_same<T, int16_t>::value,
+                   "Scores must be float or int16_t" );
+
+  private:
+    static constexpr bool FIXED_POINT = std::is_integral<T>::value;
+    // Lowest fixed point score of possible state, relative to the best one
+    static constexpr T FLOOR = FIXED_POINT ? std::numeric_limits<T>::lowest() / 4
+                                           : -std::numeric_limits<T>::infinity();
+    // Lowest fixed point score of possible initial states, transitions and emissions
+    static constexpr T MIN_FINITE = std::numeric_limits<T>::lowest() / 8 + 1;
+    // Score of impossible states, initial states, transitions and emissions.
+    // Sum of two of them is not lower than the lowest value of T, and sum
+    // of possible state, transition and emission is higher than it
+    static constexpr T IMPOSSIBLE = FIXED_POINT ? std::numeric_limits<T>::lowest() / 2
+                                                : -std::numeric_limits<T>::infinity();
+    static_assert( not FIXED_POINT || IMPOSSIBLE < FLOOR + 2 * MIN_FINITE,
+                   "Impossible scores must be lower than possible ones" );
+    // Lowest log10 probability quantized to fixed point score of possible one
+    static constexpr double LOG10_RANGE = 8;
+
+    // Scores of all states, split into vectors of at most given number of bytes,
+    // which are loaded directly from tables
+    template<unsigned BYTES>
+    struct Registers
+    {
+        static constexpr unsigned WIDTH = std::min<unsigned>( BYTES, N * sizeof( T ) );
+        static constexpr unsigned COUNT = N * sizeof( T ) / WIDTH;
+        static constexpr unsigned LANES = WIDTH / sizeof( T );
+        typedef T Vector __attribute__( ( vector_size( WIDTH ), may_alias ) );
+    };
+
+    using ScoreFunction = double ( QuantizedHmm::* )(
+      const char*, std::size_t, const char*, double, double, bool& ) const;
+    using BatchFunction = void ( QuantizedHmm::* )(
+      const char* const*, const std::size_t*, std::size_t, double*, const char* ) const;
+
+    alignas( 64 ) T log_initial_states_[N];   // Quantized log10 of initial states probabilities
+    alignas( 64 ) T log_transitions_[N][N];   // Quantized log10 of transitions, [from][to]
+    alignas( 64 ) T log_emissions_[A + 1][N]; // Quantized log10 of emissions, [symbol][state],
+                                              // symbol A stands for unknown characters
+    uint8_t symbols_[256];                    // Symbol of each character
+    double scale_;                            // Quantized scores per log10 unit
+    ScoreFunction score_function_;            // Scoring compiled for the CPU
+    ScoreFunction bounded_function_;          // Bounded scoring compiled for the CPU
+    BatchFunction batch_function_;            // Batch scoring compiled for the CPU
+
+    // Get symbol of given character
+    unsigned symbol( char c ) const
+    {
+        return symbols_[uint8_t( c )];
+    }
+
+    // Quantize log10 probability with given scale
+    static T quantize( double log_prob, double scale )
+    {
+        if( FIXED_POINT ) {
+            double q = std::round( log_prob * scale );
+            return q >= MIN_FINITE ? T( q ) : IMPOSSIBLE;
+        }
+        return T( log_prob );
+    }
+
+    // Viterbi recurrence over quantized scores, in vectors of at most given
+    // number of bytes. Limit and beam are used by bounded variant only,
+    // see Hmm::find_viterbi_score_bounded
+    template<unsigned BYTES, bool bounded>
+    __attribute__( ( always_inline ) ) inline double score_inline( const char* sequence,
+                                                                   std::size_t length,
+                                                                   const char* terminator,
+                                                                   double limit,
+                                                                   double beam,
+                                                                   bool& stopped ) const
+    {
+        using Vector         = typename Registers<BYTES>::Vector;
+        constexpr unsigned C = Registers<BYTES>::COUNT;
+        constexpr unsigned L = Registers<BYTES>::LANES;
+
+        stopped                 = false;
+        const std::size_t total = length + ( terminator ? 1 : 0 );
+        if( total == 0 ) {
+            return -std::numeric_limits<double>::infinity();
+        }
+        auto load = []( const T* row, unsigned c ) -> const Vector& {
+            return *reinterpret_cast<const Vector*>( row + c * L );
+        };
+        auto best_of = []( const Vector* scores ) {
+            Vector v = scores[0];
+            for( unsigned c = 1; c < C; ++c ) {
+                v = v < scores[c] ? scores[c] : v;
+            }
+            T best = v[0];
+            for( unsigned l = 1; l < L; ++l ) {
+                best = best < v[l] ? v[l] : best;
+            }
+            return best;
+        };
+        double shift = 0; // Sum of best scores subtracted from current ones
+        Vector current[C];
+        Vector next[C];
+        T sources[N]; // Scores of source states, broadcast from memory
+
+        // Fixed point score of the best path, or -infinity if all paths are impossible
+        auto unscaled = [this, &shift]( T best ) {
+            return FIXED_POINT && best < FLOOR + 2 * MIN_FINITE
+                     ? -std::numeric_limits<double>::infinity()
+                     : ( shift + best ) / scale_;
+        };
+
+        const T* emission = log_emissions_[symbol( length ? sequence[0] : *terminator )];
+        for( unsigned c = 0; c < C; ++c ) {
+            current[c] = load( log_initial_states_, c ) + load( emission, c );
+        }
+        for( std::size_t t = 1; t < total; ++t ) {
+            if( FIXED_POINT || bounded ) {
+                const T best = best_of( current );
+                if( FIXED_POINT && best < FLOOR + 2 * MIN_FINITE ) {
+                    return -std::numeric_limits<double>::infinity();
+                }
+                if( bounded ) {
+                    if( ( shift + best ) / scale_ < limit ) {
+                        stopped = true;
+                        return ( shift + best ) / scale_;
+                    }
+                    const T threshold =
+                      T( std::max( best - beam * scale_, double( best + FLOOR ) ) );
+                    for( unsigned c = 0; c < C; ++c ) {
+                        current[c] = current[c] < threshold ? IMPOSSIBLE : current[c];
+                    }
+                }
+                if( FIXED_POINT ) {
+                    // Impossible and least probable paths are pruned, so that
+                    // scores are never raised
+                    for( unsigned c = 0; c < C; ++c ) {
+                        Vector shifted = current[c] - best;
+                        current[c]     = current[c] < FLOOR + 2 * MIN_FINITE || shifted < FLOOR
+                                           ? IMPOSSIBLE
+                                           : shifted;
+                    }
+                    shift += best;
+                }
+            }
+            emission = log_emissions_[symbol( t < length ? sequence[t] : *terminator )];
+            std::memcpy( sources, current, sizeof( sources ) );
+            for( unsigned c = 0; c < C; ++c ) {
+                next[c] = sources[0] + load( log_transitions_[0], c );
+            }
+            for( unsigned k = 1; k < N; ++k ) {
+                for( unsigned c = 0; c < C; ++c ) {
+                    Vector candidate = sources[k] + load( log_transitions_[k], c );
+                    next[c]          = next[c] < candidate ? candidate : next[c];
+                }
+            }
+            for( unsigned c = 0; c < C; ++c ) {
+                if( FIXED_POINT ) {
+                    next[c] = next[c] < FLOOR + MIN_FINITE ? IMPOSSIBLE : next[c];
+                }
+                current[c] = next[c] + load( emission, c );
+            }
+        }
+        return unscaled( best_of( current ) );
+    }
+
+    // Viterbi recurrence of many sequences over quantized scores, in vectors of
+    // given number of bytes. When scores of all states of a sequence fill such
+    // vector, sequences are scored one by one. Otherwise they are scored in groups,
+    // with lane l of vector i holding score of state i of l-th sequence of group,
+    // so that every vector is full. Scores are the same as of score_inline
+    template<unsigned BYTES>
+    __attribute__( ( always_inline ) ) inline void
+    score_batch_inline( const char* const* sequences,
+                        const std::size_t* lengths,
+                        std::size_t count,
+                        double* scores,
+                        const char* terminator ) const
+    {
+        if constexpr( Registers<BYTES>::WIDTH == BYTES ) {
+            bool stopped;
+            for( std::size_t s = 0; s < count; ++s ) {
+                scores[s] = score_inline<BYTES, false>(
+                  sequences[s], lengths[s], terminator, 0, 0, stopped );
+            }
+            return;
+        }
+        constexpr unsigned L = BYTES / sizeof( T );
+        typedef T Vector __attribute__( ( vector_size( BYTES ) ) );
+        Vector current[N]; // Scores of state i of group sequences
+        Vector next[N];
+        Vector emission[N] = {}; // Filled lane by lane
+        double shift[L]; // Sums of best scores subtracted from current ones
+
+        for( std::size_t first = 0; first < count; first += L ) {
+            const unsigned lanes = std::min<std::size_t>( L, count - first );
+            std::size_t total[L]; // Number of elements of group sequences
+            std::size_t steps = 0;
+            for( unsigned l = 0; l < L; ++l ) {
+                total[l] = l < lanes ? lengths[first + l] + ( terminator ? 1 : 0 ) : 0;
+                steps    = std::max( steps, total[l] );
+                shift[l] = 0;
+                if( l < lanes && total[l] == 0 ) {
+                    scores[first + l] = -std::numeric_limits<double>::infinity();
+                }
+            }
+            for( std::size_t t = 0; t < steps; ++t ) {
+                // Lanes of finished and missing sequences repeat the first symbol,
+                // their scores are not used
+                for( unsigned l = 0; l < L; ++l ) {
+                    unsigned s = 0;
+                    if( t < total[l] ) {
+                        s = symbol( t < lengths[first + l] ? sequences[first + l][t]
+                                                           : *terminator );
+                    }
+                    for( unsigned i = 0; i < N; ++i ) {
+                        emission[i][l] = log_emissions_[s][i];
+                    }
+                }
+                if( t == 0 ) {
+                    for( unsigned i = 0; i < N; ++i ) {
+                        current[i] = log_initial_states_[i] + emission[i];
+                    }
+                } else {
+                    if( FIXED_POINT ) {
+                        // Lanes of impossible sequences are pruned to IMPOSSIBLE
+                        // scores and stay there, instead of returning early
+                        Vector best = current[0];
+                        for( unsigned i = 1; i < N; ++i ) {
+                            best = best < current[i] ? current[i] : best;
+                        }
+                        for( unsigned i = 0; i < N; ++i ) {
+                            Vector shifted = current[i] - best;
+                            current[i] = current[i] < FLOOR + 2 * MIN_FINITE || shifted < FLOOR
+                                           ? IMPOSSIBLE
+                                           : shifted;
+                        }
+                        for( unsigned l = 0; l < L; ++l ) {
+                            shift[l] += best[l];
+                        }
+                    }
+                    for( unsigned i = 0; i < N; ++i ) {
+                        next[i] = current[0] + log_transitions_[0][i];
+                        for( unsigned k = 1; k < N; ++k ) {
+                            Vector candidate = current[k] + log_transitions_[k][i];
+                            next[i]          = next[i] < candidate ? candidate : next[i];
+                        }
+                        if( FIXED_POINT ) {
+                            next[i] = next[i] < FLOOR + MIN_FINITE ? IMPOSSIBLE : next[i];
+                        }
+                    }
+                    for( unsigned i = 0; i < N; ++i ) {
+                        current[i] = next[i] + emission[i];
+                    }
+                }
+                // Collect scores of sequences ending at this element
+                for( unsigned l = 0; l < lanes; ++l ) {
+                    if( total[l] == t + 1 ) {
+                        T best = current[0][l];
+                        for( unsigned i = 1; i < N; ++i ) {
+                            best = best < current[i][l] ? current[i][l] : best;
+                        }
+                        scores[first + l] = FIXED_POINT && best < FLOOR + 2 * MIN_FINITE
+                                              ? -std::numeric_limits<double>::infinity()
+                                              : ( shift[l] + best ) / scale_;
+                    }
+                }
+            }
+        }
+    }
+
+    void score_batch_baseline( const char* const* sequences,
+                               const std::size_t* lengths,
+                               std::size_t count,
+                               double* scores,
+                               const char* terminator ) const
+    {
+        score_batch_inline<16>( sequences, lengths, count, scores, terminator );
+    }
+#ifdef SCIENTIFIC_ML_MAX_PLUS_X86
+    __attribute__( ( target( "sse4.2" ) ) ) void
+    score_batch_sse42( const char* const* sequences,
+                       const std::size_t* lengths,
+                       std::size_t count,
+                       double* scores,
+                       const char* terminator ) const
+    {
+        score_batch_inline<16>( sequences, lengths, count, scores, terminator );
+    }
+    __attribute__( ( target( "avx2" ) ) ) void
+    score_batch_avx2( const char* const* sequences,
+                      const std::size_t* lengths,
+                      std::size_t count,
+                      double* scores,
+                      const char* terminator ) const
+    {
+        score_batch_inline<32>( sequences, lengths, count, scores, terminator );
+    }
+    __attribute__( ( target( "avx512f,avx512bw" ) ) ) void
+    score_batch_avx512( const char* const* sequences,
+                        const std::size_t* lengths,
+                        std::size_t count,
+                        double* scores,
+                        const char* terminator ) const
+    {
+        score_batch_inline<64>( sequences, lengths, count, scores, terminator );
+    }
+#endif
+
+    template<bool bounded>
+    double score_baseline( const char* sequence,
+                           std::size_t length,
+                           const char* terminator,
+                           double limit,
+                           double beam,
+                           bool& stopped ) const
+    {
+        return score_inline<16, bounded>( sequence, length, terminator, limit, beam, stopped );
+    }
+#ifdef SCIENTIFIC_ML_MAX_PLUS_X86
+    template<bool bounded>
+    __attribute__( ( target( "sse4.2" ) ) ) double score_sse42( const char* sequence,
+                                                              std::size_t length,
+                                                              const char* terminator,
+                                                              double limit,
+                                                              double beam,
+                                                              bool& stopped ) const
+    {
+        return score_inline<16, bounded>( sequence, length, terminator, limit, beam, stopped );
+    }
+    template<bool bounded>
+    __attribute__( ( target( "avx2" ) ) ) double score_avx2( const char* sequence,
+                                                           std::size_t length,
+                                                           const char* terminator,
+                                                           double limit,
+                                                           double beam,
+                                                           bool& stopped ) const
+    {
+        return score_inline<32, bounded>( sequence, length, terminator, limit, beam, stopped );
+    }
+    // 16-bit elements of 512-bit vectors need AVX-512BW
+    template<bool bounded>
+    __attribute__( ( target( "avx512f,avx512bw" ) ) ) double
+    score_avx512( const char* sequence,
+                  std::size_t length,
+                  const char* terminator,
+                  double limit,
+                  double beam,
+                  bool& stopped ) const
+    {
+        return score_inline<64, bounded>( sequence, length, terminator, limit, beam, stopped );
+    }
+#endif
+
+  public:
+    // Check if given HMM has N states and at most A characters
+    static bool fits( const Hmm<char, std::string>& hmm )
+    {
+        return FixedHmm<N, A>::fits( hmm );
+    }
+
+    // Quantize log-space tables of given HMM, which must fit
+    explicit QuantizedHmm( const Hmm<char, std::string>& hmm )
+        : scale_( 1 )
+    {
+        if( not fits( hmm ) ) {
+            throw std::invalid_argument( "HMM does not fit quantized scorer!" );
+        }
+        const std::string alphabet        = hmm.get_alphabet();
+        const std::vector<double>& init   = hmm.get_log_initial_states();
+        const std::vector<double>& trans  = hmm.get_log_transitions();
+        const std::vector<double>& emis   = hmm.get_log_emissions();
+        const std::size_t emissions_count = ( alphabet.size() + 1 ) * N;
+
+        if( FIXED_POINT ) {
+            // Lowest log10 probability of possible entries in all tables
+            double lowest = -1;
+            auto update   = [&lowest]( const double* first, const double* last ) {
+                for( ; first != last; ++first ) {
+                    lowest = *first >= -LOG10_RANGE ? std::min( lowest, *first ) : lowest;
+                }
+            };
+            update( init.data(), init.data() + N );
+            update( trans.data(), trans.data() + N * N );
+            update( emis.data(), emis.data() + emissions_count );
+            scale_ = MIN_FINITE / lowest;
+        }
+
+        for( unsigned i = 0; i < N; ++i ) {
+            log_initial_states_[i] = quantize( init[i], scale_ );
+            for( unsigned j = 0; j < N; ++j ) {
+                log_transitions_[i][j] = quantize( trans[i * N + j], scale_ );
+            }
+        }
+        std::fill_n( &log_emissions_[0][0], ( A + 1 ) * N, IMPOSSIBLE );
+        for( unsigned s = 0; s < alphabet.size(); ++s ) {
+            for( unsigned i = 0; i < N; ++i ) {
+                log_emissions_[s][i] = quantize( emis[s * N + i], scale_ );
+            }
+        }
+        for( unsigned i = 0; i < N; ++i ) {
+            log_emissions_[A][i] = quantize( emis[alphabet.size() * N + i], scale_ );
+        }
+        // First occurence of character wins, as in Hmm
+        std::memset( symbols_, A, sizeof( symbols_ ) );
+        for( unsigned s = alphabet.size(); s-- > 0; ) {
+            symbols_[uint8_t( alphabet[s] )] = s;
+        }
+
+        score_function_   = &QuantizedHmm::score_baseline<false>;
+        bounded_function_ = &QuantizedHmm::score_baseline<true>;
+        batch_function_   = &QuantizedHmm::score_batch_baseline;
+#ifdef SCIENTIFIC_ML_MAX_PLUS_X86
+        switch( max_plus::best_isa() ) {
+            case max_plus::Isa::SSE42:
+                score_function_   = &QuantizedHmm::score_sse42<false>;
+                bounded_function_ = &QuantizedHmm::score_sse42<true>;
+                batch_function_   = &QuantizedHmm::score_batch_sse42;
+                break;
+            case max_plus::Isa::AVX2:
+                score_function_   = &QuantizedHmm::score_avx2<false>;
+                bounded_function_ = &QuantizedHmm::score_avx2<true>;
+                batch_function_   = &QuantizedHmm::score_batch_avx2;
+                break;
+            case max_plus::Isa::AVX512:
+                if( __builtin_cpu_supports( "avx512bw" ) ) {
+                    score_function_   = &QuantizedHmm::score_avx512<false>;
+                    bounded_function_ = &QuantizedHmm::score_avx512<true>;
+                    // Batches of fixed point scores are faster in 256-bit vectors,
+                    // see dfw3bench
+                    batch_function_ = FIXED_POINT ? &QuantizedHmm::score_batch_avx2
+                                                  : &QuantizedHmm::score_batch_avx512;
+                } else {
+                    score_function_   = &QuantizedHmm::score_avx2<false>;
+                    bounded_function_ = &QuantizedHmm::score_avx2<true>;
+                    batch_function_   = &QuantizedHmm::score_batch_avx2;
+                }
+                break;
+            default:
+                break;
+        }
+#endif
+    }
+
+    // Get number of quantized scores per log10 unit
+    double get_scale() const
+    {
+        return scale_;
+    }
+
+    double score( const char* sequence, std::size_t length, const char* terminator ) const
+      override
+    {
+        bool stopped;
+        return ( this->*score_function_ )( sequence, length, terminator, 0, 0, stopped );
+    }
+
+    void score( const char* const* sequences,
+                const std::size_t* lengths,
+                std::size_t count,
+                double* scores,
+                const char* terminator ) const override
+    {
+        ( this->*batch_function_ )( sequences, lengths, count, scores, terminator );
+    }
+
+    double score_bounded( const char* sequence,
+                          std::size_t length,
+                          const char* terminator,
+                          double limit,
+                          double beam,
+                          bool& stopped ) const override
+    {
+        return ( this->*bounded_function_ )(
+          sequence, length, terminator, limit, beam, stopped );
+    }
+};
+
+}} // namespace scientific::ml
+
+#endif // SCIENTIFIC_ML_QUANTIZED_HMM_H
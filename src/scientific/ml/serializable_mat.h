@@ -21,6 +21,7 @@
 #include <cereal/types/string.hpp>
 #include <cereal/types/unordered_map.hpp>
 #include <cereal/types/vector.hpp>
+#include <stdexcept>
 #include <vector>
 
 namespace scientific { namespace ml {
@@ -74,6 +75,89 @@ struct SerializableMat
     }
 };
 
+// Armadillo matrix serialized in compressed sparse row form, with only
+// non-zero elements of each row stored, for matrices with mostly zero elements
+struct SerializableSparseMat
+{
+    arma::mat m;
+
+    SerializableSparseMat()
+    {
+    }
+    explicit SerializableSparseMat( const arma::mat m )
+        : m( m )
+    {
+    }
+
+    // Serialize armadillo
+    template<class Archive>
+    void save( Archive& archive ) const
+    {
+        unsigned n_rows = m.n_rows;
+        unsigned n_cols = m.n_cols;
+        std::vector<unsigned> row_offsets( 1, 0 ); // Position of first element of each row
+        std::vector<unsigned> columns;             // Column of each element
+        std::vector<double> values;                // Value of each element
+
+        for( unsigned i = 0; i < n_rows; ++i ) {
+            for( unsigned j = 0; j < n_cols; ++j ) {
+                if( m( i, j ) != 0 ) {
+                    columns.push_back( j );
+                    values.push_back( m( i, j ) );
+                }
+            }
+            row_offsets.push_back( values.size() );
+        }
+
+        archive( n_rows, n_cols, row_offsets, columns, values );
+    }
+
+    // Deserialize armadillo
+    template<class Archive>
+    void load( Archive& archive )
+    {
+        unsigned n_rows;
+        unsigned n_cols;
+        std::vector<unsigned> row_offsets;
+        std::vector<unsigned> columns;
+        std::vector<double> values;
+
+        archive( n_rows, n_cols, row_offsets, columns, values );
+        if( row_offsets.size() != n_rows + 1 || columns.size() != values.size() ||
+            row_offsets.back() != values.size() ) {
+            throw std::invalid_argument( "Sparse matrix is malformed!" );
+        }
+
+        arma::mat m2( n_rows, n_cols );
+        m2.fill( 0 );
+        for( unsigned i = 0; i < n_rows; ++i ) {
+            if( row_offsets[i] > row_offsets[i + 1] ) {
+                throw std::invalid_argument( "Sparse matrix is malformed!" );
+            }
+            for( unsigned e = row_offsets[i]; e < row_offsets[i + 1]; ++e ) {
+                if( columns[e] >= n_cols ) {
+                    throw std::invalid_argument( "Sparse matrix is malformed!" );
+                }
+                m2( i, columns[e] ) = values[e];
+            }
+        }
+        m = m2;
+    }
+
+    // Check if given matrix is stored in less space in sparse form
+    static bool is_sparse( const arma::mat& mat )
+    {
+        // Sparse form stores column index of 4 bytes for every value of 8 bytes
+        std::size_t non_zeros = 0;
+        for( unsigned i = 0; i < mat.n_rows; ++i ) {
+            for( unsigned j = 0; j < mat.n_cols; ++j ) {
+                non_zeros += mat( i, j ) != 0;
+            }
+        }
+        return non_zeros * 12 + ( mat.n_rows + 1 ) * 4 < std::size_t( mat.n_elem ) * 8;
+    }
+};
+
 }} // namespace scientific::ml
 
 #endif // SCIENTIFIC_ML_SERIALIZABLE_MAT_H
\ No newline at end of file
@@ -15,6 +15,7 @@
 #ifndef SCIENTIFIC_ML_SMART_HMM_H
 #define SCIENTIFIC_ML_SMART_HMM_H
 
+#include "max_plus.h"
 #include "serializable_mat.h"
 #include <algorithm>
 #include <armadillo>
@@ -24,14 +25,17 @@
 #include <cereal/types/unordered_map.hpp>
 #include <cereal/types/vector.hpp>
 #include <cmath>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <limits>
 #include <mutex>
+#include <random>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <unistd.h>
 #include <unordered_map>
 #include <vector>
@@ -79,13 +83,71 @@ class Hmm
     S alphabet;
     unsigned processed_lines;
     std::vector<S> learning_buffer;
+    std::vector<double> learning_weights; // Weights of buffered sequences, not serialized
     std::mutex mutex;
 
+    // Log-space tables for scoring, derived from matrices above
+    std::vector<double> log_initial_states; // log10 of initial states probabilities
+    std::vector<double> log_transitions;    // log10 of transitions, [from * N + to]
+    std::vector<double> log_emissions;      // log10 of emissions, [symbol * N + state],
+                                            // last symbol stands for unknown elements
+    uint8_t symbols[256];   // Symbol of each one-byte element, alphabet size if unknown
+    double unknown_penalty; // Minus log10 of emission probability of unknown elements
+
+    // Non-zero transitions in compressed sparse column form: transitions into state i
+    // are at [predecessor_offsets[i], predecessor_offsets[i + 1]), in order of sources
+    std::vector<unsigned> predecessor_offsets;
+    std::vector<unsigned> predecessor_states;
+    std::vector<double> predecessor_log_transitions;
+    bool sparse_scoring;        // Viterbi scoring iterates over non-zero transitions only
+    double transitions_epsilon; // Transitions less probable are pruned on every update
+    unsigned learning_threads;  // Threads finding Viterbi paths in learn_parallel, 0 for all
+    bool learning_determinism;  // Results of learn_parallel do not depend on threads
+
+    // Number of shards of learning buffer counted separately by deterministic
+    // learn_parallel, independent of number of threads
+    static constexpr unsigned LEARNING_SHARDS = 64;
+
     // Normalize given matrix in rows
     arma::mat normalize_rows( const arma::mat& ) const;
     // Normalize transitions and emissions matrices
     void normalize();
-    // Return internal index of given output character
+    // Recompute log-space tables after matrices change
+    void compute_log_tables();
+    // Add states of Viterbi path of given sequence, multiplied by given weight,
+    // to given counts
+    void count_viterbi_path( const S&,
+                             double weight,
+                             arma::mat& initial,
+                             arma::mat& trans,
+                             arma::mat& emis );
+    // Add expected counts of initial states, transitions and emissions of given
+    // sequence, multiplied by given weight, to given counts, using scaled
+    // forward-backward algorithm. Returns log10 probability of the sequence,
+    // or -inf if it is impossible, and then nothing is counted
+    double count_expected( const S&,
+                           double weight,
+                           arma::mat& initial,
+                           arma::mat& trans,
+                           arma::mat& emis ) const;
+    // Call count( i, initial, trans, emis ) for sequences 0 to size - 1 in parallel.
+    // Sequences are split into given number of parts, each counted by one thread
+    // at a time into its own matrices, which are then added to given counts
+    // in order of parts. Returns sum of results of count
+    template<class Count>
+    double count_parallel( std::size_t size,
+                           unsigned parts,
+                           Count count,
+                           arma::mat& initial,
+                           arma::mat& trans,
+                           arma::mat& emis );
+    // Count Viterbi paths of all buffered sequences in parallel into *_prim matrices
+    void learn_buffered();
+    // One step of Viterbi recurrence in log space, see max_plus::Kernel,
+    // over non-zero transitions only if most of transitions are zero
+    void viterbi_step( const double* current, const double* emission, double* next ) const;
+    // Return internal index of given output character, or alphabet size
+    // if it is not in the alphabet. Never throws
     unsigned out_index( E ) const;
     // Given vector of N probabilities (summing up to 1),
     // function returns unsigned from 0 to N-1
@@ -100,6 +162,9 @@ class Hmm
     Hmm( const Hmm& );
     // Assumes random, uniformly distributed probabilities for transitions and emissions
     Hmm( unsigned num_states, const S& );
+    // Assumes random probabilities drawn from given seed, which are the same
+    // on every platform, unlike the ones of Armadillo random generator
+    Hmm( unsigned num_states, const S&, uint32_t seed );
     // Construct an HMM object with given transitions and emissions probabilities
     // Transition and emission probabilities are scaled down to sum 1
     Hmm( const arma::mat& transitions,
@@ -123,6 +188,37 @@ class Hmm
     double get_emission( unsigned, E ) const;
     // Get transitions probability
     double get_transition( unsigned state_from, unsigned state_to ) const;
+    // Get log10 of initial states probabilities
+    const std::vector<double>& get_log_initial_states() const;
+    // Get log10 of transitions probabilities, [from * N + to]
+    const std::vector<double>& get_log_transitions() const;
+    // Get log10 of emissions probabilities, [symbol * N + state]
+    // Row after the alphabet holds emissions of unknown elements
+    const std::vector<double>& get_log_emissions() const;
+    // Check if all elements of given sequence are in the alphabet,
+    // in time proportional to its length
+    bool in_alphabet( const S& ) const;
+    // Get penalty of unknown elements, see set_unknown_penalty
+    double get_unknown_penalty() const;
+    // Set minus log10 of emission probability of elements not in the alphabet,
+    // in every state. Infinite by default, so unknown elements are impossible.
+    // Must not be negative, so that probabilities of paths never grow
+    void set_unknown_penalty( double );
+    // Get number of non-zero transitions
+    unsigned get_transitions_count() const;
+    // Check if most of transitions are zero, so that Viterbi algorithm
+    // iterates over non-zero ones only
+    bool has_sparse_transitions() const;
+    // Prune transitions less probable than given epsilon to zero, keeping
+    // the most probable transition from each state, and normalize the rest.
+    // Pruned transitions are never learned again, as Viterbi paths skip them
+    void prune_transitions( double epsilon );
+    // Set epsilon of transitions pruned on every update, see prune_transitions.
+    // Zero by default, so that transitions are never pruned
+    void set_transitions_epsilon( double );
+    // Set number of threads used by learn_parallel, 0 for all cores (default),
+    // and whether its results must not depend on number of threads
+    void set_learning_threads( unsigned threads, bool deterministic );
 
     // Move HMM machine to the next state and return an output char,
     // according to current transitions and emissions probabilities.
@@ -134,13 +230,81 @@ class Hmm
     Path generate_sequence( E end_char );
     // Find Viterbi path for given sequence
     Path find_viterbi_path( const S& sequence );
+    // Find log10 probability of Viterbi path for given sequence, followed by
+    // optional terminator element. Same as find_viterbi_path( sequence ).prob,
+    // but works in log space, so it does not underflow for long sequences,
+    // does not compute the path and does not allocate memory
+    double find_viterbi_score( const E* sequence,
+                               std::size_t length,
+                               const E* terminator = nullptr ) const;
+    // Find log10 probability of Viterbi path as find_viterbi_score, but stop
+    // as soon as the best partial path is less probable than given limit and
+    // return its probability. Probabilities of partial paths never grow, so it is
+    // an upper bound of the exact result, also below the limit. States less
+    // probable than the best one by more than beam (in log10) are pruned, so for
+    // finite beam the result may be lower than the exact one.
+    // Sets stopped if scoring stopped before the last element
+    double find_viterbi_score_bounded( const E* sequence,
+                                       std::size_t length,
+                                       const E* terminator,
+                                       double limit,
+                                       double beam,
+                                       bool& stopped ) const;
+    // Find log10 probabilities of Viterbi paths for many sequences at once, each
+    // followed by optional terminator element. Sequences are scored in groups
+    // of max_plus::LANES, sharing transitions, so that SIMD lanes are filled
+    // even for small number of states (bigger models are scored one by one).
+    // Results are the same as of find_viterbi_score
+    void find_viterbi_scores( const E* const* sequences,
+                              const std::size_t* lengths,
+                              std::size_t count,
+                              double* scores,
+                              const E* terminator = nullptr ) const;
     // Learn HMM utilizing Baum-Welch algorithm
     // If update = false, transitions and emissions matrices
     // are not instantly updated, but rather learning state
     // is accumulated in *_prim matrices, and then applied
     // when calling update() method
     void learn( const S& sequence, double, unsigned batch_size );
-    void learn_parallel( const S& sequence, double, unsigned batch_size );
+    // Learn HMM as learn() does, but buffer sequences up to the end of current
+    // batch and find their Viterbi paths in parallel, see set_learning_threads.
+    // Each thread, or each of LEARNING_SHARDS parts of the batch if learning is
+    // deterministic, accumulates its own counts, which are then summed up in order.
+    // Sequence of given weight counts as that many sequences, learned at once
+    void learn_parallel( const S& sequence, double, unsigned batch_size, double weight = 1 );
+    // Accumulate sequences buffered by learn_parallel in *_prim matrices,
+    // without update, as learn() leaves sequences of unfinished batch
+    void flush_learning_buffer();
+    // Learn HMM with one epoch of Baum-Welch algorithm over given sequences.
+    // Expected counts are found in parallel, see set_learning_threads, always
+    // in LEARNING_SHARDS parts, so that results do not depend on threads.
+    // Counts replace probabilities, with given pseudo count added to counts
+    // of non-zero ones; states never visited keep their probabilities.
+    // Sequences are weighted with given weights, or all weigh 1 if there are none.
+    // Returns weighted sum of log10 probabilities of sequences before the update
+    double learn_baum_welch( const std::vector<S>& sequences,
+                             const std::vector<double>& weights,
+                             double pseudo_count );
+    // Accumulate sequences as learn_parallel does, but never update, so that all
+    // of them are counted against the same model, as by every shard of dataset
+    // in sharded training. Buffered sequences are counted in parallel as soon as
+    // batch_size of them are buffered, the rest by flush_learning_buffer
+    void accumulate_parallel( const S& sequence, unsigned batch_size, double weight = 1 );
+    // Accumulate expected counts of sequences in *_prim matrices, as expectation
+    // step of learn_baum_welch does, without update. Sequences are weighted with
+    // given weights, or all weigh 1 if there are none.
+    // Returns weighted sum of log10 probabilities of sequences
+    double accumulate_baum_welch( const std::vector<S>& sequences,
+                                  const std::vector<double>& weights );
+    // Replace probabilities with counts accumulated in *_prim matrices,
+    // as maximization step of learn_baum_welch does, and clear them
+    void maximize( double pseudo_count );
+    // Add learning state accumulated by given HMM to learning state of this one,
+    // so that counts of many shards of dataset are summed up. Both HMMs must have
+    // the same probabilities, otherwise counts are not additive and it throws
+    void add_learning_state( const Hmm<E, S>& );
+    // Discard learning state accumulated so far, with buffered sequences
+    void clear_learning_state();
     // Update transitions and emisisons matrices
     // with accumulated learning state
     void update( double );
@@ -182,7 +346,13 @@ class Hmm
 // Requires loading HMM object from file (serialization) before use
 template<class E, class S>
 Hmm<E, S>::Hmm()
+    : unknown_penalty( std::numeric_limits<double>::infinity() )
+    , sparse_scoring( false )
+    , transitions_epsilon( 0 )
+    , learning_threads( 0 )
+    , learning_determinism( false )
 {
+    compute_log_tables();
 }
 
 // Copy constructor
@@ -198,7 +368,20 @@ Hmm<E, S>::Hmm( const Hmm<E, S>& hmm )
     , alphabet( hmm.alphabet )
     , processed_lines( hmm.processed_lines )
     , learning_buffer( hmm.learning_buffer )
+    , learning_weights( hmm.learning_weights )
+    , log_initial_states( hmm.log_initial_states )
+    , log_transitions( hmm.log_transitions )
+    , log_emissions( hmm.log_emissions )
+    , unknown_penalty( hmm.unknown_penalty )
+    , predecessor_offsets( hmm.predecessor_offsets )
+    , predecessor_states( hmm.predecessor_states )
+    , predecessor_log_transitions( hmm.predecessor_log_transitions )
+    , sparse_scoring( hmm.sparse_scoring )
+    , transitions_epsilon( hmm.transitions_epsilon )
+    , learning_threads( hmm.learning_threads )
+    , learning_determinism( hmm.learning_determinism )
 {
+    std::copy( hmm.symbols, hmm.symbols + 256, symbols );
 }
 
 // Assumes random probability distribution for transitions and emissions
@@ -213,6 +396,11 @@ Hmm<E, S>::Hmm( unsigned num_states, const S& alphabet )
     , emissions_prim( num_states, alphabet.size() )
     , alphabet( alphabet )
     , processed_lines( 0 )
+    , unknown_penalty( std::numeric_limits<double>::infinity() )
+    , sparse_scoring( false )
+    , transitions_epsilon( 0 )
+    , learning_threads( 0 )
+    , learning_determinism( false )
 {
     normalize();
     initial_states_prim.fill( 0 );
@@ -221,6 +409,21 @@ Hmm<E, S>::Hmm( unsigned num_states, const S& alphabet )
     current_state = random_element( initial_states );
 }
 
+// Draws random probabilities from Mersenne Twister, whose raw output is fixed
+// by the standard, while distributions of the standard library are not
+template<class E, class S>
+Hmm<E, S>::Hmm( unsigned num_states, const S& alphabet, uint32_t seed )
+    : Hmm( num_states, alphabet )
+{
+    std::mt19937 generator( seed );
+    for( arma::mat* probabilities: { &initial_states, &transitions, &emissions } ) {
+        for( unsigned i = 0; i < probabilities->n_elem; ++i ) {
+            ( *probabilities )( i ) = ( generator() + 0.5 ) / 4294967296.0;
+        }
+    }
+    normalize();
+}
+
 // Construct an HMM object with given transitions and emissions probabilities
 // Transition and emission probabilities are scaled down to sum 1
 template<class E, class S>
@@ -236,6 +439,11 @@ Hmm<E, S>::Hmm( const arma::mat& transitions,
     , emissions_prim( emissions )
     , alphabet( alphabet )
     , processed_lines( 0 )
+    , unknown_penalty( std::numeric_limits<double>::infinity() )
+    , sparse_scoring( false )
+    , transitions_epsilon( 0 )
+    , learning_threads( 0 )
+    , learning_determinism( false )
 {
     bool valid_sizes =
       initial_states.n_cols == transitions.n_cols && transitions.n_rows == transitions.n_cols &&
@@ -291,17 +499,16 @@ void Hmm<E, S>::set_initial_states( const arma::mat& initial_states_ )
         throw std::invalid_argument( "Vector of initial probabilities is of invalid length!" );
     }
     initial_states = initial_states_;
+    compute_log_tables();
 }
 
 // Get emission probability
 template<class E, class S>
 double Hmm<E, S>::get_emission( unsigned state, E e ) const
 {
-    unsigned i = 0;
-    for( i = 0; i < alphabet.size(); ++i ) {
-        if( alphabet[i] == e ) {
-            break;
-        }
+    unsigned i = out_index( e );
+    if( i == alphabet.size() ) {
+        return pow( 10, -unknown_penalty );
     }
     return emissions( state, i );
 }
@@ -313,6 +520,107 @@ double Hmm<E, S>::get_transition( unsigned state_from, unsigned state_to ) const
     return transitions( state_from, state_to );
 }
 
+// Get log10 of initial states probabilities
+template<class E, class S>
+const std::vector<double>& Hmm<E, S>::get_log_initial_states() const
+{
+    return log_initial_states;
+}
+
+// Get log10 of transitions probabilities
+template<class E, class S>
+const std::vector<double>& Hmm<E, S>::get_log_transitions() const
+{
+    return log_transitions;
+}
+
+// Get log10 of emissions probabilities
+template<class E, class S>
+const std::vector<double>& Hmm<E, S>::get_log_emissions() const
+{
+    return log_emissions;
+}
+
+// Check if all elements of given sequence are in the alphabet
+template<class E, class S>
+bool Hmm<E, S>::in_alphabet( const S& sequence ) const
+{
+    for( const E& e: sequence ) {
+        if( out_index( e ) == alphabet.size() ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Get penalty of unknown elements
+template<class E, class S>
+double Hmm<E, S>::get_unknown_penalty() const
+{
+    return unknown_penalty;
+}
+
+// Set penalty of unknown elements
+template<class E, class S>
+void Hmm<E, S>::set_unknown_penalty( double penalty )
+{
+    if( not( penalty >= 0 ) ) {
+        throw std::invalid_argument( "Unknown element penalty must not be negative!" );
+    }
+    unknown_penalty = penalty;
+    compute_log_tables();
+}
+
+// Get number of non-zero transitions
+template<class E, class S>
+unsigned Hmm<E, S>::get_transitions_count() const
+{
+    return predecessor_states.size();
+}
+
+// Check if most of transitions are zero
+template<class E, class S>
+bool Hmm<E, S>::has_sparse_transitions() const
+{
+    return sparse_scoring;
+}
+
+// Prune transitions less probable than given epsilon
+template<class E, class S>
+void Hmm<E, S>::prune_transitions( double epsilon )
+{
+    for( unsigned i = 0; i < transitions.n_rows; ++i ) {
+        unsigned most_probable = 0;
+        for( unsigned j = 1; j < transitions.n_cols; ++j ) {
+            if( transitions( i, j ) > transitions( i, most_probable ) ) {
+                most_probable = j;
+            }
+        }
+        for( unsigned j = 0; j < transitions.n_cols; ++j ) {
+            if( transitions( i, j ) < epsilon && j != most_probable ) {
+                transitions( i, j ) = 0;
+            }
+        }
+    }
+    transitions = normalize_rows( transitions );
+    compute_log_tables();
+}
+
+// Set epsilon of transitions pruned on every update
+template<class E, class S>
+void Hmm<E, S>::set_transitions_epsilon( double epsilon )
+{
+    transitions_epsilon = epsilon;
+}
+
+// Set number of threads used by learn_parallel
+template<class E, class S>
+void Hmm<E, S>::set_learning_threads( unsigned threads, bool deterministic )
+{
+    learning_threads     = threads;
+    learning_determinism = deterministic;
+}
+
 // Get current HMM state
 template<class E, class S>
 unsigned Hmm<E, S>::get_current_state() const
@@ -357,6 +665,56 @@ void Hmm<E, S>::normalize()
     transitions    = normalize_rows( transitions );
     emissions      = normalize_rows( emissions );
     initial_states = normalize_rows( initial_states );
+    compute_log_tables();
+}
+
+// Recompute log-space tables after matrices change
+template<class E, class S>
+void Hmm<E, S>::compute_log_tables()
+{
+    unsigned num_states = transitions.n_rows;
+    log_initial_states.resize( num_states );
+    log_transitions.resize( num_states * num_states );
+    log_emissions.resize( ( alphabet.size() + 1 ) * num_states );
+    for( unsigned i = 0; i < num_states; ++i ) {
+        log_initial_states[i] = log10( initial_states( i ) );
+        for( unsigned j = 0; j < num_states; ++j ) {
+            log_transitions[i * num_states + j] = log10( transitions( i, j ) );
+        }
+        for( unsigned e = 0; e < alphabet.size(); ++e ) {
+            log_emissions[e * num_states + i] = log10( emissions( i, e ) );
+        }
+        log_emissions[alphabet.size() * num_states + i] = -unknown_penalty;
+    }
+
+    // Non-zero transitions into each state
+    predecessor_offsets.assign( 1, 0 );
+    predecessor_states.clear();
+    predecessor_log_transitions.clear();
+    for( unsigned i = 0; i < num_states; ++i ) {
+        for( unsigned k = 0; k < num_states; ++k ) {
+            if( transitions( k, i ) > 0 ) {
+                predecessor_states.push_back( k );
+                predecessor_log_transitions.push_back( log_transitions[k * num_states + i] );
+            }
+        }
+        predecessor_offsets.push_back( predecessor_states.size() );
+    }
+    // Dense kernels compute a few products in one instruction, so skipping
+    // zero transitions pays off only if at most one in eight is non-zero
+    sparse_scoring =
+      num_states > 0 && predecessor_states.size() * 8 <= num_states * num_states;
+
+    // Symbols of one-byte elements, first occurence in the alphabet wins
+    if constexpr( sizeof( E ) == 1 ) {
+        if( alphabet.size() > 255 ) {
+            throw std::invalid_argument( "HMM alphabet is too big!" );
+        }
+        std::fill( symbols, symbols + 256, uint8_t( alphabet.size() ) );
+        for( unsigned e = alphabet.size(); e-- > 0; ) {
+            symbols[uint8_t( alphabet[e] )] = e;
+        }
+    }
 }
 
 // Auxiliary function
@@ -376,19 +734,43 @@ unsigned Hmm<E, S>::random_element( const arma::mat& probabilities )
     return i;
 }
 
+// One step of Viterbi recurrence in log space
+template<class E, class S>
+void Hmm<E, S>::viterbi_step( const double* current,
+                              const double* emission,
+                              double* next ) const
+{
+    const unsigned num_states = log_initial_states.size();
+    if( not sparse_scoring ) {
+        // Max-plus product, using the widest SIMD kernel supported by the CPU
+        max_plus::step( current, log_transitions.data(), emission, num_states, next );
+        return;
+    }
+    // Zero transitions never extend a path, so they are skipped
+    for( unsigned i = 0; i < num_states; ++i ) {
+        double best   = -std::numeric_limits<double>::infinity();
+        unsigned last = predecessor_offsets[i + 1];
+        for( unsigned p = predecessor_offsets[i]; p < last; ++p ) {
+            double candidate = current[predecessor_states[p]] + predecessor_log_transitions[p];
+            best             = best < candidate ? candidate : best;
+        }
+        next[i] = best + emission[i];
+    }
+}
+
 // Return internal index of given output character
 template<class E, class S>
 unsigned Hmm<E, S>::out_index( E e ) const
 {
+    if constexpr( sizeof( E ) == 1 ) {
+        return symbols[uint8_t( e )];
+    }
     unsigned i = 0;
     for( i = 0; i < alphabet.size(); ++i ) {
         if( alphabet[i] == e ) {
             break;
         }
     }
-    if( i >= alphabet.size() ) {
-        throw std::invalid_argument( "Given character is not in HMM alphabet!" );
-    }
     return i;
 }
 
@@ -467,11 +849,14 @@ typename Hmm<E, S>::Path Hmm<E, S>::find_viterbi_path( const S& sequence )
                 t1( i, t ) = get_emission( i, sequence[t] ) * initial_states( i );
                 t2( i, t ) = 0;
             } else {
-                double valmax = 0;
-                double argmax = 0;
-                for( unsigned k = 0; k < num_states; ++k ) {
-                    double val =
-                      t1( k, t - 1 ) * get_emission( i, sequence[t] ) * get_transition( k, i );
+                // Only states with non-zero transitions into state i can precede it
+                double valmax   = 0;
+                double argmax   = 0;
+                double emission = get_emission( i, sequence[t] );
+                unsigned last   = predecessor_offsets[i + 1];
+                for( unsigned p = predecessor_offsets[i]; p < last; ++p ) {
+                    unsigned k = predecessor_states[p];
+                    double val = t1( k, t - 1 ) * emission * get_transition( k, i );
                     if( val > valmax ) {
                         valmax = val;
                         argmax = k;
@@ -519,18 +904,203 @@ typename Hmm<E, S>::Path Hmm<E, S>::find_viterbi_path( const S& sequence )
 
 } // Hmm::find_viterbi_path
 
-// Learn HMM utilizing Brodzki-Viterbi algorithm
+// Find log10 probability of Viterbi path for given sequence, followed by
+// optional terminator element
 template<class E, class S>
-void Hmm<E, S>::learn( const S& sequence, double learn_rate, unsigned batch_size )
+double Hmm<E, S>::find_viterbi_score( const E* sequence,
+                                      std::size_t length,
+                                      const E* terminator ) const
+{
+    const unsigned num_states = log_initial_states.size();
+    const std::size_t total   = length + ( terminator ? 1 : 0 );
+    if( total == 0 || num_states == 0 ) {
+        return -std::numeric_limits<double>::infinity();
+    }
+
+    // Two rolling vectors of best path probabilities ending in each state,
+    // kept between calls, so that they are allocated only once per thread
+    static thread_local std::vector<double> scratch;
+    if( scratch.size() < 2 * num_states ) {
+        scratch.resize( 2 * num_states );
+    }
+    double* current = scratch.data();
+    double* next    = scratch.data() + num_states;
+
+    const double* emission =
+      &log_emissions[out_index( length ? sequence[0] : *terminator ) * num_states];
+    for( unsigned i = 0; i < num_states; ++i ) {
+        current[i] = log_initial_states[i] + emission[i];
+    }
+
+    for( std::size_t t = 1; t < total; ++t ) {
+        emission =
+          &log_emissions[out_index( t < length ? sequence[t] : *terminator ) * num_states];
+        viterbi_step( current, emission, next );
+        std::swap( current, next );
+    }
+    return *std::max_element( current, current + num_states );
+} // Hmm::find_viterbi_score
+
+// Find log10 probability of Viterbi path for given sequence, followed by
+// optional terminator element, stopping early below given limit
+template<class E, class S>
+double Hmm<E, S>::find_viterbi_score_bounded( const E* sequence,
+                                              std::size_t length,
+                                              const E* terminator,
+                                              double limit,
+                                              double beam,
+                                              bool& stopped ) const
+{
+    stopped                   = false;
+    const unsigned num_states = log_initial_states.size();
+    const std::size_t total   = length + ( terminator ? 1 : 0 );
+    if( total == 0 || num_states == 0 ) {
+        return -std::numeric_limits<double>::infinity();
+    }
+
+    static thread_local std::vector<double> scratch;
+    if( scratch.size() < 2 * num_states ) {
+        scratch.resize( 2 * num_states );
+    }
+    double* current = scratch.data();
+    double* next    = scratch.data() + num_states;
+
+    const double* emission =
+      &log_emissions[out_index( length ? sequence[0] : *terminator ) * num_states];
+    for( unsigned i = 0; i < num_states; ++i ) {
+        current[i] = log_initial_states[i] + emission[i];
+    }
+
+    for( std::size_t t = 1; t < total; ++t ) {
+        double best = max_plus::prune( current, num_states, beam );
+        if( best < limit ) {
+            stopped = true;
+            return best;
+        }
+        emission =
+          &log_emissions[out_index( t < length ? sequence[t] : *terminator ) * num_states];
+        viterbi_step( current, emission, next );
+        std::swap( current, next );
+    }
+    return *std::max_element( current, current + num_states );
+} // Hmm::find_viterbi_score_bounded
+
+// Find log10 probabilities of Viterbi paths for many sequences at once
+template<class E, class S>
+void Hmm<E, S>::find_viterbi_scores( const E* const* sequences,
+                                     const std::size_t* lengths,
+                                     std::size_t count,
+                                     double* scores,
+                                     const E* terminator ) const
+{
+    constexpr unsigned LANES  = max_plus::LANES;
+    const unsigned num_states = log_initial_states.size();
+    if( num_states == 0 ) {
+        std::fill( scores, scores + count, -std::numeric_limits<double>::infinity() );
+        return;
+    }
+    // With many states, single sequences fill SIMD vectors on their own,
+    // and scoring them one by one keeps rolling vectors in registers
+    if( num_states >= 2 * LANES ) {
+        for( std::size_t s = 0; s < count; ++s ) {
+            scores[s] = find_viterbi_score( sequences[s], lengths[s], terminator );
+        }
+        return;
+    }
+
+    // Rolling vectors and emissions of a group, state-major and sequence-minor
+    static thread_local std::vector<double> scratch;
+    if( scratch.size() < 3 * num_states * LANES ) {
+        scratch.resize( 3 * num_states * LANES );
+    }
+    double* current  = scratch.data();
+    double* next     = scratch.data() + num_states * LANES;
+    double* emission = scratch.data() + 2 * num_states * LANES;
+
+    // Gather emissions of t-th elements of group sequences. Lanes of finished
+    // and missing sequences repeat the first symbol, their scores are not used
+    std::size_t first = 0;    // First sequence of current group
+    std::size_t total[LANES]; // Number of elements of group sequences
+    auto gather = [&]( std::size_t t ) {
+        for( unsigned l = 0; l < LANES; ++l ) {
+            unsigned symbol = 0;
+            if( t < total[l] ) {
+                symbol = out_index( t < lengths[first + l] ? sequences[first + l][t]
+                                                           : *terminator );
+            }
+            const double* row = &log_emissions[symbol * num_states];
+            for( unsigned i = 0; i < num_states; ++i ) {
+                emission[i * LANES + l] = row[i];
+            }
+        }
+    };
+
+    for( first = 0; first < count; first += LANES ) {
+        unsigned lanes    = std::min<std::size_t>( LANES, count - first );
+        std::size_t steps = 0;
+        for( unsigned l = 0; l < LANES; ++l ) {
+            total[l] = l < lanes ? lengths[first + l] + ( terminator ? 1 : 0 ) : 0;
+            steps    = std::max( steps, total[l] );
+            if( l < lanes && total[l] == 0 ) {
+                scores[first + l] = -std::numeric_limits<double>::infinity();
+            }
+        }
+
+        for( std::size_t t = 0; t < steps; ++t ) {
+            gather( t );
+            if( t == 0 ) {
+                for( unsigned i = 0; i < num_states; ++i ) {
+                    for( unsigned l = 0; l < LANES; ++l ) {
+                        current[i * LANES + l] =
+                          log_initial_states[i] + emission[i * LANES + l];
+                    }
+                }
+            } else {
+                max_plus::step_batch(
+                  current, log_transitions.data(), emission, num_states, next );
+                std::swap( current, next );
+            }
+            // Collect scores of sequences ending at this element
+            for( unsigned l = 0; l < lanes; ++l ) {
+                if( total[l] == t + 1 ) {
+                    double best = -std::numeric_limits<double>::infinity();
+                    for( unsigned i = 0; i < num_states; ++i ) {
+                        best = std::max( best, current[i * LANES + l] );
+                    }
+                    scores[first + l] = best;
+                }
+            }
+        }
+    }
+} // Hmm::find_viterbi_scores
+
+// Add states of Viterbi path of given sequence to given counts
+template<class E, class S>
+void Hmm<E, S>::count_viterbi_path( const S& sequence,
+                                    double weight,
+                                    arma::mat& initial,
+                                    arma::mat& trans,
+                                    arma::mat& emis )
 {
     Path best_path = find_viterbi_path( sequence );
     for( unsigned i = 0; i < sequence.size() - 1; ++i ) {
-        transitions_prim( best_path.states[i], best_path.states[i + 1] )++;
+        trans( best_path.states[i], best_path.states[i + 1] ) += weight;
     }
+    // Unknown elements contribute only to transitions
     for( unsigned i = 0; i < sequence.size(); ++i ) {
-        emissions_prim( best_path.states[i], out_index( sequence[i] ) )++;
+        unsigned symbol = out_index( sequence[i] );
+        if( symbol < alphabet.size() ) {
+            emis( best_path.states[i], symbol ) += weight;
+        }
     }
-    initial_states_prim( best_path.states[0] )++;
+    initial( best_path.states[0] ) += weight;
+}
+
+// Learn HMM utilizing Brodzki-Viterbi algorithm
+template<class E, class S>
+void Hmm<E, S>::learn( const S& sequence, double learn_rate, unsigned batch_size )
+{
+    count_viterbi_path( sequence, 1, initial_states_prim, transitions_prim, emissions_prim );
 
     mutex.lock();
     ++processed_lines;
@@ -540,26 +1110,283 @@ void Hmm<E, S>::learn( const S& sequence, double learn_rate, unsigned batch_size
     mutex.unlock();
 } // Hmm::learn
 
+// Count sequences in parallel, in given number of parts
+template<class E, class S>
+template<class Count>
+double Hmm<E, S>::count_parallel( std::size_t size,
+                                  unsigned parts,
+                                  Count count,
+                                  arma::mat& initial,
+                                  arma::mat& trans,
+                                  arma::mat& emis )
+{
+    unsigned threads = learning_threads;
+    if( threads == 0 ) {
+        threads = std::max( 1u, std::thread::hardware_concurrency() );
+    }
+
+    // Counts of each part, learned by one thread at a time
+    std::vector<arma::mat> part_initial( parts, arma::mat( initial.n_rows, initial.n_cols ) );
+    std::vector<arma::mat> part_trans( parts, arma::mat( trans.n_rows, trans.n_cols ) );
+    std::vector<arma::mat> part_emis( parts, arma::mat( emis.n_rows, emis.n_cols ) );
+    std::vector<double> part_result( parts, 0 );
+#pragma omp parallel for schedule( dynamic ) num_threads( threads )
+    for( unsigned part = 0; part < parts; ++part ) {
+        part_initial[part].fill( 0 );
+        part_trans[part].fill( 0 );
+        part_emis[part].fill( 0 );
+        for( std::size_t i = size * part / parts; i < size * ( part + 1 ) / parts; ++i ) {
+            part_result[part] +=
+              count( i, part_initial[part], part_trans[part], part_emis[part] );
+        }
+    }
+    double result = 0;
+    for( unsigned part = 0; part < parts; ++part ) {
+        initial += part_initial[part];
+        trans += part_trans[part];
+        emis += part_emis[part];
+        result += part_result[part];
+    }
+    return result;
+}
+
+// Count Viterbi paths of all buffered sequences in parallel into *_prim matrices
+template<class E, class S>
+void Hmm<E, S>::learn_buffered()
+{
+    unsigned parts = learning_determinism ? LEARNING_SHARDS : learning_threads;
+    if( parts == 0 ) {
+        parts = std::max( 1u, std::thread::hardware_concurrency() );
+    }
+    count_parallel(
+      learning_buffer.size(),
+      parts,
+      [this]( std::size_t i, arma::mat& initial, arma::mat& trans, arma::mat& emis ) {
+          count_viterbi_path( learning_buffer[i], learning_weights[i], initial, trans, emis );
+          return 0.0;
+      },
+      initial_states_prim,
+      transitions_prim,
+      emissions_prim );
+    processed_lines += learning_buffer.size();
+    learning_buffer.clear();
+    learning_weights.clear();
+}
+
+template<class E, class S>
+void Hmm<E, S>::learn_parallel( const S& sequence,
+                                double learn_rate,
+                                unsigned batch_size,
+                                double weight )
+{
+    learning_buffer.push_back( sequence );
+    learning_weights.push_back( weight );
+    if( ( processed_lines + learning_buffer.size() ) % batch_size == 0 ) {
+        learn_buffered();
+        update( learn_rate );
+    }
+}
+
 template<class E, class S>
-void Hmm<E, S>::learn_parallel( const S& sequence, double learn_rate, unsigned batch_size )
+void Hmm<E, S>::accumulate_parallel( const S& sequence, unsigned batch_size, double weight )
 {
     learning_buffer.push_back( sequence );
-    const unsigned NUM_THREADS       = 8;
-    const unsigned THREAD_BATCH_SIZE = batch_size / NUM_THREADS;
+    learning_weights.push_back( weight );
+    if( learning_buffer.size() >= batch_size ) {
+        learn_buffered();
+    }
+}
 
-    if( learning_buffer.size() == batch_size ) {
+// Accumulate sequences buffered by learn_parallel without update
+template<class E, class S>
+void Hmm<E, S>::flush_learning_buffer()
+{
+    if( not learning_buffer.empty() ) {
+        learn_buffered();
+    }
+}
 
-        // Parallel threads work
-#pragma omp parallel for
-        for( unsigned i = 0; i < NUM_THREADS; ++i ) {
+// Add expected counts of given sequence, using scaled forward-backward algorithm
+template<class E, class S>
+double Hmm<E, S>::count_expected( const S& sequence,
+                                  double weight,
+                                  arma::mat& initial,
+                                  arma::mat& trans,
+                                  arma::mat& emis ) const
+{
+    const unsigned num_states = transitions.n_rows;
+    const std::size_t length  = sequence.size();
+    if( length == 0 ) {
+        return 0;
+    }
+    std::vector<unsigned> symbols( length );             // Symbols of sequence elements
+    std::vector<double> emission( length * num_states ); // Emissions, [t * N + i]
+    std::vector<double> alpha( length * num_states );    // Forward probabilities, [t * N + i]
+    std::vector<double> beta( length * num_states );     // Backward probabilities, [t * N + i]
+    std::vector<double> scale( length );                 // Sum of forward probabilities at t
+    const double unknown_emission = pow( 10, -unknown_penalty );
+    for( std::size_t t = 0; t < length; ++t ) {
+        symbols[t] = out_index( sequence[t] );
+        for( unsigned i = 0; i < num_states; ++i ) {
+            emission[t * num_states + i] =
+              symbols[t] < alphabet.size() ? emissions( i, symbols[t] ) : unknown_emission;
+        }
+    }
 
-            // One thread
-            for( unsigned j = 0; j < THREAD_BATCH_SIZE; ++j ) {
-                learn( learning_buffer[i * THREAD_BATCH_SIZE + j], learn_rate, batch_size );
+    // Forward pass, scaled so that probabilities sum up to 1 at every element
+    double log_prob = 0;
+    for( std::size_t t = 0; t < length; ++t ) {
+        double* current = &alpha[t * num_states];
+        scale[t]        = 0;
+        for( unsigned j = 0; j < num_states; ++j ) {
+            double sum = 0;
+            if( t == 0 ) {
+                sum = initial_states( j );
+            } else {
+                const double* previous = &alpha[( t - 1 ) * num_states];
+                for( unsigned i = 0; i < num_states; ++i ) {
+                    sum += previous[i] * transitions( i, j );
+                }
+            }
+            current[j] = sum * emission[t * num_states + j];
+            scale[t] += current[j];
+        }
+        if( scale[t] == 0 ) {
+            return -std::numeric_limits<double>::infinity();
+        }
+        for( unsigned j = 0; j < num_states; ++j ) {
+            current[j] /= scale[t];
+        }
+        log_prob += log10( scale[t] );
+    }
+
+    // Backward pass, scaled in the same way
+    std::fill_n( &beta[( length - 1 ) * num_states], num_states, 1.0 );
+    for( std::size_t t = length - 1; t-- > 0; ) {
+        const double* next = &beta[( t + 1 ) * num_states];
+        for( unsigned i = 0; i < num_states; ++i ) {
+            double sum = 0;
+            for( unsigned j = 0; j < num_states; ++j ) {
+                sum += transitions( i, j ) * emission[( t + 1 ) * num_states + j] * next[j];
+            }
+            beta[t * num_states + i] = sum / scale[t + 1];
+        }
+    }
+
+    // Expected counts of states and transitions between them,
+    // unknown elements contribute only to transitions
+    for( std::size_t t = 0; t < length; ++t ) {
+        for( unsigned i = 0; i < num_states; ++i ) {
+            double state = weight * alpha[t * num_states + i] * beta[t * num_states + i];
+            if( t == 0 ) {
+                initial( i ) += state;
+            }
+            if( symbols[t] < alphabet.size() ) {
+                emis( i, symbols[t] ) += state;
+            }
+            if( t + 1 < length ) {
+                const double from = weight * alpha[t * num_states + i] / scale[t + 1];
+                for( unsigned j = 0; j < num_states; ++j ) {
+                    trans( i, j ) += from * transitions( i, j ) *
+                                     emission[( t + 1 ) * num_states + j] *
+                                     beta[( t + 1 ) * num_states + j];
+                }
             }
         }
-        learning_buffer.clear();
-    } // if
+    }
+    return weight * log_prob;
+}
+
+// Accumulate expected counts of sequences, using forward-backward algorithm
+template<class E, class S>
+double Hmm<E, S>::accumulate_baum_welch( const std::vector<S>& sequences,
+                                         const std::vector<double>& weights )
+{
+    auto count = [this, &sequences, &weights](
+                   std::size_t i, arma::mat& initial, arma::mat& trans, arma::mat& emis ) {
+        double weight = weights.empty() ? 1.0 : weights[i];
+        return count_expected( sequences[i], weight, initial, trans, emis );
+    };
+    return count_parallel( sequences.size(),
+                           LEARNING_SHARDS,
+                           count,
+                           initial_states_prim,
+                           transitions_prim,
+                           emissions_prim );
+}
+
+// Replace probabilities with accumulated counts
+template<class E, class S>
+void Hmm<E, S>::maximize( double pseudo_count )
+{
+    auto maximize_rows = [pseudo_count]( arma::mat& probabilities, arma::mat& counts ) {
+        for( unsigned i = 0; i < counts.n_rows; ++i ) {
+            double sum = 0;
+            for( unsigned j = 0; j < counts.n_cols; ++j ) {
+                counts( i, j ) += probabilities( i, j ) > 0 ? pseudo_count : 0;
+                sum += counts( i, j );
+            }
+            if( sum > 0 ) {
+                for( unsigned j = 0; j < counts.n_cols; ++j ) {
+                    probabilities( i, j ) = counts( i, j ) / sum;
+                }
+            }
+        }
+    };
+    maximize_rows( initial_states, initial_states_prim );
+    maximize_rows( transitions, transitions_prim );
+    maximize_rows( emissions, emissions_prim );
+    if( transitions_epsilon > 0 ) {
+        prune_transitions( transitions_epsilon );
+    } else {
+        compute_log_tables();
+    }
+    transitions_prim.fill( 0 );
+    emissions_prim.fill( 0 );
+    initial_states_prim.fill( 0 );
+}
+
+// Learn HMM with one epoch of Baum-Welch algorithm
+template<class E, class S>
+double Hmm<E, S>::learn_baum_welch( const std::vector<S>& sequences,
+                                    const std::vector<double>& weights,
+                                    double pseudo_count )
+{
+    double log_prob = accumulate_baum_welch( sequences, weights );
+    maximize( pseudo_count );
+    return log_prob;
+}
+
+// Add learning state of HMM with the same probabilities
+template<class E, class S>
+void Hmm<E, S>::add_learning_state( const Hmm<E, S>& hmm )
+{
+    if( alphabet != hmm.alphabet || transitions.n_rows != hmm.transitions.n_rows ||
+        not arma::approx_equal( initial_states, hmm.initial_states, "absdiff", 0.0 ) ||
+        not arma::approx_equal( transitions, hmm.transitions, "absdiff", 0.0 ) ||
+        not arma::approx_equal( emissions, hmm.emissions, "absdiff", 0.0 ) ) {
+        throw std::invalid_argument(
+          "Learning state of HMM with different probabilities can not be added!" );
+    }
+    initial_states_prim += hmm.initial_states_prim;
+    transitions_prim += hmm.transitions_prim;
+    emissions_prim += hmm.emissions_prim;
+    processed_lines += hmm.processed_lines;
+    learning_buffer.insert(
+      learning_buffer.end(), hmm.learning_buffer.begin(), hmm.learning_buffer.end() );
+    learning_weights.insert(
+      learning_weights.end(), hmm.learning_weights.begin(), hmm.learning_weights.end() );
+}
+
+// Discard accumulated learning state
+template<class E, class S>
+void Hmm<E, S>::clear_learning_state()
+{
+    transitions_prim.fill( 0 );
+    emissions_prim.fill( 0 );
+    initial_states_prim.fill( 0 );
+    learning_buffer.clear();
+    learning_weights.clear();
 }
 
 // Update transitions and emisisons matrices
@@ -571,6 +1398,9 @@ void Hmm<E, S>::update( double learn_rate )
     emissions += learn_rate * emissions_prim;
     initial_states += learn_rate * initial_states_prim;
     normalize();
+    if( transitions_epsilon > 0 ) {
+        prune_transitions( transitions_epsilon );
+    }
     transitions_prim.fill( 0 );
     emissions_prim.fill( 0 );
     initial_states_prim.fill( 0 );
@@ -585,10 +1415,15 @@ template<class E, class S>
 template<class Archive>
 void Hmm<E, S>::save( Archive& archive ) const
 {
+    // Sparse transitions are stored as empty matrices, followed by the rest
+    // of HMM and then by their sparse form, so that HMMs of dense transitions
+    // are stored in the same way as before sparse form was introduced
+    bool sparse = SerializableSparseMat::is_sparse( transitions );
+
     SerializableMat initial_states_serializable( initial_states );
     SerializableMat initial_states_prim_serializable( initial_states_prim );
-    SerializableMat transitions_serializable( transitions );
-    SerializableMat transitions_prim_serializable( transitions_prim );
+    SerializableMat transitions_serializable( sparse ? arma::mat() : transitions );
+    SerializableMat transitions_prim_serializable( sparse ? arma::mat() : transitions_prim );
     SerializableMat emissions_serializable( emissions );
     SerializableMat emissions_prim_serializable( emissions_prim );
 
@@ -602,6 +1437,12 @@ void Hmm<E, S>::save( Archive& archive ) const
              alphabet,
              processed_lines,
              learning_buffer );
+
+    if( sparse ) {
+        SerializableSparseMat transitions_sparse( transitions );
+        SerializableSparseMat transitions_prim_sparse( transitions_prim );
+        archive( transitions_sparse, transitions_prim_sparse );
+    }
 }
 
 template<class E, class S>
@@ -625,6 +1466,7 @@ void Hmm<E, S>::load( Archive& archive )
              alphabet,
              processed_lines,
              learning_buffer );
+    learning_weights.assign( learning_buffer.size(), 1.0 );
 
     initial_states      = initial_states_serializable.m;
     initial_states_prim = initial_states_prim_serializable.m;
@@ -632,6 +1474,16 @@ void Hmm<E, S>::load( Archive& archive )
     transitions_prim    = transitions_prim_serializable.m;
     emissions           = emissions_serializable.m;
     emissions_prim      = emissions_prim_serializable.m;
+
+    // Empty transitions of non-empty HMM are followed by their sparse form
+    if( transitions.n_elem == 0 && initial_states.n_elem > 0 ) {
+        SerializableSparseMat transitions_sparse;
+        SerializableSparseMat transitions_prim_sparse;
+        archive( transitions_sparse, transitions_prim_sparse );
+        transitions      = transitions_sparse.m;
+        transitions_prim = transitions_prim_sparse.m;
+    }
+    compute_log_tables();
 }
 
 template<class E, class S>
@@ -672,6 +1524,19 @@ Hmm<E, S>& Hmm<E, S>::operator=( const Hmm<E, S>& hmm )
     alphabet            = hmm.alphabet;
     processed_lines     = hmm.processed_lines;
     learning_buffer     = hmm.learning_buffer;
+    learning_weights    = hmm.learning_weights;
+    log_initial_states  = hmm.log_initial_states;
+    log_transitions     = hmm.log_transitions;
+    log_emissions       = hmm.log_emissions;
+    unknown_penalty     = hmm.unknown_penalty;
+    std::copy( hmm.symbols, hmm.symbols + 256, symbols );
+    predecessor_offsets         = hmm.predecessor_offsets;
+    predecessor_states          = hmm.predecessor_states;
+    predecessor_log_transitions = hmm.predecessor_log_transitions;
+    sparse_scoring              = hmm.sparse_scoring;
+    transitions_epsilon         = hmm.transitions_epsilon;
+    learning_threads            = hmm.learning_threads;
+    learning_determinism        = hmm.learning_determinism;
 
     return *this;
 }
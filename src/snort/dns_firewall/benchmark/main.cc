@@ -0,0 +1,268 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#include "hmm_precision.h"
+#include "hmm_scorer.h"
+#include "max_plus.h"
+#include "smart_hmm.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+extern char* optarg;
+
+using namespace scientific::ml;
+using namespace snort::dns_firewall;
+
+// Random log10 probability table of given size, with rows of given length
+// summing up to 1
+static std::vector<double> random_log_table( unsigned rows, unsigned cols, std::mt19937& gen )
+{
+    std::uniform_real_distribution<double> dist( 0.01, 1.0 );
+    std::vector<double> table( rows * cols );
+    for( unsigned r = 0; r < rows; ++r ) {
+        double sum = 0;
+        for( unsigned c = 0; c < cols; ++c ) {
+            table[r * cols + c] = dist( gen );
+            sum += table[r * cols + c];
+        }
+        for( unsigned c = 0; c < cols; ++c ) {
+            table[r * cols + c] = std::log10( table[r * cols + c] / sum );
+        }
+    }
+    return table;
+}
+
+// ----------------
+// ENTRYPOINT
+// ----------------
+int main( int argc, char* const argv[] )
+{
+    std::cout << "dfw3bench 0.1.0 by Artur M. Brodzki" << std::endl << std::endl;
+    std::string help =
+      "Usage:\n"
+      "   -n: Number of domains scored for each model (default: 200000)\n"
+      "   -l: Length of domains (default: 32)\n"
+      "   -h: Print this help\n\n"
+      "   Measures throughput of Viterbi scoring kernels for HMMs of 8, 16, 32\n"
+      "   and 64 hidden states, for every instruction set supported by the CPU,\n"
+      "   scoring domains one by one and in batches. Then measures throughput of\n"
+      "   scorers used by the plugin for models of 4, 8, 16 and 32 hidden states,\n"
+      "   for every precision, scoring domains one by one and in batches.\n";
+
+    // Parse command line options
+    int opt;
+    unsigned domains_getopt = 200000;
+    unsigned length_getopt  = 32;
+
+    while( ( opt = getopt( argc, argv, "n:l:h" ) ) != -1 ) {
+        switch( opt ) {
+        case 'n':
+            domains_getopt = std::stoul( optarg );
+            break;
+        case 'l':
+            length_getopt = std::stoul( optarg );
+            break;
+        case 'h':
+            std::cout << help << std::endl;
+            exit( 0 );
+            break;
+        }
+    }
+    if( domains_getopt == 0 || length_getopt == 0 ) {
+        std::cout << help << std::endl;
+        exit( 1 );
+    }
+
+    // Batched scoring processes whole groups of domains
+    const unsigned LANES = max_plus::LANES;
+    domains_getopt       = std::max( LANES, domains_getopt / LANES * LANES );
+
+    const unsigned ALPHABET_SIZE = 40;
+    std::mt19937 gen( 2020 );
+    std::uniform_int_distribution<unsigned> symbol( 0, ALPHABET_SIZE - 1 );
+    std::vector<unsigned> symbols( domains_getopt * length_getopt );
+    for( unsigned& s: symbols ) {
+        s = symbol( gen );
+    }
+
+    std::cout << "Selected kernel: " << max_plus::isa_name( max_plus::best_isa() ) << std::endl
+              << std::endl;
+    std::cout << std::setw( 8 ) << "states" << std::setw( 10 ) << "kernel" << std::setw( 14 )
+              << "domains/s" << std::setw( 12 ) << "Mcells/s" << std::setw( 10 ) << "speedup"
+              << std::setw( 14 ) << "batched/s" << std::setw( 10 ) << "speedup" << std::endl;
+
+    for( unsigned states: { 8, 16, 32, 64 } ) {
+        std::vector<double> initial     = random_log_table( 1, states, gen );
+        std::vector<double> transitions = random_log_table( states, states, gen );
+        std::vector<double> emissions   = random_log_table( ALPHABET_SIZE, states, gen );
+        std::vector<double> scratch( 2 * states );
+        std::vector<double> batch_scratch( 3 * states * LANES );
+
+        double scalar_rate = 0;
+        double scalar_sum  = 0;
+        for( auto isa: { max_plus::Isa::SCALAR,
+                         max_plus::Isa::SSE42,
+                         max_plus::Isa::AVX2,
+                         max_plus::Isa::AVX512 } ) {
+            if( not max_plus::supported( isa ) ) {
+                continue;
+            }
+            max_plus::Kernel step            = max_plus::kernel( isa );
+            max_plus::BatchKernel step_batch = max_plus::batch_kernel( isa );
+
+            // Score all domains, in the same way as Hmm::find_viterbi_score
+            double sum = 0;
+            auto start = std::chrono::steady_clock::now();
+            for( unsigned d = 0; d < domains_getopt; ++d ) {
+                const unsigned* domain = &symbols[d * length_getopt];
+                double* current        = scratch.data();
+                double* next           = scratch.data() + states;
+                for( unsigned i = 0; i < states; ++i ) {
+                    current[i] = initial[i] + emissions[domain[0] * states + i];
+                }
+                for( unsigned t = 1; t < length_getopt; ++t ) {
+                    step( current, transitions.data(), &emissions[domain[t] * states], states,
+                          next );
+                    std::swap( current, next );
+                }
+                sum += *std::max_element( current, current + states );
+            }
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+            // Score groups of domains together, in the same way as Hmm::find_viterbi_scores
+            double batch_sum = 0;
+            start            = std::chrono::steady_clock::now();
+            for( unsigned d = 0; d < domains_getopt; d += LANES ) {
+                double* current  = batch_scratch.data();
+                double* next     = batch_scratch.data() + states * LANES;
+                double* emission = batch_scratch.data() + 2 * states * LANES;
+                for( unsigned t = 0; t < length_getopt; ++t ) {
+                    for( unsigned l = 0; l < LANES; ++l ) {
+                        const double* row = &emissions[symbols[( d + l ) * length_getopt + t] *
+                                                       states];
+                        for( unsigned i = 0; i < states; ++i ) {
+                            emission[i * LANES + l] = row[i];
+                        }
+                    }
+                    if( t == 0 ) {
+                        for( unsigned i = 0; i < states * LANES; ++i ) {
+                            current[i] = initial[i / LANES] + emission[i];
+                        }
+                    } else {
+                        step_batch( current, transitions.data(), emission, states, next );
+                        std::swap( current, next );
+                    }
+                }
+                for( unsigned l = 0; l < LANES; ++l ) {
+                    double best = -std::numeric_limits<double>::infinity();
+                    for( unsigned i = 0; i < states; ++i ) {
+                        best = std::max( best, current[i * LANES + l] );
+                    }
+                    batch_sum += best;
+                }
+            }
+            std::chrono::duration<double> batch_elapsed =
+              std::chrono::steady_clock::now() - start;
+
+            double rate       = domains_getopt / elapsed.count();
+            double batch_rate = domains_getopt / batch_elapsed.count();
+            double cells      = rate * ( length_getopt - 1 ) * states * states / 1e6;
+            if( isa == max_plus::Isa::SCALAR ) {
+                scalar_rate = rate;
+                scalar_sum  = sum;
+            }
+            if( sum != scalar_sum || batch_sum != scalar_sum ) {
+                std::cerr << "Kernel " << max_plus::isa_name( isa )
+                          << " result differs from scalar kernel!" << std::endl;
+                return 1;
+            }
+            std::cout << std::fixed << std::setprecision( 0 ) << std::setw( 8 ) << states
+                      << std::setw( 10 ) << max_plus::isa_name( isa ) << std::setw( 14 )
+                      << rate << std::setw( 12 ) << cells << std::setprecision( 2 )
+                      << std::setw( 9 ) << rate / scalar_rate << "x" << std::setprecision( 0 )
+                      << std::setw( 14 ) << batch_rate << std::setprecision( 2 )
+                      << std::setw( 9 ) << batch_rate / scalar_rate << "x" << std::endl;
+        }
+    }
+
+    // Scorers selected by the plugin for the CPU, with batches scored as
+    // by DnsClassifier for all questions of a packet burst
+    std::string alphabet;
+    for( unsigned s = 0; s < ALPHABET_SIZE; ++s ) {
+        alphabet += char( 'A' + s );
+    }
+    std::vector<std::string> names( domains_getopt );
+    std::vector<const char*> name_data( domains_getopt );
+    std::vector<std::size_t> name_lengths( domains_getopt );
+    for( unsigned d = 0; d < domains_getopt; ++d ) {
+        for( unsigned t = 0; t < length_getopt; ++t ) {
+            names[d] += alphabet[symbols[d * length_getopt + t]];
+        }
+        name_data[d]    = names[d].data();
+        name_lengths[d] = names[d].size();
+    }
+    std::vector<double> scores( domains_getopt );
+
+    std::cout << std::endl
+              << std::setw( 8 ) << "states" << std::setw( 10 ) << "precision" << std::setw( 14 )
+              << "domains/s" << std::setw( 14 ) << "batched/s" << std::setw( 10 ) << "speedup"
+              << std::endl;
+    for( unsigned states: { 4, 8, 16, 32 } ) {
+        Hmm<char, std::string> hmm( states, alphabet );
+        for( HmmPrecision precision:
+             { HmmPrecision::DOUBLE, HmmPrecision::FLOAT, HmmPrecision::INT16 } ) {
+            std::unique_ptr<HmmScorer> scorer = make_hmm_scorer( hmm, precision );
+
+            double sum = 0;
+            auto start = std::chrono::steady_clock::now();
+            for( unsigned d = 0; d < domains_getopt; ++d ) {
+                sum += scorer->score( name_data[d], name_lengths[d], nullptr );
+            }
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+            start = std::chrono::steady_clock::now();
+            scorer->score(
+              name_data.data(), name_lengths.data(), domains_getopt, scores.data(), nullptr );
+            std::chrono::duration<double> batch_elapsed =
+              std::chrono::steady_clock::now() - start;
+
+            double batch_sum = 0;
+            for( double score: scores ) {
+                batch_sum += score;
+            }
+            if( batch_sum != sum ) {
+                std::cerr << "Batched " << precision
+                          << " scorer result differs from single one!" << std::endl;
+                return 1;
+            }
+            double rate       = domains_getopt / elapsed.count();
+            double batch_rate = domains_getopt / batch_elapsed.count();
+            std::cout << std::fixed << std::setprecision( 0 ) << std::setw( 8 ) << states
+                      << std::setw( 10 ) << precision << std::setw( 14 ) << rate
+                      << std::setw( 14 ) << batch_rate << std::setprecision( 2 )
+                      << std::setw( 9 ) << batch_rate / rate << "x" << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,181 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#include "bloom_filter.h"
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <immintrin.h>
+#define BLOOM_FILTER_X86
+#endif
+
+namespace snort { namespace dns_firewall {
+
+// Odd multipliers selecting one bit in every word of the block
+alignas( 32 ) static const uint32_t salts[BloomFilter::BLOCK_WORDS] = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU, 0x705495c7U, 0x2df1424bU,
+    0x9efc4947U, 0x5c6bfb31U, 0x9e3779b1U, 0x85ebca77U, 0xc2b2ae3dU, 0x27d4eb2fU,
+    0x165667b1U, 0xd3a2646dU, 0xfd7046c5U, 0xb55a4f09U
+};
+
+// Check if all bits selected by key are set in block
+using BlockContains = bool ( * )( const BloomFilter::Block&, uint32_t key );
+
+static bool block_contains_scalar( const BloomFilter::Block& b, uint32_t key ) noexcept
+{
+    uint32_t missing = 0;
+    for( unsigned i = 0; i < BloomFilter::BLOCK_WORDS; ++i ) {
+        missing |= ~b.words[i] & ( 1U << ( ( key * salts[i] ) >> 27 ) );
+    }
+    return missing == 0;
+}
+
+#ifdef BLOOM_FILTER_X86
+
+__attribute__( ( target( "avx2" ) ) ) static bool
+block_contains_avx2( const BloomFilter::Block& b, uint32_t key ) noexcept
+{
+    const __m256i ones = _mm256_set1_epi32( 1 );
+    const __m256i keys = _mm256_set1_epi32( key );
+    for( unsigned half = 0; half < BloomFilter::BLOCK_WORDS; half += 8 ) {
+        __m256i salt  = _mm256_load_si256( reinterpret_cast<const __m256i*>( salts + half ) );
+        __m256i bits  = _mm256_srli_epi32( _mm256_mullo_epi32( keys, salt ), 27 );
+        __m256i mask  = _mm256_sllv_epi32( ones, bits );
+        __m256i words = _mm256_load_si256( reinterpret_cast<const __m256i*>( b.words + half ) );
+        if( not _mm256_testc_si256( words, mask ) ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif // BLOOM_FILTER_X86
+
+// Get the fastest block check supported by the CPU
+static BlockContains best_block_contains()
+{
+#ifdef BLOOM_FILTER_X86
+    // May run before constructors which would initialize CPU model otherwise
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports( "avx2" ) ) {
+        return block_contains_avx2;
+    }
+#endif
+    return block_contains_scalar;
+}
+
+// Block check selected once, at program startup
+static const BlockContains block_contains = best_block_contains();
+
+// Final mix of FNV hash, so that all bits depend on every character
+static uint64_t mix( uint64_t hash ) noexcept
+{
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+uint64_t BloomFilter::hash( std::string_view domain ) noexcept
+{
+    uint64_t hash = HASH_SEED;
+    for( auto c = domain.rbegin(); c != domain.rend(); ++c ) {
+        hash = hash_step( hash, *c );
+    }
+    return hash;
+}
+
+BloomFilter::BloomFilter()
+{
+}
+
+BloomFilter::BloomFilter( std::size_t keys, unsigned bits_per_key )
+    : blocks_( ( keys * bits_per_key + sizeof( Block ) * 8 - 1 ) / ( sizeof( Block ) * 8 ) )
+{
+    for( auto& b: blocks_ ) {
+        for( auto& w: b.words ) {
+            w = 0;
+        }
+    }
+}
+
+// Get index of block holding given mixed hash, in filter of given number of blocks
+static std::size_t block_index( uint64_t hash, std::size_t count ) noexcept
+{
+    return ( ( hash >> 32 ) * count ) >> 32;
+}
+
+// Check if hash may be present in filter of given non-zero number of blocks
+static bool
+blocks_contain( const BloomFilter::Block* blocks, std::size_t count, uint64_t hash ) noexcept
+{
+    hash = mix( hash );
+    return block_contains( blocks[block_index( hash, count )], uint32_t( hash ) );
+}
+
+void BloomFilter::insert( uint64_t hash ) noexcept
+{
+    if( blocks_.empty() ) {
+        return;
+    }
+    hash         = mix( hash );
+    uint32_t key = hash;
+    Block& b     = blocks_[block_index( hash, blocks_.size() )];
+    for( unsigned i = 0; i < BLOCK_WORDS; ++i ) {
+        b.words[i] |= 1U << ( ( key * salts[i] ) >> 27 );
+    }
+}
+
+bool BloomFilter::contains( uint64_t hash ) const noexcept
+{
+    return not blocks_.empty() && blocks_contain( blocks_.data(), blocks_.size(), hash );
+}
+
+bool BloomFilter::contains_suffix( std::string_view domain ) const noexcept
+{
+    return contains_suffix( blocks_.data(), blocks_.size(), domain );
+}
+
+bool BloomFilter::contains_suffix( const Block* blocks,
+                                   std::size_t count,
+                                   std::string_view domain ) noexcept
+{
+    while( not domain.empty() && domain.back() == '.' ) {
+        domain.remove_suffix( 1 );
+    }
+    if( count == 0 ) {
+        return false;
+    }
+    // Probe every parent domain, starting from the top-level one
+    uint64_t hash = HASH_SEED;
+    for( std::size_t i = domain.size(); i > 0; --i ) {
+        hash = hash_step( hash, domain[i - 1] );
+        if( ( i == 1 || domain[i - 2] == '.' ) && blocks_contain( blocks, count, hash ) ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const BloomFilter::Block* BloomFilter::data() const noexcept
+{
+    return blocks_.data();
+}
+
+std::size_t BloomFilter::size_bytes() const noexcept
+{
+    return blocks_.size() * sizeof( Block );
+}
+
+}} // namespace snort::dns_firewall
@@ -0,0 +1,75 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#ifndef SNORT_DNS_FIREWALL_BLOOM_FILTER_H
+#define SNORT_DNS_FIREWALL_BLOOM_FILTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace snort { namespace dns_firewall {
+
+// Blocked Bloom filter of domain hashes.
+// Each key sets one bit in every 32-bit word of a single 64-byte block,
+// so a probe touches exactly one cache line and is checked with a few SIMD operations,
+// if the CPU supports AVX2.
+// Domains are hashed backwards (from the last character), so hashes of all
+// parent domains of a query are computed in a single pass.
+class BloomFilter
+{
+  public:
+    static constexpr unsigned BLOCK_WORDS = 16;
+    static constexpr uint64_t HASH_SEED   = 14695981039346656037ULL;
+
+    struct alignas( 64 ) Block
+    {
+        uint32_t words[BLOCK_WORDS];
+    };
+
+    // Extend hash of domain suffix with one more character on the left (FNV-1a)
+    static uint64_t hash_step( uint64_t hash, unsigned char c ) noexcept
+    {
+        return ( hash ^ c ) * 1099511628211ULL;
+    }
+    // Hash of the whole domain, read backwards
+    static uint64_t hash( std::string_view ) noexcept;
+
+  private:
+    std::vector<Block> blocks_;
+
+  public:
+    // Create empty filter, containing nothing
+    BloomFilter();
+    // Create filter sized for given number of keys
+    BloomFilter( std::size_t keys, unsigned bits_per_key );
+
+    // Insert domain hash
+    void insert( uint64_t ) noexcept;
+    // Check if domain hash may be present in the filter
+    bool contains( uint64_t ) const noexcept;
+    // Check if domain or any of its parent domains may be present in the filter
+    bool contains_suffix( std::string_view ) const noexcept;
+    // Same for filter of given blocks kept elsewhere, e.g. mapped from a file
+    static bool contains_suffix( const Block*, std::size_t count, std::string_view ) noexcept;
+    // Get filter blocks
+    const Block* data() const noexcept;
+    // Get filter size in bytes
+    std::size_t size_bytes() const noexcept;
+};
+
+}} // namespace snort::dns_firewall
+
+#endif // SNORT_DNS_FIREWALL_BLOOM_FILTER_H
@@ -13,6 +13,7 @@
 // **********************************************************************
 
 #include "config.h"
+#include <stdexcept>
 #include <yaml-cpp/yaml.h>
 
 namespace snort { namespace dns_firewall {
@@ -61,6 +62,33 @@ std::ostream& operator<<( std::ostream& os, const Config::ModelConfig& model )
     return os;
 }
 
+bool Config::PrefilterConfig::operator==( const Config::PrefilterConfig& operand2 ) const
+{
+    return enabled == operand2.enabled && bits_per_entry == operand2.bits_per_entry;
+}
+
+std::ostream& operator<<( std::ostream& os, const Config::PrefilterConfig& prefilter )
+{
+    os << "[DNS Firewall]    * enabled: " << ( prefilter.enabled ? "true" : "false" )
+       << std::endl;
+    os << "[DNS Firewall]    * bits-per-entry: " << prefilter.bits_per_entry;
+    return os;
+}
+
+bool Config::ReloadConfig::operator==( const Config::ReloadConfig& operand2 ) const
+{
+    return enabled == operand2.enabled && interval == operand2.interval &&
+           grace_period == operand2.grace_period;
+}
+
+std::ostream& operator<<( std::ostream& os, const Config::ReloadConfig& reload )
+{
+    os << "[DNS Firewall]    * enabled: " << ( reload.enabled ? "true" : "false" ) << std::endl;
+    os << "[DNS Firewall]    * interval: " << reload.interval << std::endl;
+    os << "[DNS Firewall]    * grace-period: " << reload.grace_period;
+    return os;
+}
+
 bool Config::TimeframeConfig::operator==( const Config::TimeframeConfig& operand2 ) const
 {
     return enabled == operand2.enabled && period == operand2.period &&
@@ -80,7 +108,9 @@ std::ostream& operator<<( std::ostream& os, const Config::TimeframeConfig& timef
 bool Config::HmmConfig::operator==( const Config::HmmConfig& operand2 ) const
 {
     return enabled == operand2.enabled && min_length == operand2.min_length &&
-           bias == operand2.bias && weight == operand2.weight;
+           bias == operand2.bias && weight == operand2.weight &&
+           unknown_penalty == operand2.unknown_penalty && early_exit == operand2.early_exit &&
+           beam_width == operand2.beam_width && precision == operand2.precision;
 }
 
 std::ostream& operator<<( std::ostream& os, const Config::HmmConfig& hmm )
@@ -88,7 +118,12 @@ std::ostream& operator<<( std::ostream& os, const Config::HmmConfig& hmm )
     os << "[DNS Firewall]    * enabled: " << ( hmm.enabled ? "true" : "false" ) << std::endl;
     os << "[DNS Firewall]    * min-length: " << hmm.min_length << std::endl;
     os << "[DNS Firewall]    * bias: " << hmm.bias << std::endl;
-    os << "[DNS Firewall]    * weight: " << hmm.weight;
+    os << "[DNS Firewall]    * weight: " << hmm.weight << std::endl;
+    os << "[DNS Firewall]    * unknown-penalty: " << hmm.unknown_penalty << std::endl;
+    os << "[DNS Firewall]    * early-exit: " << ( hmm.early_exit ? "true" : "false" )
+       << std::endl;
+    os << "[DNS Firewall]    * beam-width: " << hmm.beam_width << std::endl;
+    os << "[DNS Firewall]    * precision: " << hmm.precision;
     return os;
 }
 
@@ -150,15 +185,46 @@ Config::Config( const std::string& config_filename )
     whitelist = node["plugin"]["whitelist"].as<std::string>();
     blacklist = node["plugin"]["blacklist"].as<std::string>();
 
+    prefilter.enabled  = node["plugin"]["prefilter"]["enabled"].as<bool>();
+    int bits_per_entry = node["plugin"]["prefilter"]["bits-per-entry"].as<int>();
+    if( prefilter.enabled && ( bits_per_entry < 1 || bits_per_entry > 64 ) ) {
+        throw std::invalid_argument( "Prefilter bits per entry must be between 1 and 64!" );
+    }
+    prefilter.bits_per_entry = bits_per_entry;
+
+    reload.enabled      = node["plugin"]["reload"]["enabled"].as<bool>();
+    int reload_interval = node["plugin"]["reload"]["interval"].as<int>();
+    int reload_grace    = node["plugin"]["reload"]["grace-period"].as<int>();
+    if( reload.enabled && reload_interval < 1 ) {
+        throw std::invalid_argument( "Lists reload interval must be at least 1 second!" );
+    }
+    if( reload.enabled && reload_grace < 1 ) {
+        throw std::invalid_argument( "Lists reload grace period must be at least 1 second!" );
+    }
+    reload.interval     = reload_interval;
+    reload.grace_period = reload_grace;
+
     timeframe.enabled     = node["plugin"]["timeframe"]["enabled"].as<bool>();
     timeframe.period      = node["plugin"]["timeframe"]["period"].as<int>();
     timeframe.max_queries = node["plugin"]["timeframe"]["max-queries"].as<int>();
     timeframe.penalty     = node["plugin"]["timeframe"]["penalty"].as<double>();
 
-    hmm.enabled    = node["plugin"]["hmm"]["enabled"].as<bool>();
-    hmm.min_length = node["plugin"]["hmm"]["min-length"].as<int>();
-    hmm.bias       = node["plugin"]["hmm"]["bias"].as<double>();
-    hmm.weight     = node["plugin"]["hmm"]["weight"].as<double>();
+    hmm.enabled         = node["plugin"]["hmm"]["enabled"].as<bool>();
+    hmm.min_length      = node["plugin"]["hmm"]["min-length"].as<int>();
+    hmm.bias            = node["plugin"]["hmm"]["bias"].as<double>();
+    hmm.weight          = node["plugin"]["hmm"]["weight"].as<double>();
+    hmm.unknown_penalty = node["plugin"]["hmm"]["unknown-penalty"].as<double>();
+    hmm.early_exit      = node["plugin"]["hmm"]["early-exit"].as<bool>();
+    hmm.beam_width      = node["plugin"]["hmm"]["beam-width"].as<double>();
+    if( node["plugin"]["hmm"]["precision"].as<std::string>() == "double" ) {
+        hmm.precision = HmmPrecision::DOUBLE;
+    }
+    if( node["plugin"]["hmm"]["precision"].as<std::string>() == "float" ) {
+        hmm.precision = HmmPrecision::FLOAT;
+    }
+    if( node["plugin"]["hmm"]["precision"].as<std::string>() == "int16" ) {
+        hmm.precision = HmmPrecision::INT16;
+    }
 
     entropy.enabled    = node["plugin"]["entropy"]["enabled"].as<bool>();
     entropy.min_length = node["plugin"]["entropy"]["min-length"].as<int>();
@@ -173,6 +239,7 @@ bool Config::operator==( const Config& operand2 ) const
 {
     return mode == operand2.mode && model == operand2.model &&
            blacklist == operand2.blacklist && whitelist == operand2.whitelist &&
+           prefilter == operand2.prefilter && reload == operand2.reload &&
            timeframe == operand2.timeframe && hmm == operand2.hmm &&
            entropy == operand2.entropy && short_reject == operand2.short_reject;
 }
@@ -185,6 +252,10 @@ std::ostream& operator<<( std::ostream& os, const Config& options )
     os << options.model << std::endl;
     os << "[DNS Firewall]  - blacklist file: " << options.blacklist << std::endl;
     os << "[DNS Firewall]  - whitelist file: " << options.whitelist << std::endl;
+    os << "[DNS Firewall]  - Lists prefilter:" << std::endl;
+    os << options.prefilter << std::endl;
+    os << "[DNS Firewall]  - Lists reload:" << std::endl;
+    os << options.reload << std::endl;
 
     os << "[DNS Firewall]  - Entropy classifier:" << std::endl;
     os << options.entropy << std::endl;
@@ -15,6 +15,7 @@
 #ifndef SNORT_DNS_FIREWALL_CONFIG_H
 #define SNORT_DNS_FIREWALL_CONFIG_H
 
+#include "hmm_precision.h"
 #include <ostream>
 #include <string>
 
@@ -41,6 +42,21 @@ struct Config
         bool operator==( const ModelConfig& ) const;
         friend std::ostream& operator<<( std::ostream&, const ModelConfig& );
     };
+    struct PrefilterConfig
+    {
+        bool enabled;
+        unsigned bits_per_entry; // Filter bits per list entry, from 1 to 64
+        bool operator==( const PrefilterConfig& ) const;
+        friend std::ostream& operator<<( std::ostream&, const PrefilterConfig& );
+    };
+    struct ReloadConfig
+    {
+        bool enabled;
+        unsigned interval;     // Seconds between checks of lists files, at least 1
+        unsigned grace_period; // Seconds before previous lists version may be freed, at least 1
+        bool operator==( const ReloadConfig& ) const;
+        friend std::ostream& operator<<( std::ostream&, const ReloadConfig& );
+    };
     struct TimeframeConfig
     {
         bool enabled;
@@ -56,6 +72,10 @@ struct Config
         unsigned min_length;
         double bias;
         double weight;
+        double unknown_penalty; // Minus log10 of emission probability of unknown characters
+        bool early_exit;        // Stop scoring once query is known to be rejected
+        double beam_width;      // Prune states less probable than the best one, 0 disables
+        HmmPrecision precision; // Type of log10 probabilities used in scoring
         bool operator==( const HmmConfig& ) const;
         friend std::ostream& operator<<( std::ostream&, const HmmConfig& );
     };
@@ -82,6 +102,8 @@ struct Config
     ModelConfig model;
     std::string blacklist;
     std::string whitelist;
+    PrefilterConfig prefilter;
+    ReloadConfig reload;
     TimeframeConfig timeframe;
     HmmConfig hmm;
     EntropyConfig entropy;
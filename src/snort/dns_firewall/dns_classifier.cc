@@ -14,16 +14,31 @@
 
 #include "dns_classifier.h"
 #include "classification.h"
-#include "dns_packet.h"
+#include "dns_packet_view.h"
 #include "model.h"
-#include <regex>
+#include <limits>
 
 namespace snort { namespace dns_firewall {
 
+DnsClassifier::Statistics::Statistics()
+    : prefilter_queries( 0 )
+    , prefilter_hits( 0 )
+    , prefilter_false_positives( 0 )
+    , hmm_early_exits( 0 )
+{
+}
+
+thread_local DnsClassifier::Statistics DnsClassifier::statistics;
+
 DnsClassifier::DnsClassifier( const Config& config )
     : options( config )
     , query_max_length( 256 )
     , max_length_penalty( 0 )
+    , lists( config )
+    , hmm_size_bias( 0 )
+    , hmm_bounded( config.hmm.early_exit || config.hmm.beam_width > 0 )
+    , hmm_beam( config.hmm.beam_width > 0 ? config.hmm.beam_width
+                                          : std::numeric_limits<double>::infinity() )
     , timeframe_classifier( config )
 {
     Model model;
@@ -32,26 +47,11 @@ DnsClassifier::DnsClassifier( const Config& config )
     query_max_length   = model.query_max_length;
     max_length_penalty = model.max_length_penalty;
     hmm_classifier     = model.hmm;
-
-    // Initialize blacklist, if applicable
-    if( not options.blacklist.empty() ) {
-        std::ifstream blacklist_file( options.blacklist );
-        std::string line;
-        while( std::getline( blacklist_file, line ) ) {
-            blacklist.push_back( line );
-        }
-        blacklist_file.close();
-    }
-
-    // Initialize whitelist, if applicable
-    if( not options.whitelist.empty() ) {
-        std::ifstream whitelist_file( options.whitelist );
-        std::string line;
-        while( getline( whitelist_file, line ) ) {
-            whitelist.push_back( line );
-        }
-        whitelist_file.close();
-    }
+    hmm_classifier.set_unknown_penalty( options.hmm.unknown_penalty );
+    hmm_scorer         = make_hmm_scorer( hmm_classifier, options.hmm.precision );
+    canonicalizer      = QnameCanonicalizer( hmm_classifier.get_alphabet() );
+    hmm_size_bias      = log10( hmm_classifier.get_alphabet().size() ) +
+                         log10( hmm_classifier.get_states().size() );
 
     // Initialize entropy clasifiers
     for( auto& d: model.entropy_distribution ) {
@@ -61,53 +61,121 @@ DnsClassifier::DnsClassifier( const Config& config )
     }
 }
 
-Classification DnsClassifier::classify_question( const std::string& domain )
+bool DnsClassifier::classify_listed( const DnsPacketView::Question& question,
+                                     Classification& result )
 {
+    std::string_view qname = question.qname;
+
+    // ****************
+    // PREFILTER CHECK
+    // ****************
+    // Prefilter covers only domain entries, patterns are always checked
+    DomainListsReloader::Reader reader( lists );
+    const DomainLists& current_lists = reader.get();
+    bool listed                      = true;
+    if( options.prefilter.enabled ) {
+        ++statistics.prefilter_queries;
+        listed = current_lists.may_match_literal( qname );
+        statistics.prefilter_hits += listed;
+    }
+    bool blacklisted = listed && current_lists.blacklist.match_literal( qname );
+    bool whitelisted =
+      listed && not blacklisted && current_lists.whitelist.match_literal( qname );
+    statistics.prefilter_false_positives +=
+      options.prefilter.enabled && listed && not blacklisted && not whitelisted;
+
     // ****************
     // BLACKLIST CHECK
     // ****************
-    if( std::any_of( blacklist.begin(), blacklist.end(), [&]( auto blacklisted ) {
-            return std::regex_match( domain, std::regex( ".*" + blacklisted ) );
-        } ) ) {
-        return Classification( domain, Classification::Note::BLACKLIST, 0, 0, 0 );
+    if( blacklisted || current_lists.blacklist.match_pattern( qname ) ) {
+        result =
+          Classification( std::string( qname ), Classification::Note::BLACKLIST, 0, 0, 0 );
+        return true;
     }
 
     // ****************
     // WHITELIST CHECK
     // ****************
-    if( std::any_of( whitelist.begin(), whitelist.end(), [&]( auto whitelisted ) {
-            return std::regex_match( domain, std::regex( ".*" + whitelisted ) );
-        } ) ) {
-        return Classification( domain, Classification::Note::WHITELIST, 0, 0, 0 );
+    if( whitelisted || current_lists.whitelist.match_pattern( qname ) ) {
+        result =
+          Classification( std::string( qname ), Classification::Note::WHITELIST, 0, 0, 0 );
+        return true;
+    }
+    return false;
+}
+
+bool DnsClassifier::hmm_applies( const DnsPacketView::Question& question ) const
+{
+    return options.hmm.enabled && question.qname.size() >= options.hmm.min_length;
+}
+
+double DnsClassifier::score_entropy( const DnsPacketView::Question& question )
+{
+    double entropy_score = 0;
+    if( options.entropy.enabled &&
+        question.qname.size() >= options.entropy.min_length ) { // Min length check
+        // Average score from each entropy classifier
+        const std::string sld( question.qname.substr( question.features.sld_offset ) );
+        for( auto& c: entropy_classifiers ) {
+            entropy_score += c.classify_sld( sld );
+        }
+        entropy_score /= entropy_classifiers.size();
+        entropy_score += options.entropy.bias;
+    }
+    return entropy_score;
+}
+
+double DnsClassifier::score_hmm( const DnsPacketView::Question& question,
+                                 double entropy_score )
+{
+    const char terminator = '$';
+    const char* qname     = question.qname.data();
+    const std::size_t len = question.qname.size();
+    if( not hmm_bounded ) {
+        return hmm_scorer->score( qname, len, &terminator );
     }
 
+    // Penalties applied after weighting only lower the score, so the question
+    // is rejected whenever HMM probability is lower than the limit
+    double limit          = -std::numeric_limits<double>::infinity();
+    double hmm_weight     = options.hmm.weight;
+    double entropy_weight = options.entropy.enabled ? options.entropy.weight : 0;
+    if( options.hmm.early_exit && hmm_weight > 0 ) {
+        double hmm_score_limit = ( options.short_reject.threshold *
+                                     ( hmm_weight + entropy_weight ) -
+                                   entropy_weight * entropy_score ) /
+                                 hmm_weight;
+        limit = ( hmm_score_limit - hmm_size_bias - options.hmm.bias ) * len;
+    }
+    bool stopped;
+    double hmm_prob =
+      hmm_scorer->score_bounded( qname, len, &terminator, limit, hmm_beam, stopped );
+    statistics.hmm_early_exits += stopped;
+    return hmm_prob;
+}
+
+Classification DnsClassifier::classify_scored( const DnsPacketView::Question& question,
+                                               double hmm_prob,
+                                               double entropy_score )
+{
+    std::string_view qname = question.qname;
+
+    // Scoring classifiers keep their own copies of domains
+    const std::string domain( qname );
+
     // ****************
     // HMM CLASSIFIER
     // ****************
     double hmm_score  = 0;
     double hmm_weight = options.hmm.enabled ? options.hmm.weight : 0;
-    if( options.hmm.enabled && domain.size() >= options.hmm.min_length ) {
-        auto best_path = hmm_classifier.find_viterbi_path( domain + "$" );
-
-        hmm_score = ( best_path.prob / domain.size() ) +
-                    log10( hmm_classifier.get_alphabet().size() ) +
-                    log10( hmm_classifier.get_states().size() ) + options.hmm.bias;
+    if( hmm_applies( question ) ) {
+        hmm_score = ( hmm_prob / domain.size() ) + hmm_size_bias + options.hmm.bias;
     }
 
     // *******************
     // ENTROPY CLASSIFIER
     // *******************
-    double entropy_score  = 0;
     double entropy_weight = options.entropy.enabled ? options.entropy.weight : 0;
-    if( options.entropy.enabled &&
-        domain.size() >= options.entropy.min_length ) { // Min length check
-        // Average score from each entropy classifier
-        for( auto& c: entropy_classifiers ) {
-            entropy_score += c.classify( domain );
-        }
-        entropy_score /= entropy_classifiers.size();
-        entropy_score += options.entropy.bias;
-    }
 
     // *************
     // Set defaults
@@ -155,11 +223,25 @@ Classification DnsClassifier::classify_question( const std::string& domain )
     return Classification( domain, note, score, score1, score2 );
 }
 
-Classification DnsClassifier::classify( const DnsPacket& dns )
+Classification DnsClassifier::classify_question( const DnsPacketView::Question& question )
+{
+    Classification result;
+    if( classify_listed( question, result ) ) {
+        return result;
+    }
+    double entropy_score = score_entropy( question );
+    double hmm_prob      = 0;
+    if( hmm_applies( question ) ) {
+        hmm_prob = score_hmm( question, entropy_score );
+    }
+    return classify_scored( question, hmm_prob, entropy_score );
+}
+
+Classification DnsClassifier::classify( const DnsPacketView& dns )
 {
     Classification min_cls( "", Classification::SCORE, 1000, 0, 0 );
-    for( auto& q: dns.questions ) {
-        Classification cls = classify_question( q.qname );
+    for( auto& q: dns ) {
+        Classification cls = classify_question( q );
         if( cls < min_cls ) {
             min_cls = cls;
         }
@@ -167,11 +249,76 @@ Classification DnsClassifier::classify( const DnsPacket& dns )
     return min_cls;
 }
 
-void DnsClassifier::learn( const DnsPacket& dns )
+void DnsClassifier::classify( const DnsPacketView* const* messages,
+                              std::size_t count,
+                              Classification* results )
+{
+    const std::size_t NO_HMM = std::size_t( -1 );
+    // Buffers kept between batches, separate for every packet thread
+    static thread_local std::vector<BatchQuestion> batch_questions;
+    static thread_local std::vector<const char*> batch_names;
+    static thread_local std::vector<std::size_t> batch_lengths;
+    static thread_local std::vector<double> batch_scores;
+    batch_questions.clear();
+    batch_names.clear();
+    batch_lengths.clear();
+
+    // Check lists and collect names to be scored by HMM
+    for( std::size_t m = 0; m < count; ++m ) {
+        for( auto& q: *messages[m] ) {
+            BatchQuestion b;
+            b.question  = &q;
+            b.message   = m;
+            b.listed        = classify_listed( q, b.result );
+            b.entropy_score = b.listed ? 0 : score_entropy( q );
+            b.hmm_index     = NO_HMM;
+            if( not b.listed && hmm_applies( q ) ) {
+                b.hmm_index = batch_names.size();
+                batch_names.push_back( q.qname.data() );
+                batch_lengths.push_back( q.qname.size() );
+            }
+            batch_questions.push_back( std::move( b ) );
+        }
+    }
+
+    // Score all names together, unless each of them has its own bound
+    const char terminator = '$';
+    batch_scores.resize( batch_names.size() );
+    if( hmm_bounded ) {
+        for( auto& b: batch_questions ) {
+            if( b.hmm_index != NO_HMM ) {
+                batch_scores[b.hmm_index] = score_hmm( *b.question, b.entropy_score );
+            }
+        }
+    } else {
+        hmm_scorer->score( batch_names.data(),
+                           batch_lengths.data(),
+                           batch_names.size(),
+                           batch_scores.data(),
+                           &terminator );
+    }
+
+    // Classify questions in order, as timeframe classifier depends on it
+    for( std::size_t m = 0; m < count; ++m ) {
+        results[m] = Classification( "", Classification::SCORE, 1000, 0, 0 );
+    }
+    for( auto& b: batch_questions ) {
+        if( not b.listed ) {
+            double hmm_prob = b.hmm_index != NO_HMM ? batch_scores[b.hmm_index] : 0;
+            b.result        = classify_scored( *b.question, hmm_prob, b.entropy_score );
+        }
+        if( b.result < results[b.message] ) {
+            results[b.message] = b.result;
+        }
+    }
+}
+
+void DnsClassifier::learn( const DnsPacketView& dns )
 {
-    for( auto& q: dns.questions ) {
+    for( auto& q: dns ) {
+        const std::string sld( q.qname.substr( q.features.sld_offset ) );
         for( auto& c: entropy_classifiers ) {
-            c.learn( q.qname );
+            c.learn_sld( sld );
         }
     }
 }
@@ -187,4 +334,16 @@ Model DnsClassifier::create_model() const
     return model;
 }
 
+DnsClassifier::Statistics DnsClassifier::take_statistics()
+{
+    Statistics taken = statistics;
+    statistics       = Statistics();
+    return taken;
+}
+
+const QnameCanonicalizer& DnsClassifier::get_canonicalizer() const
+{
+    return canonicalizer;
+}
+
 }} // namespace snort::dns_firewall
@@ -15,38 +15,97 @@
 #ifndef SNORT_DNS_FIREWALL_DNS_CLASSIFIER_H
 #define SNORT_DNS_FIREWALL_DNS_CLASSIFIER_H
 
+#include "classification.h"
 #include "config.h"
+#include "dns_packet_view.h"
+#include "domain_lists.h"
 #include "entropy/dns_classifier.h"
+#include "hmm_scorer.h"
+#include "qname_canonicalizer.h"
 #include "smart_hmm.h"
 #include "timeframe/dns_classifier.h"
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace snort { namespace dns_firewall {
 
-struct Classification;
-struct DnsPacket;
 struct Model;
 
 class DnsClassifier
 {
   public:
+    // Counters of classification events, kept separately for every thread,
+    // as packets are classified by many threads at once
+    struct Statistics
+    {
+        unsigned long prefilter_queries;         // Queries checked against prefilter
+        unsigned long prefilter_hits;            // Queries passed to lists lookup
+        unsigned long prefilter_false_positives; // Passed queries not found on lists
+        unsigned long hmm_early_exits;           // Queries with HMM scoring stopped early
+        Statistics();
+    };
+
   private:
+    // Question of batch classification
+    struct BatchQuestion
+    {
+        const DnsPacketView::Question* question;
+        std::size_t message;   // Index of message containing the question
+        bool listed;           // Question was classified by lists
+        Classification result; // Classification by lists
+        double entropy_score;  // Score of entropy classifier
+        std::size_t hmm_index; // Index of HMM score, if HMM classifier applies
+    };
+
     Config options;
     unsigned query_max_length;
     double max_length_penalty;
-    std::vector<std::string> blacklist;
-    std::vector<std::string> whitelist;
+    DomainListsReloader lists;
+    static thread_local Statistics statistics; // Events counted by calling thread
+    QnameCanonicalizer canonicalizer;
     std::vector<entropy::DnsClassifier> entropy_classifiers;
     scientific::ml::Hmm<char, std::string> hmm_classifier;
+    std::unique_ptr<scientific::ml::HmmScorer> hmm_scorer; // Scorer specialized for HMM size
+    double hmm_size_bias; // Score bias for HMM alphabet and states size
+    bool hmm_bounded;     // HMM scoring stops early or prunes states
+    double hmm_beam;      // Beam width of HMM scoring, infinite if pruning is disabled
     timeframe::DnsClassifier timeframe_classifier;
 
-    Classification classify_question( const std::string& );
+    Classification classify_question( const DnsPacketView::Question& );
+    // Check question against blacklist and whitelist
+    // Returns true if question was classified by them
+    bool classify_listed( const DnsPacketView::Question&, Classification& );
+    // Check if HMM classifier applies to question. Characters outside of HMM
+    // alphabet are scored with unknown-penalty, see Config::HmmConfig
+    bool hmm_applies( const DnsPacketView::Question& ) const;
+    // Score question with entropy classifiers
+    double score_entropy( const DnsPacketView::Question& );
+    // Find log10 probability of HMM Viterbi path of question. With early-exit,
+    // scoring stops once the question is known to be rejected given its entropy
+    // score, and the probability is only an upper bound of the exact one
+    double score_hmm( const DnsPacketView::Question&, double entropy_score );
+    // Classify question, given log10 probability of its HMM Viterbi path
+    // and its entropy score
+    Classification classify_scored( const DnsPacketView::Question&,
+                                    double hmm_prob,
+                                    double entropy_score );
 
   public:
     explicit DnsClassifier( const Config& );
-    Classification classify( const DnsPacket& );
-    void learn( const DnsPacket& );
+    Classification classify( const DnsPacketView& );
+    // Classify many messages at once, scoring all their questions with HMM together.
+    // Results are the same as of classifying messages one by one, in given order
+    void classify( const DnsPacketView* const* messages,
+                   std::size_t count,
+                   Classification* results );
+    void learn( const DnsPacketView& );
     Model create_model() const;
+    // Get counters of events in calling thread since the last call, and reset them
+    static Statistics take_statistics();
+    // Get canonicalizer of question names, with HMM alphabet
+    const QnameCanonicalizer& get_canonicalizer() const;
 };
 
 }} // namespace snort::dns_firewall
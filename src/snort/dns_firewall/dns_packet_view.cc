@@ -0,0 +1,377 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#include "dns_packet_view.h"
+#include <algorithm>
+#include <cstring>
+#include <strings.h>
+
+namespace snort { namespace dns_firewall {
+
+static inline uint16_t read_u16( const uint8_t* data ) noexcept
+{
+    return ( data[0] << 8 ) + data[1];
+}
+
+static inline uint32_t read_u32( const uint8_t* data ) noexcept
+{
+    return ( uint32_t( read_u16( data ) ) << 16 ) + read_u16( data + 2 );
+}
+
+// Check if label length byte is a compression pointer
+static inline bool is_pointer( uint8_t label_length ) noexcept
+{
+    return ( label_length & 0xC0 ) == 0xC0;
+}
+
+// **********************
+// NAMES DECODING
+// **********************
+
+unsigned DnsPacketView::read_name(
+  const uint8_t* data, unsigned dsize, unsigned pos, char* name, unsigned& length ) noexcept
+{
+    length         = 0;
+    unsigned end   = 0;   // Position after the name, set on first pointer
+    unsigned limit = pos; // Pointers must point before this position
+    while( pos < dsize ) {
+        unsigned label_length = data[pos];
+        if( label_length == 0 ) {
+            return end ? end : pos + 1;
+        }
+        if( is_pointer( label_length ) ) {
+            if( pos + 1 >= dsize ) {
+                return 0;
+            }
+            unsigned target = ( ( label_length & 0x3F ) << 8 ) + data[pos + 1];
+            if( target >= limit ) {
+                return 0;
+            }
+            if( end == 0 ) {
+                end = pos + 2;
+            }
+            pos = limit = target;
+            continue;
+        }
+        // Extended labels are obsolete
+        if( label_length > 63 || pos + 1 + label_length > dsize ) {
+            return 0;
+        }
+        unsigned new_length = length + ( length > 0 ) + label_length;
+        if( new_length > MAX_NAME_LENGTH ) {
+            return 0;
+        }
+        if( length > 0 ) {
+            name[length] = '.';
+        }
+        std::memcpy( name + new_length - label_length, data + pos + 1, label_length );
+        length = new_length;
+        pos += 1 + label_length;
+    }
+    return 0;
+}
+
+unsigned DnsPacketView::skip_name( const uint8_t* data, unsigned dsize, unsigned pos ) noexcept
+{
+    while( pos < dsize ) {
+        unsigned label_length = data[pos];
+        if( label_length == 0 ) {
+            return pos + 1;
+        }
+        if( is_pointer( label_length ) ) {
+            return pos + 2 <= dsize ? pos + 2 : 0;
+        }
+        if( label_length > 63 ) {
+            return 0;
+        }
+        pos += 1 + label_length;
+    }
+    return 0;
+}
+
+bool DnsPacketView::decode_name( unsigned pos,
+                                 char* buffer,
+                                 std::string_view& name ) const noexcept
+{
+    unsigned length;
+    if( read_name( data_, dsize_, pos, buffer, length ) == 0 ) {
+        return false;
+    }
+    name = std::string_view( buffer, length );
+    return true;
+}
+
+// **********************
+// HEADER AND QUESTIONS
+// **********************
+
+DnsPacketView::DnsPacketView( const uint8_t* data,
+                              unsigned dsize,
+                              const QnameCanonicalizer& canonicalizer ) noexcept
+    : data_( data )
+    , dsize_( dsize )
+    , questions_size_( 0 )
+    , questions_end_( 0 )
+    , sections_located_( false )
+    , sections_malformed_( false )
+    , section_pos_()
+    , section_size_()
+    , edns_()
+    , id( 0 )
+    , flags( 0 )
+    , question_num( 0 )
+    , answer_num( 0 )
+    , authority_num( 0 )
+    , additional_num( 0 )
+    , malformed( false )
+    , truncated_questions( false )
+{
+    if( dsize < HEADER_SIZE ) {
+        malformed = sections_located_ = true;
+        return;
+    }
+    id             = read_u16( data );
+    flags          = read_u16( data + 2 );
+    question_num   = read_u16( data + 4 );
+    answer_num     = read_u16( data + 6 );
+    authority_num  = read_u16( data + 8 );
+    additional_num = read_u16( data + 10 );
+
+    unsigned cursor_pos = HEADER_SIZE;
+    for( unsigned i = 0; i < question_num; ++i ) {
+        // Questions above the limit are decoded into the last buffer and dropped
+        unsigned slot = questions_size_ < MAX_QUESTIONS ? questions_size_ : MAX_QUESTIONS - 1;
+        unsigned length;
+        cursor_pos = read_name( data, dsize, cursor_pos, names_[slot], length );
+        if( cursor_pos == 0 || cursor_pos + 4 > dsize ) {
+            malformed = sections_located_ = true;
+            return;
+        }
+        if( questions_size_ < MAX_QUESTIONS ) {
+            Question& q = questions_[questions_size_++];
+            q.qname     = std::string_view( names_[slot], length );
+            q.features  = canonicalizer.canonicalize( names_[slot], length, names_[slot] );
+            q.qtype     = read_u16( data + cursor_pos );
+            q.qclass    = read_u16( data + cursor_pos + 2 );
+        }
+        cursor_pos += 4;
+    }
+    questions_end_      = cursor_pos;
+    truncated_questions = question_num > MAX_QUESTIONS;
+}
+
+DnsPacketView::DnsPacketView( std::string_view domain,
+                              const QnameCanonicalizer& canonicalizer ) noexcept
+    : data_( nullptr )
+    , dsize_( 0 )
+    , questions_size_( 1 )
+    , questions_end_( 0 )
+    , sections_located_( true )
+    , sections_malformed_( false )
+    , section_pos_()
+    , section_size_()
+    , edns_()
+    , id( 0 )
+    , flags( 0 )
+    , question_num( 1 )
+    , answer_num( 0 )
+    , authority_num( 0 )
+    , additional_num( 0 )
+    , malformed( false )
+    , truncated_questions( false )
+{
+    Question& q = questions_[0];
+    if( domain.size() <= MAX_NAME_LENGTH ) {
+        q.features = canonicalizer.canonicalize( domain.data(), domain.size(), names_[0] );
+        q.qname    = std::string_view( names_[0], domain.size() );
+    } else {
+        q.features = canonicalizer.canonicalize( domain.data(), domain.size(), nullptr );
+        q.qname    = domain;
+    }
+    q.qtype  = 1;
+    q.qclass = 1;
+}
+
+const DnsPacketView::Question* DnsPacketView::begin() const noexcept
+{
+    return questions_;
+}
+
+const DnsPacketView::Question* DnsPacketView::end() const noexcept
+{
+    return questions_ + questions_size_;
+}
+
+unsigned DnsPacketView::size() const noexcept
+{
+    return questions_size_;
+}
+
+// **********************
+// RECORD SECTIONS
+// **********************
+
+void DnsPacketView::locate_sections() const noexcept
+{
+    sections_located_        = true;
+    const uint16_t counts[3] = { answer_num, authority_num, additional_num };
+    unsigned pos             = questions_end_;
+    for( unsigned s = ANSWER; s <= ADDITIONAL; ++s ) {
+        section_pos_[s] = pos;
+        for( unsigned i = 0; i < counts[s]; ++i ) {
+            unsigned name_end = skip_name( data_, dsize_, pos );
+            if( name_end == 0 || name_end + 10 > dsize_ ||
+                name_end + 10 + read_u16( data_ + name_end + 8 ) > dsize_ ) {
+                sections_malformed_ = true;
+                return;
+            }
+            const uint8_t* header = data_ + name_end;
+            if( s == ADDITIONAL && read_u16( header ) == TYPE_OPT ) {
+                edns_.present        = true;
+                edns_.udp_size       = read_u16( header + 2 );
+                edns_.extended_rcode = header[4];
+                edns_.version        = header[5];
+                edns_.dnssec_ok      = header[6] & 0x80;
+            }
+            pos = name_end + 10 + read_u16( header + 8 );
+            ++section_size_[s];
+        }
+    }
+}
+
+DnsPacketView::Records DnsPacketView::records( Section section ) const noexcept
+{
+    if( not sections_located_ ) {
+        locate_sections();
+    }
+    return Records{ RecordIterator( this, section_pos_[section], section_size_[section] ),
+                    RecordIterator( this, 0, 0 ) };
+}
+
+bool DnsPacketView::sections_malformed() const noexcept
+{
+    if( not sections_located_ ) {
+        locate_sections();
+    }
+    return sections_malformed_;
+}
+
+const DnsPacketView::Edns& DnsPacketView::edns() const noexcept
+{
+    if( not sections_located_ ) {
+        locate_sections();
+    }
+    return edns_;
+}
+
+DnsPacketView::AnswerSummary DnsPacketView::summarize_answers() const noexcept
+{
+    AnswerSummary summary = { 0, 0, 0 };
+    for( auto& r: records( ANSWER ) ) {
+        summary.rdata_bytes += r.rdlength;
+        unsigned payload = 0;
+        if( r.type == TYPE_NULL ) {
+            payload = r.rdlength;
+        } else if( r.type == TYPE_TXT ) {
+            // Sequence of length-prefixed strings
+            for( unsigned i = 0; i < r.rdlength; i += 1 + r.rdata[i] ) {
+                payload += std::min<unsigned>( r.rdata[i], r.rdlength - i - 1 );
+            }
+        }
+        summary.max_payload = std::max( summary.max_payload, payload );
+    }
+
+    // Follow CNAME chain starting from the first question name
+    if( questions_size_ == 0 ) {
+        return summary;
+    }
+    char owner_buffer[MAX_NAME_LENGTH];
+    char target_buffer[MAX_NAME_LENGTH];
+    std::string_view current = questions_[0].qname;
+    bool followed            = true;
+    while( followed && summary.cname_chain < section_size_[ANSWER] ) {
+        followed = false;
+        for( auto& r: records( ANSWER ) ) {
+            std::string_view owner;
+            if( r.type != TYPE_CNAME || not decode_name( r.name_pos, owner_buffer, owner ) ||
+                owner.size() != current.size() ||
+                strncasecmp( owner.data(), current.data(), owner.size() ) != 0 ) {
+                continue;
+            }
+            if( decode_name( r.rdata_pos, target_buffer, current ) ) {
+                ++summary.cname_chain;
+                followed = true;
+            }
+            break;
+        }
+    }
+    return summary;
+}
+
+// **********************
+// RECORD ITERATOR
+// **********************
+
+DnsPacketView::RecordIterator::RecordIterator( const DnsPacketView* view,
+                                               unsigned pos,
+                                               unsigned left ) noexcept
+    : view_( view )
+    , pos_( pos )
+    , left_( left )
+    , record_()
+{
+    if( left_ > 0 ) {
+        read();
+    }
+}
+
+void DnsPacketView::RecordIterator::read() noexcept
+{
+    // Record was already validated by locate_sections
+    const uint8_t* data = view_->data_;
+    unsigned name_end   = skip_name( data, view_->dsize_, pos_ );
+    record_.name_pos    = pos_;
+    record_.type        = read_u16( data + name_end );
+    record_.rclass      = read_u16( data + name_end + 2 );
+    record_.ttl         = read_u32( data + name_end + 4 );
+    record_.rdlength    = read_u16( data + name_end + 8 );
+    record_.rdata_pos   = name_end + 10;
+    record_.rdata       = data + record_.rdata_pos;
+}
+
+const DnsPacketView::ResourceRecord& DnsPacketView::RecordIterator::operator*() const noexcept
+{
+    return record_;
+}
+
+const DnsPacketView::ResourceRecord* DnsPacketView::RecordIterator::operator->() const noexcept
+{
+    return &record_;
+}
+
+DnsPacketView::RecordIterator& DnsPacketView::RecordIterator::operator++() noexcept
+{
+    pos_ = record_.rdata_pos + record_.rdlength;
+    if( --left_ > 0 ) {
+        read();
+    }
+    return *this;
+}
+
+bool DnsPacketView::RecordIterator::operator!=( const RecordIterator& operand2 ) const noexcept
+{
+    return left_ != operand2.left_;
+}
+
+}} // namespace snort::dns_firewall
@@ -0,0 +1,191 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#ifndef SNORT_DNS_FIREWALL_DNS_PACKET_VIEW_H
+#define SNORT_DNS_FIREWALL_DNS_PACKET_VIEW_H
+
+#include "qname_canonicalizer.h"
+#include <cstdint>
+#include <string_view>
+
+namespace snort { namespace dns_firewall {
+
+// DNS message, decoded without any heap allocation.
+// Question names are decoded and canonicalized (see QnameCanonicalizer) into fixed
+// buffers inside the view and exposed as string_views, so the view must outlive them
+// and can not be copied.
+// Only first MAX_QUESTIONS questions are stored, the rest are validated and skipped,
+// which is signaled by truncated_questions.
+// Answer, authority and additional sections are located on first access only,
+// and their records are decoded while iterating over them.
+// The view references message data, which must outlive it.
+class DnsPacketView
+{
+  public:
+    static constexpr unsigned HEADER_SIZE     = 12;
+    static constexpr unsigned MAX_NAME_LENGTH = 255;
+    static constexpr unsigned MAX_QUESTIONS   = 4;
+
+    static constexpr uint16_t TYPE_CNAME = 5;
+    static constexpr uint16_t TYPE_NULL  = 10;
+    static constexpr uint16_t TYPE_TXT   = 16;
+    static constexpr uint16_t TYPE_OPT   = 41;
+
+    static constexpr uint16_t FLAG_RESPONSE = 0x8000; // QR bit of header flags
+
+    enum Section
+    {
+        ANSWER,
+        AUTHORITY,
+        ADDITIONAL
+    };
+
+    struct Question
+    {
+        std::string_view qname; // Dot-separated lowercase name, without trailing dot
+        QnameFeatures features; // Features computed during canonicalization
+        uint16_t qtype;
+        uint16_t qclass;
+    };
+
+    struct ResourceRecord
+    {
+        unsigned name_pos;    // Position of owner name in message, see decode_name
+        uint16_t type;        // Record type
+        uint16_t rclass;      // Record class
+        uint32_t ttl;         // Time to live
+        unsigned rdata_pos;   // Position of record data in message
+        uint16_t rdlength;    // Length of record data
+        const uint8_t* rdata; // Record data
+    };
+
+    // EDNS0 parameters, from OPT record in additional section
+    struct Edns
+    {
+        bool present;
+        uint16_t udp_size;
+        uint8_t extended_rcode;
+        uint8_t version;
+        bool dnssec_ok;
+    };
+
+    // Features of answer section, used to detect tunnels in responses
+    struct AnswerSummary
+    {
+        unsigned rdata_bytes; // Total length of answers data
+        unsigned max_payload; // Longest TXT or NULL record payload
+        unsigned cname_chain; // Number of CNAMEs followed from the first question name
+    };
+
+    // Forward iterator over records of one section, decoding them on the fly
+    class RecordIterator
+    {
+      private:
+        const DnsPacketView* view_;
+        unsigned pos_;  // Position of current record
+        unsigned left_; // Number of records left, including current one
+        ResourceRecord record_;
+
+        // Decode record at current position
+        void read() noexcept;
+
+      public:
+        RecordIterator( const DnsPacketView*, unsigned pos, unsigned left ) noexcept;
+        const ResourceRecord& operator*() const noexcept;
+        const ResourceRecord* operator->() const noexcept;
+        RecordIterator& operator++() noexcept;
+        bool operator!=( const RecordIterator& ) const noexcept;
+    };
+
+    // Range of records of one section
+    struct Records
+    {
+        RecordIterator first;
+        RecordIterator last;
+        RecordIterator begin() const noexcept
+        {
+            return first;
+        }
+        RecordIterator end() const noexcept
+        {
+            return last;
+        }
+    };
+
+  private:
+    const uint8_t* data_;                        // Message data
+    unsigned dsize_;                             // Message size
+    char names_[MAX_QUESTIONS][MAX_NAME_LENGTH]; // Decoded question names
+    Question questions_[MAX_QUESTIONS];          // Stored questions
+    unsigned questions_size_;                    // Number of stored questions
+    unsigned questions_end_;                     // Position after question section
+
+    // Filled on first access to any section
+    mutable bool sections_located_;    // Sections were already located
+    mutable bool sections_malformed_;  // Any record is malformed
+    mutable unsigned section_pos_[3];  // Position of first record of each section
+    mutable unsigned section_size_[3]; // Number of valid records in each section
+    mutable Edns edns_;                // EDNS0 parameters
+
+    // Decode name starting at given position into given buffer, following
+    // compression pointers. Only pointers to earlier positions are followed,
+    // so decoding always terminates, even for malicious pointer loops.
+    // Returns position after the name, or 0 if name is malformed
+    static unsigned read_name( const uint8_t*, unsigned, unsigned, char*, unsigned& ) noexcept;
+    // Get position after the name starting at given position, without decoding it
+    // Returns 0 if name is malformed
+    static unsigned skip_name( const uint8_t*, unsigned, unsigned ) noexcept;
+    // Walk over headers of all records, once
+    void locate_sections() const noexcept;
+
+  public:
+    // Parse header and question section of DNS message of given size.
+    // Never reads outside of it
+    DnsPacketView( const uint8_t*, unsigned, const QnameCanonicalizer& ) noexcept;
+    // Create view of query with single question about given domain.
+    // Domains longer than MAX_NAME_LENGTH are referenced and not lowercased
+    DnsPacketView( std::string_view domain, const QnameCanonicalizer& ) noexcept;
+    DnsPacketView( const DnsPacketView& ) = delete;
+    DnsPacketView& operator=( const DnsPacketView& ) = delete;
+
+    const Question* begin() const noexcept;
+    const Question* end() const noexcept;
+    unsigned size() const noexcept;
+
+    // Get records of given section. Malformed record and all records
+    // after it are skipped, see sections_malformed
+    Records records( Section ) const noexcept;
+    // Check if any record in answer, authority or additional section is malformed
+    bool sections_malformed() const noexcept;
+    // Get EDNS0 parameters of message
+    const Edns& edns() const noexcept;
+    // Compute features of answer section
+    AnswerSummary summarize_answers() const noexcept;
+    // Decode name at given position of message into buffer of MAX_NAME_LENGTH bytes
+    // Returns false if name is malformed
+    bool decode_name( unsigned pos, char* buffer, std::string_view& name ) const noexcept;
+
+    uint16_t id;
+    uint16_t flags;
+    uint16_t question_num;
+    uint16_t answer_num;
+    uint16_t authority_num;
+    uint16_t additional_num;
+    bool malformed;
+    bool truncated_questions; // Questions after MAX_QUESTIONS were skipped
+};
+
+}} // namespace snort::dns_firewall
+
+#endif // SNORT_DNS_FIREWALL_DNS_PACKET_VIEW_H
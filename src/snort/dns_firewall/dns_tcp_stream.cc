@@ -0,0 +1,39 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#include "dns_tcp_stream.h"
+
+namespace snort { namespace dns_firewall {
+
+DnsTcpStream::DnsTcpStream()
+    : buffer_()
+    , delivered_()
+    , next_sequence_( 0 )
+    , synchronized_( false )
+{
+}
+
+std::size_t DnsTcpStream::pending() const noexcept
+{
+    return buffer_.size();
+}
+
+void DnsTcpStream::reset() noexcept
+{
+    buffer_.clear();
+    delivered_.clear();
+    synchronized_ = false;
+}
+
+}} // namespace snort::dns_firewall
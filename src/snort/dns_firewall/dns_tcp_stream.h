@@ -0,0 +1,120 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#ifndef SNORT_DNS_FIREWALL_DNS_TCP_STREAM_H
+#define SNORT_DNS_FIREWALL_DNS_TCP_STREAM_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace snort { namespace dns_firewall {
+
+// One direction of DNS over TCP connection, where every message is preceded
+// by its 2-byte length and many messages may be sent back to back.
+// Messages contained in a single segment are passed in place, without copying,
+// only messages split between segments are buffered.
+class DnsTcpStream
+{
+  private:
+    std::vector<uint8_t> buffer_;    // Incomplete message, with its length prefix
+    std::vector<uint8_t> delivered_; // Last completed message, see feed
+    uint32_t next_sequence_;         // TCP sequence number of the next byte
+    bool synchronized_;              // Sequence number of the next byte is known
+
+    static unsigned message_length( const uint8_t* data ) noexcept
+    {
+        return ( data[0] << 8 ) + data[1];
+    }
+
+  public:
+    DnsTcpStream();
+
+    // Feed next segment of the stream. For every complete message,
+    // on_message( const uint8_t* data, unsigned size ) is called.
+    // Message data is valid until the segment data is, and at most
+    // until the next call of feed or reset, so messages may be
+    // collected and processed together after feed returns
+    template<typename F> void feed( const uint8_t* data, unsigned size, F&& on_message );
+    // Feed next TCP segment with given sequence number of its first byte, as above.
+    // Bytes fed before, e.g. retransmitted, are skipped, and incomplete message
+    // is dropped after a gap, so that later messages are not parsed from the
+    // middle of a lost one. Segments must not arrive out of order
+    template<typename F>
+    void feed( uint32_t sequence, const uint8_t* data, unsigned size, F&& on_message );
+    // Get number of buffered bytes of incomplete message
+    std::size_t pending() const noexcept;
+    // Drop incomplete message and forget sequence number, e.g. when connection
+    // is opened again
+    void reset() noexcept;
+};
+
+template<typename F>
+void DnsTcpStream::feed( const uint8_t* data, unsigned size, F&& on_message )
+{
+    // Complete message started in previous segments
+    while( size > 0 && not buffer_.empty() ) {
+        unsigned needed = buffer_.size() < 2 ? 2 - buffer_.size()
+                                              : 2 + message_length( buffer_.data() ) -
+                                                  buffer_.size();
+        unsigned taken = std::min( needed, size );
+        buffer_.insert( buffer_.end(), data, data + taken );
+        data += taken;
+        size -= taken;
+        if( buffer_.size() >= 2 && buffer_.size() == 2 + message_length( buffer_.data() ) ) {
+            // Keep completed message until next call, reusing memory of both buffers
+            delivered_.swap( buffer_ );
+            buffer_.clear();
+            on_message( delivered_.data() + 2, delivered_.size() - 2 );
+        }
+    }
+
+    // Messages contained in this segment
+    while( size >= 2 && size >= 2 + message_length( data ) ) {
+        unsigned length = message_length( data );
+        on_message( data + 2, length );
+        data += 2 + length;
+        size -= 2 + length;
+    }
+
+    // Beginning of message continued in next segments
+    if( size > 0 ) {
+        buffer_.assign( data, data + size );
+    }
+}
+
+template<typename F>
+void DnsTcpStream::feed( uint32_t sequence, const uint8_t* data, unsigned size, F&& on_message )
+{
+    // Number of bytes of the segment fed before, or minus size of a gap before it
+    int32_t fed = int32_t( next_sequence_ - sequence );
+    if( synchronized_ && fed > 0 ) {
+        if( unsigned( fed ) >= size ) {
+            return;
+        }
+        data += fed;
+        size -= fed;
+        sequence += fed;
+    } else if( synchronized_ && fed < 0 ) {
+        reset();
+    }
+    synchronized_  = true;
+    next_sequence_ = sequence + size;
+    feed( data, size, on_message );
+}
+
+}} // namespace snort::dns_firewall
+
+#endif // SNORT_DNS_FIREWALL_DNS_TCP_STREAM_H
@@ -0,0 +1,331 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#include "domain_index.h"
+#include "bloom_filter.h"
+#include "domain_list.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace snort { namespace dns_firewall {
+
+// Compare entry with reversed characters to the domain suffix read backwards
+static int compare_reversed( std::string_view reversed, std::string_view suffix ) noexcept
+{
+    std::size_t n = std::min( reversed.size(), suffix.size() );
+    for( std::size_t i = 0; i < n; ++i ) {
+        unsigned char a = reversed[i];
+        unsigned char b = suffix[suffix.size() - 1 - i];
+        if( a != b ) {
+            return a < b ? -1 : 1;
+        }
+    }
+    if( reversed.size() == suffix.size() ) {
+        return 0;
+    }
+    return reversed.size() < suffix.size() ? -1 : 1;
+}
+
+// Get offset of Bloom filter in index file with given sizes of previous parts
+static std::size_t filter_offset( std::size_t parts_size ) noexcept
+{
+    return ( parts_size + sizeof( BloomFilter::Block ) - 1 ) / sizeof( BloomFilter::Block ) *
+           sizeof( BloomFilter::Block );
+}
+
+DomainIndex::DomainIndex( const std::string& filename )
+    : data_( nullptr )
+    , data_size_( 0 )
+    , offsets_( nullptr )
+    , blob_( nullptr )
+    , count_( 0 )
+    , patterns_()
+    , filter_( nullptr )
+    , filter_blocks_( 0 )
+{
+    int fd = ::open( filename.c_str(), O_RDONLY );
+    if( fd < 0 ) {
+        throw std::invalid_argument( "Could not open domain index file " + filename );
+    }
+    struct stat st;
+    if( fstat( fd, &st ) != 0 || (std::size_t) st.st_size < sizeof( Header ) ) {
+        ::close( fd );
+        throw std::invalid_argument( "Domain index file " + filename + " is too short!" );
+    }
+    data_size_ = st.st_size;
+    void* data = mmap( nullptr, data_size_, PROT_READ, MAP_SHARED, fd, 0 );
+    ::close( fd );
+    if( data == MAP_FAILED ) {
+        throw std::invalid_argument( "Could not map domain index file " + filename );
+    }
+    data_ = static_cast<const char*>( data );
+    // Lookups are binary searches, so read-ahead is useless
+    madvise( data, data_size_, MADV_RANDOM );
+
+    Header header;
+    std::memcpy( &header, data_, sizeof( Header ) );
+    std::size_t parts_size = sizeof( Header ) +
+                             ( std::size_t( header.count ) + 1 ) * sizeof( uint32_t ) +
+                             header.blob_size + header.patterns_size;
+    std::size_t offset     = filter_offset( parts_size );
+    if( std::memcmp( header.magic, MAGIC, sizeof( MAGIC ) ) != 0 ||
+        header.version != VERSION || offset + header.filter_size != data_size_ ||
+        header.filter_size % sizeof( BloomFilter::Block ) != 0 ) {
+        munmap( data, data_size_ );
+        throw std::invalid_argument( "Invalid domain index file " + filename );
+    }
+
+    count_    = header.count;
+    offsets_  = reinterpret_cast<const uint32_t*>( data_ + sizeof( Header ) );
+    blob_     = data_ + sizeof( Header ) + ( std::size_t( count_ ) + 1 ) * sizeof( uint32_t );
+    patterns_ = std::string_view( blob_ + header.blob_size, header.patterns_size );
+    // Mapping is page aligned, so are the blocks
+    filter_        = reinterpret_cast<const BloomFilter::Block*>( data_ + offset );
+    filter_blocks_ = header.filter_size / sizeof( BloomFilter::Block );
+}
+
+DomainIndex::~DomainIndex()
+{
+    munmap( const_cast<char*>( data_ ), data_size_ );
+}
+
+std::shared_ptr<const DomainIndex> DomainIndex::open( const std::string& filename )
+{
+    // Registry of opened indexes, so that every DnsClassifier in the process
+    // shares one mapping of the same file. Files are identified by inode
+    // and modification time, so that reloaded file is mapped again
+    static std::mutex registry_mutex;
+    static std::unordered_map<std::string, std::weak_ptr<const DomainIndex>> registry;
+
+    struct stat st;
+    if( stat( filename.c_str(), &st ) != 0 ) {
+        throw std::invalid_argument( "Could not open domain index file " + filename );
+    }
+    std::string key = filename + ":" + std::to_string( st.st_ino ) + ":" +
+                      std::to_string( st.st_mtim.tv_sec ) + "." +
+                      std::to_string( st.st_mtim.tv_nsec );
+
+    std::lock_guard<std::mutex> lock( registry_mutex );
+    std::shared_ptr<const DomainIndex> index = registry[key].lock();
+    if( not index ) {
+        index.reset( new DomainIndex( filename ) );
+        registry[key] = index;
+    }
+    // Forget expired entries
+    for( auto it = registry.begin(); it != registry.end(); ) {
+        it = it->second.expired() ? registry.erase( it ) : std::next( it );
+    }
+    return index;
+}
+
+bool DomainIndex::is_index_file( const std::string& filename )
+{
+    std::ifstream fs( filename, std::ios::binary );
+    char magic[sizeof( MAGIC )];
+    if( not fs.read( magic, sizeof( magic ) ) ) {
+        return false;
+    }
+    return std::memcmp( magic, MAGIC, sizeof( MAGIC ) ) == 0;
+}
+
+unsigned DomainIndex::compile( const std::string& list_filename,
+                               const std::string& index_filename,
+                               unsigned bits_per_entry )
+{
+    if( bits_per_entry < 1 || bits_per_entry > 64 ) {
+        throw std::invalid_argument( "Bloom filter bits per entry must be between 1 and 64!" );
+    }
+    // Read all entries into one buffer, with characters reversed
+    std::ifstream list_file( list_filename );
+    if( not list_file ) {
+        throw std::invalid_argument( "Could not open domain list file " + list_filename );
+    }
+    std::string blob;
+    std::vector<std::pair<uint64_t, uint32_t>> entries; // offset and length in blob
+    std::vector<std::string> patterns;
+    std::string line;
+    while( std::getline( list_file, line ) ) {
+        std::string_view entry = DomainList::normalize( line );
+        if( entry.empty() ) {
+            continue;
+        }
+        // Patterns are stored as they are, to be compiled on load
+        if( DomainList::is_pattern( entry ) ) {
+            patterns.emplace_back( entry );
+            continue;
+        }
+        // Queries are lowercased by QnameCanonicalizer, so are the entries
+        entries.emplace_back( blob.size(), entry.size() );
+        for( auto c = entry.rbegin(); c != entry.rend(); ++c ) {
+            blob.push_back( std::tolower( (unsigned char) *c ) );
+        }
+    }
+    list_file.close();
+
+    // Sort and remove duplicates
+    auto view = [&]( const std::pair<uint64_t, uint32_t>& e ) {
+        return std::string_view( blob.data() + e.first, e.second );
+    };
+    std::sort( entries.begin(), entries.end(), [&]( const auto& a, const auto& b ) {
+        return view( a ) < view( b );
+    } );
+    entries.erase( std::unique( entries.begin(),
+                                entries.end(),
+                                [&]( const auto& a, const auto& b ) {
+                                    return view( a ) == view( b );
+                                } ),
+                   entries.end() );
+
+    // Build offsets table, sorted blob and Bloom filter. Entries are already
+    // reversed, so they are hashed forward
+    std::vector<uint32_t> offsets;
+    std::string sorted_blob;
+    BloomFilter filter( entries.size(), bits_per_entry );
+    offsets.reserve( entries.size() + 1 );
+    for( auto& e: entries ) {
+        if( sorted_blob.size() + e.second > UINT32_MAX ) {
+            throw std::invalid_argument( "Domain list " + list_filename +
+                                         " is too big to be indexed!" );
+        }
+        offsets.push_back( sorted_blob.size() );
+        sorted_blob.append( view( e ) );
+        uint64_t hash = BloomFilter::HASH_SEED;
+        for( char c: view( e ) ) {
+            hash = BloomFilter::hash_step( hash, c );
+        }
+        filter.insert( hash );
+    }
+    offsets.push_back( sorted_blob.size() );
+
+    std::sort( patterns.begin(), patterns.end() );
+    patterns.erase( std::unique( patterns.begin(), patterns.end() ), patterns.end() );
+    std::string patterns_blob;
+    for( auto& p: patterns ) {
+        patterns_blob.append( p ).push_back( '\n' );
+    }
+
+    // Write index file
+    Header header;
+    std::memcpy( header.magic, MAGIC, sizeof( MAGIC ) );
+    header.version        = VERSION;
+    header.count          = entries.size();
+    header.blob_size      = sorted_blob.size();
+    header.pattern_count  = patterns.size();
+    header.bits_per_entry = bits_per_entry;
+    header.patterns_size  = patterns_blob.size();
+    header.filter_size    = filter.size_bytes();
+    std::size_t parts_size = sizeof( Header ) + offsets.size() * sizeof( uint32_t ) +
+                             sorted_blob.size() + patterns_blob.size();
+    std::string padding( filter_offset( parts_size ) - parts_size, '\0' );
+
+    // Write to temporary file and rename it, as running plugins may have
+    // the old index mapped
+    std::string tmp_filename = index_filename + ".tmp";
+    std::ofstream index_file( tmp_filename, std::ios::binary | std::ios::trunc );
+    index_file.write( reinterpret_cast<const char*>( &header ), sizeof( Header ) );
+    index_file.write( reinterpret_cast<const char*>( offsets.data() ),
+                      offsets.size() * sizeof( uint32_t ) );
+    index_file.write( sorted_blob.data(), sorted_blob.size() );
+    index_file.write( patterns_blob.data(), patterns_blob.size() );
+    index_file.write( padding.data(), padding.size() );
+    index_file.write( reinterpret_cast<const char*>( filter.data() ), filter.size_bytes() );
+    index_file.close();
+    if( not index_file || std::rename( tmp_filename.c_str(), index_filename.c_str() ) != 0 ) {
+        std::remove( tmp_filename.c_str() );
+        throw std::invalid_argument( "Could not write domain index file " + index_filename );
+    }
+
+    return entries.size() + patterns.size();
+}
+
+std::string_view DomainIndex::reversed_entry( unsigned i ) const noexcept
+{
+    return std::string_view( blob_ + offsets_[i], offsets_[i + 1] - offsets_[i] );
+}
+
+bool DomainIndex::match( std::string_view domain ) const noexcept
+{
+    while( not domain.empty() && domain.back() == '.' ) {
+        domain.remove_suffix( 1 );
+    }
+    if( count_ == 0 || domain.empty() ) {
+        return false;
+    }
+
+    // Search for every parent domain, starting from the top-level one.
+    // Longer suffixes sort after shorter ones, so the search range only shrinks
+    unsigned low      = 0;
+    std::size_t begin = domain.size();
+    while( true ) {
+        std::size_t dot =
+          begin == 0 ? std::string_view::npos : domain.rfind( '.', begin - 1 );
+        std::string_view suffix =
+          domain.substr( dot == std::string_view::npos ? 0 : dot + 1 );
+
+        unsigned high = count_;
+        while( low < high ) {
+            unsigned mid = low + ( high - low ) / 2;
+            if( compare_reversed( reversed_entry( mid ), suffix ) < 0 ) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        if( low < count_ && compare_reversed( reversed_entry( low ), suffix ) == 0 ) {
+            return true;
+        }
+
+        if( dot == std::string_view::npos ) {
+            return false;
+        }
+        begin = dot;
+    }
+}
+
+bool DomainIndex::may_match( std::string_view domain ) const noexcept
+{
+    return BloomFilter::contains_suffix( filter_, filter_blocks_, domain );
+}
+
+std::vector<std::string_view> DomainIndex::get_patterns() const
+{
+    std::vector<std::string_view> patterns;
+    std::string_view rest = patterns_;
+    while( not rest.empty() ) {
+        std::size_t end = rest.find( '\n' );
+        patterns.push_back( rest.substr( 0, end ) );
+        rest.remove_prefix( end == std::string_view::npos ? rest.size() : end + 1 );
+    }
+    return patterns;
+}
+
+unsigned DomainIndex::size() const noexcept
+{
+    return count_;
+}
+
+}} // namespace snort::dns_firewall
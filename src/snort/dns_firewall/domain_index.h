@@ -0,0 +1,104 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#ifndef SNORT_DNS_FIREWALL_DOMAIN_INDEX_H
+#define SNORT_DNS_FIREWALL_DOMAIN_INDEX_H
+
+#include "bloom_filter.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace snort { namespace dns_firewall {
+
+// Read-only, memory-mapped index of domains compiled offline by dfw3index.
+// File layout (native byte order):
+//   Header
+//   uint32_t offsets[count + 1]  - offsets of entries in blob
+//   char blob[blob_size]         - entries with reversed characters, sorted bytewise
+//   char patterns[patterns_size] - pattern entries, each terminated by newline
+//   char padding[]               - zeros up to multiple of 64 bytes from file start
+//   Block filter[filter_size/64] - BloomFilter of all entries
+// Domain www.google.com is stored as moc.elgoog.www, so every parent domain
+// of a query is a prefix of the reversed query and may be found by binary search.
+// Entries are lowercase since version 3. Bloom filter is stored since version 4,
+// so that it is mapped together with the index instead of being built on load.
+class DomainIndex
+{
+  public:
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t count;
+        uint64_t blob_size;
+        uint32_t pattern_count;
+        uint32_t bits_per_entry; // Bits of Bloom filter per entry
+        uint64_t patterns_size;
+        uint64_t filter_size;
+    };
+    static constexpr char MAGIC[8]    = { 'D', 'F', 'W', '3', 'I', 'D', 'X', '\0' };
+    static constexpr uint32_t VERSION = 4;
+
+  private:
+    const char* data_;                 // Mapped file contents
+    std::size_t data_size_;            // Size of mapped file
+    const uint32_t* offsets_;          // Entries offsets, count_ + 1 elements
+    const char* blob_;                 // Reversed entries
+    unsigned count_;                   // Number of entries
+    std::string_view patterns_;        // Pattern entries, each terminated by newline
+    const BloomFilter::Block* filter_; // Bloom filter of entries
+    std::size_t filter_blocks_;        // Number of Bloom filter blocks
+
+    // Map given index file into memory
+    explicit DomainIndex( const std::string& );
+
+    // Get i-th entry, with reversed characters
+    std::string_view reversed_entry( unsigned ) const noexcept;
+
+  public:
+    DomainIndex( const DomainIndex& ) = delete;
+    DomainIndex& operator=( const DomainIndex& ) = delete;
+    ~DomainIndex();
+
+    // Open index file. Indexes opened more than once in one process
+    // share a single mapping, so all packet threads use the same pages.
+    // Index file must be replaced atomically (by rename), never modified in place
+    static std::shared_ptr<const DomainIndex> open( const std::string& );
+    // Check if given file is a compiled index
+    static bool is_index_file( const std::string& );
+    // Compile text list of domains into index file, replacing it atomically,
+    // with Bloom filter of given number of bits per entry.
+    // Returns number of entries written
+    static unsigned compile( const std::string& list_filename,
+                             const std::string& index_filename,
+                             unsigned bits_per_entry = 16 );
+
+    // Check if domain or any of its parent domains is present in the index
+    bool match( std::string_view ) const noexcept;
+    // Check if domain or any of its parent domains may be present in the index,
+    // with Bloom filter stored in it, which gives false positives only
+    bool may_match( std::string_view ) const noexcept;
+    // Get pattern entries (see DomainList::is_pattern)
+    std::vector<std::string_view> get_patterns() const;
+    // Get number of domain entries in the index
+    unsigned size() const noexcept;
+};
+
+}} // namespace snort::dns_firewall
+
+#endif // SNORT_DNS_FIREWALL_DOMAIN_INDEX_H
@@ -0,0 +1,245 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#include "domain_list.h"
+#include "bloom_filter.h"
+#include <cctype>
+#include <fstream>
+#include <re2/re2.h>
+#include <stdexcept>
+
+namespace snort { namespace dns_firewall {
+
+DomainList::DomainList()
+    : nodes_( 1 )
+    , size_( 0 )
+{
+}
+
+std::string_view DomainList::normalize( std::string_view line ) noexcept
+{
+    while( not line.empty() && std::isspace( (unsigned char) line.front() ) ) {
+        line.remove_prefix( 1 );
+    }
+    while( not line.empty() && std::isspace( (unsigned char) line.back() ) ) {
+        line.remove_suffix( 1 );
+    }
+    if( line.empty() || line.front() == '#' ) {
+        return std::string_view();
+    }
+    if( is_pattern( line ) ) {
+        return line;
+    }
+    // Strip wildcard prefix and root label
+    if( line.substr( 0, 2 ) == "*." ) {
+        line.remove_prefix( 2 );
+    }
+    while( not line.empty() && line.front() == '.' ) {
+        line.remove_prefix( 1 );
+    }
+    while( not line.empty() && line.back() == '.' ) {
+        line.remove_suffix( 1 );
+    }
+    return line;
+}
+
+bool DomainList::is_pattern( std::string_view entry ) noexcept
+{
+    if( entry.substr( 0, 2 ) == "*." ) {
+        entry.remove_prefix( 2 );
+    }
+    for( unsigned char c: entry ) {
+        if( not std::isalnum( c ) && c != '-' && c != '_' && c != '.' ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void DomainList::insert( std::string_view entry )
+{
+    if( insert_entry( entry ) ) {
+        compile_patterns();
+    }
+}
+
+bool DomainList::insert_entry( std::string_view domain )
+{
+    domain = normalize( domain );
+    if( domain.empty() ) {
+        return false;
+    }
+    if( is_pattern( domain ) ) {
+        patterns_.emplace_back( domain );
+        return true;
+    }
+    // Queries are lowercased by QnameCanonicalizer, so are the entries
+    std::string lowercase( domain );
+    for( char& c: lowercase ) {
+        c = std::tolower( (unsigned char) c );
+    }
+    domain = lowercase;
+
+    // Walk labels from the rightmost one, creating missing nodes
+    unsigned node   = 0;
+    std::size_t end = domain.size();
+    while( true ) {
+        std::size_t dot =
+          end == 0 ? std::string_view::npos : domain.rfind( '.', end - 1 );
+        std::size_t begin      = dot == std::string_view::npos ? 0 : dot + 1;
+        std::string_view label = domain.substr( begin, end - begin );
+
+        auto child = nodes_[node].children.find( label );
+        if( child == nodes_[node].children.end() ) {
+            labels_.emplace_back( label );
+            nodes_.emplace_back();
+            nodes_[node].children.emplace( labels_.back(), nodes_.size() - 1 );
+            node = nodes_.size() - 1;
+        } else {
+            node = child->second;
+        }
+
+        if( dot == std::string_view::npos ) {
+            break;
+        }
+        end = dot;
+    }
+
+    if( not nodes_[node].terminal ) {
+        nodes_[node].terminal = true;
+        ++size_;
+    }
+    return false;
+}
+
+void DomainList::compile_patterns()
+{
+    if( patterns_.empty() ) {
+        patterns_set_.reset();
+        return;
+    }
+    re2::RE2::Options re2_options;
+    re2_options.set_log_errors( false );
+    re2_options.set_case_sensitive( false );
+    patterns_set_.reset( new re2::RE2::Set( re2_options, re2::RE2::UNANCHORED ) );
+    for( auto& p: patterns_ ) {
+        // Patterns must match at the end of the domain, as if preceded by .*
+        std::string error;
+        if( patterns_set_->Add( "(?:" + p + ")$", &error ) < 0 ) {
+            throw std::invalid_argument( "Invalid list pattern " + p + ": " + error );
+        }
+    }
+    if( not patterns_set_->Compile() ) {
+        throw std::invalid_argument( "Could not compile list patterns, out of memory!" );
+    }
+}
+
+void DomainList::load_from_file( const std::string& filename )
+{
+    if( DomainIndex::is_index_file( filename ) ) {
+        index_ = DomainIndex::open( filename );
+        for( auto p: index_->get_patterns() ) {
+            insert_entry( p );
+        }
+    } else {
+        std::ifstream fs( filename );
+        std::string line;
+        while( std::getline( fs, line ) ) {
+            insert_entry( line );
+        }
+        fs.close();
+    }
+    compile_patterns();
+}
+
+bool DomainList::match( std::string_view domain ) const noexcept
+{
+    return match_literal( domain ) || match_pattern( domain );
+}
+
+bool DomainList::match_pattern( std::string_view domain ) const noexcept
+{
+    return patterns_set_ &&
+           patterns_set_->Match( re2::StringPiece( domain.data(), domain.size() ), nullptr );
+}
+
+bool DomainList::match_literal( std::string_view domain ) const noexcept
+{
+    while( not domain.empty() && domain.back() == '.' ) {
+        domain.remove_suffix( 1 );
+    }
+    if( index_ && index_->match( domain ) ) {
+        return true;
+    }
+    if( size_ == 0 || domain.empty() ) {
+        return false;
+    }
+
+    // Walk labels from the rightmost one, stop on first entry found
+    unsigned node   = 0;
+    std::size_t end = domain.size();
+    while( true ) {
+        std::size_t dot =
+          end == 0 ? std::string_view::npos : domain.rfind( '.', end - 1 );
+        std::size_t begin      = dot == std::string_view::npos ? 0 : dot + 1;
+        std::string_view label = domain.substr( begin, end - begin );
+
+        auto child = nodes_[node].children.find( label );
+        if( child == nodes_[node].children.end() ) {
+            return false;
+        }
+        node = child->second;
+        if( nodes_[node].terminal ) {
+            return true;
+        }
+
+        if( dot == std::string_view::npos ) {
+            return false;
+        }
+        end = dot;
+    }
+}
+
+void DomainList::hash_entries( std::vector<uint64_t>& hashes ) const
+{
+    // Depth-first walk of the trie, extending hash of the parent domain
+    // with the child label read backwards
+    std::vector<std::pair<unsigned, uint64_t>> stack = { { 0, BloomFilter::HASH_SEED } };
+    while( not stack.empty() ) {
+        auto [node, hash] = stack.back();
+        stack.pop_back();
+        for( auto& child: nodes_[node].children ) {
+            uint64_t child_hash = node == 0 ? hash : BloomFilter::hash_step( hash, '.' );
+            for( auto c = child.first.rbegin(); c != child.first.rend(); ++c ) {
+                child_hash = BloomFilter::hash_step( child_hash, *c );
+            }
+            if( nodes_[child.second].terminal ) {
+                hashes.push_back( child_hash );
+            }
+            stack.emplace_back( child.second, child_hash );
+        }
+    }
+}
+
+bool DomainList::may_match_index( std::string_view domain ) const noexcept
+{
+    return index_ && index_->may_match( domain );
+}
+
+unsigned DomainList::size() const noexcept
+{
+    return size_ + ( index_ ? index_->size() : 0 ) + patterns_.size();
+}
+
+}} // namespace snort::dns_firewall
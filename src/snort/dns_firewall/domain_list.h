@@ -0,0 +1,101 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#ifndef SNORT_DNS_FIREWALL_DOMAIN_LIST_H
+#define SNORT_DNS_FIREWALL_DOMAIN_LIST_H
+
+#include "domain_index.h"
+#include <deque>
+#include <memory>
+#include <re2/set.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace snort { namespace dns_firewall {
+
+// Set of domains stored as a trie of reversed labels,
+// e.g. www.google.com is stored as path com -> google -> www.
+// Domain matches the list if the domain itself or any of its
+// parent domains is present in the list.
+// Big lists may be compiled offline into a memory-mapped DomainIndex.
+// Entries with characters other than letters, digits, '-', '_' and '.' are
+// regular expressions, which must match at the end of the domain, as if preceded
+// by .* (use ^ to anchor them at the beginning too, and .* to match any suffix).
+// All of them are compiled into one automaton, so a domain is scanned once.
+// Domain entries are lowercased and patterns match regardless of case, as
+// queries are matched lowercase.
+class DomainList
+{
+  private:
+    struct Node
+    {
+        std::unordered_map<std::string_view, unsigned> children; // label -> node index
+        bool terminal;                                           // path from root is an entry
+        Node()
+            : terminal( false )
+        {
+        }
+    };
+
+    std::deque<std::string> labels_;              // Labels referenced by nodes
+    std::vector<Node> nodes_;                     // Trie nodes, nodes_[0] is the root
+    unsigned size_;                               // Number of distinct entries in trie
+    std::shared_ptr<const DomainIndex> index_;    // Compiled index, if loaded
+    std::vector<std::string> patterns_;           // Regular expression entries
+    std::unique_ptr<re2::RE2::Set> patterns_set_; // All patterns compiled together
+
+    // Insert one entry, without compiling patterns
+    // Returns true if entry is a pattern
+    bool insert_entry( std::string_view );
+    // Compile all patterns into one automaton
+    void compile_patterns();
+
+  public:
+    // Create empty list
+    DomainList();
+
+    // Strip whitespace from list line and, if it is not a pattern,
+    // wildcard prefix "*." or "." and trailing "."
+    // Returns empty view for empty and comment (#) lines
+    static std::string_view normalize( std::string_view ) noexcept;
+    // Check if list entry is a regular expression rather than a domain
+    static bool is_pattern( std::string_view ) noexcept;
+
+    // Insert one domain or pattern into the list
+    void insert( std::string_view );
+    // Load list from text file, one domain per line,
+    // or map compiled index file produced by dfw3index
+    void load_from_file( const std::string& );
+    // Check if domain matches any domain or pattern entry
+    bool match( std::string_view ) const noexcept;
+    // Check if domain or any of its parent domains is present in the list
+    // Takes time proportional to number of labels and never allocates
+    bool match_literal( std::string_view ) const noexcept;
+    // Check if domain matches any of pattern entries
+    bool match_pattern( std::string_view ) const noexcept;
+    // Check if domain or any of its parent domains may be present in compiled
+    // index, with Bloom filter stored in it. Returns false if no index is loaded
+    bool may_match_index( std::string_view ) const noexcept;
+    // Append hash of every domain entry (see BloomFilter::hash) to given vector,
+    // except entries of compiled index
+    void hash_entries( std::vector<uint64_t>& ) const;
+    // Get number of entries in the list, including patterns
+    unsigned size() const noexcept;
+};
+
+}} // namespace snort::dns_firewall
+
+#endif // SNORT_DNS_FIREWALL_DOMAIN_LIST_H
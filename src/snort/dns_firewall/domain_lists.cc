@@ -0,0 +1,196 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#include "domain_lists.h"
+#include <iostream>
+#include <sys/stat.h>
+#include <unordered_map>
+
+namespace snort { namespace dns_firewall {
+
+DomainLists::DomainLists( const Config& options )
+{
+    // Initialize blacklist, if applicable
+    if( not options.blacklist.empty() ) {
+        blacklist.load_from_file( options.blacklist );
+    }
+
+    // Initialize whitelist, if applicable
+    if( not options.whitelist.empty() ) {
+        whitelist.load_from_file( options.whitelist );
+    }
+
+    // Build prefilter over both lists, if applicable. Entries of indexes
+    // are not hashed, their Bloom filters are mapped with them
+    if( options.prefilter.enabled ) {
+        std::vector<uint64_t> hashes;
+        blacklist.hash_entries( hashes );
+        whitelist.hash_entries( hashes );
+        prefilter = BloomFilter( hashes.size(), options.prefilter.bits_per_entry );
+        for( auto h: hashes ) {
+            prefilter.insert( h );
+        }
+    }
+}
+
+bool DomainLists::may_match_literal( std::string_view domain ) const noexcept
+{
+    return prefilter.contains_suffix( domain ) || blacklist.may_match_index( domain ) ||
+           whitelist.may_match_index( domain );
+}
+
+bool DomainListsReloader::FileVersion::operator==( const FileVersion& operand2 ) const
+{
+    return inode == operand2.inode && size == operand2.size &&
+           mtime_sec == operand2.mtime_sec && mtime_nsec == operand2.mtime_nsec;
+}
+
+namespace {
+
+// Source of identifiers of reloaders, never reused
+std::atomic<uint64_t> reloaders( 0 );
+
+} // namespace
+
+DomainListsReloader::DomainListsReloader( const Config& options )
+    : options( options )
+    , id( ++reloaders )
+    , current( new DomainLists( options ) )
+    , epoch( 1 )
+    , files_version( get_file_version( options.blacklist ),
+                     get_file_version( options.whitelist ) )
+    , stopped( false )
+{
+    if( options.reload.enabled ) {
+        watcher = std::thread( &DomainListsReloader::watch, this );
+    }
+}
+
+DomainListsReloader::~DomainListsReloader()
+{
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+        stopped = true;
+    }
+    stop_condition.notify_all();
+    if( watcher.joinable() ) {
+        watcher.join();
+    }
+    free_retired( true );
+    delete current.load();
+}
+
+DomainListsReloader::FileVersion
+DomainListsReloader::get_file_version( const std::string& filename )
+{
+    FileVersion version = { 0, 0, 0, 0 };
+    struct stat st;
+    if( not filename.empty() && stat( filename.c_str(), &st ) == 0 ) {
+        version.inode      = st.st_ino;
+        version.size       = st.st_size;
+        version.mtime_sec  = st.st_mtim.tv_sec;
+        version.mtime_nsec = st.st_mtim.tv_nsec;
+    }
+    return version;
+}
+
+void DomainListsReloader::watch()
+{
+    std::unique_lock<std::mutex> lock( mutex );
+    while( not stop_condition.wait_for(
+      lock, std::chrono::seconds( options.reload.interval ), [&]() { return stopped; } ) ) {
+
+        free_retired( false );
+
+        auto new_version = std::make_pair( get_file_version( options.blacklist ),
+                                           get_file_version( options.whitelist ) );
+        if( new_version.first == files_version.first &&
+            new_version.second == files_version.second ) {
+            continue;
+        }
+        files_version = new_version;
+
+        // Build new version aside, packet threads still use the current one
+        try {
+            // Threads reading since epoch earlier than the new one may read the old
+            // version. Sequentially consistent order of epochs and versions
+            // makes sure that the new version is read since the new epoch
+            const DomainLists* lists = new DomainLists( options );
+            const DomainLists* old   = current.exchange( lists );
+            retired.push_back( { Clock::now(), ++epoch, old } );
+            std::cout << "[DNS Firewall] Lists reloaded: " << lists->blacklist.size()
+                      << " blacklisted, " << lists->whitelist.size() << " whitelisted"
+                      << std::endl;
+        } catch( const std::exception& e ) {
+            std::cout << "[DNS Firewall] Could not reload lists: " << e.what() << std::endl;
+        }
+    }
+}
+
+bool DomainListsReloader::read_before( uint64_t epoch )
+{
+    std::lock_guard<std::mutex> lock( readers_mutex );
+    for( auto& reader: readers ) {
+        uint64_t reader_epoch = reader.load();
+        if( reader_epoch != 0 && reader_epoch < epoch ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void DomainListsReloader::free_retired( bool all )
+{
+    auto grace_period = std::chrono::seconds( options.reload.grace_period );
+    while( not retired.empty() &&
+           ( all || ( Clock::now() - retired.front().time >= grace_period &&
+                      not read_before( retired.front().epoch ) ) ) ) {
+        delete retired.front().lists;
+        retired.pop_front();
+    }
+}
+
+std::atomic<uint64_t>& DomainListsReloader::reader_slot()
+{
+    // Slots of calling thread, by reloader id, as threads read many reloaders
+    // over time, e.g. after Snort reloads configuration
+    thread_local std::unordered_map<uint64_t, std::atomic<uint64_t>*> slots;
+    auto slot = slots.find( id );
+    if( slot != slots.end() ) {
+        return *slot->second;
+    }
+    std::lock_guard<std::mutex> lock( readers_mutex );
+    readers.emplace_back( 0 );
+    slots.emplace( id, &readers.back() );
+    return readers.back();
+}
+
+DomainListsReloader::Reader::Reader( DomainListsReloader& reloader )
+    : slot( reloader.reader_slot() )
+{
+    slot.store( reloader.epoch.load() );
+    lists = reloader.current.load();
+}
+
+DomainListsReloader::Reader::~Reader()
+{
+    slot.store( 0, std::memory_order_release );
+}
+
+const DomainLists& DomainListsReloader::Reader::get() const noexcept
+{
+    return *lists;
+}
+
+}} // namespace snort::dns_firewall
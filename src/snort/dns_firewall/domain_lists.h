@@ -0,0 +1,126 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#ifndef SNORT_DNS_FIREWALL_DOMAIN_LISTS_H
+#define SNORT_DNS_FIREWALL_DOMAIN_LISTS_H
+
+#include "bloom_filter.h"
+#include "config.h"
+#include "domain_list.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <utility>
+
+namespace snort { namespace dns_firewall {
+
+// Immutable snapshot of blacklist, whitelist and their prefilter.
+// Prefilter covers domain entries loaded from text files, while entries
+// of compiled indexes are covered by Bloom filters stored in them
+struct DomainLists
+{
+    DomainList blacklist;
+    DomainList whitelist;
+    BloomFilter prefilter;
+
+    // Load lists files given in config and build prefilter
+    explicit DomainLists( const Config& );
+
+    // Check if domain or any of its parent domains may be a domain entry
+    // of any list, with prefilter and Bloom filters of indexes
+    bool may_match_literal( std::string_view ) const noexcept;
+};
+
+// Owner of current DomainLists version.
+// If reload is enabled, background thread watches lists files and, when any of
+// them changes, builds new version and publishes it with atomic pointer swap.
+// Readers never lock. Every version is published in a new epoch, and every
+// reading thread records the epoch in which it started reading, in its own slot.
+// Previous version is freed once no thread reads since an earlier epoch,
+// but not before configured grace period.
+class DomainListsReloader
+{
+  private:
+    struct FileVersion
+    {
+        long inode;
+        long size;
+        long mtime_sec;
+        long mtime_nsec;
+        bool operator==( const FileVersion& ) const;
+    };
+    typedef std::chrono::steady_clock Clock;
+    struct RetiredVersion
+    {
+        Clock::time_point time;   // Time of replacement
+        uint64_t epoch;           // Epoch of the version replacing it
+        const DomainLists* lists; // Awaiting deletion
+    };
+
+    Config options;
+    uint64_t id; // Identifies reader slots of this reloader in reading threads
+    std::atomic<const DomainLists*> current;
+    std::atomic<uint64_t> epoch;                       // Epoch of current version, from 1
+    std::deque<std::atomic<uint64_t>> readers;         // Epoch of reading threads, 0 if idle
+    std::mutex readers_mutex;                          // Guards adding reader slots
+    std::deque<RetiredVersion> retired;                // Previous versions, oldest first
+    std::pair<FileVersion, FileVersion> files_version; // Blacklist and whitelist
+    bool stopped;
+    std::mutex mutex;
+    std::condition_variable stop_condition;
+    std::thread watcher;
+
+    // Get current version of given list file
+    static FileVersion get_file_version( const std::string& );
+    // Watcher thread main loop
+    void watch();
+    // Check if any thread reads since epoch earlier than given one
+    bool read_before( uint64_t epoch );
+    // Free retired versions, which are no longer read and are older than
+    // grace period, or all of them
+    void free_retired( bool all );
+    // Get reader slot of calling thread, adding it on the first call
+    std::atomic<uint64_t>& reader_slot();
+
+  public:
+    // Reading of current lists version by one thread, which must not be nested.
+    // The version is not freed until the reading ends
+    class Reader
+    {
+      private:
+        std::atomic<uint64_t>& slot;
+        const DomainLists* lists;
+
+      public:
+        explicit Reader( DomainListsReloader& );
+        Reader( const Reader& ) = delete;
+        Reader& operator=( const Reader& ) = delete;
+        ~Reader();
+
+        const DomainLists& get() const noexcept;
+    };
+
+    explicit DomainListsReloader( const Config& );
+    DomainListsReloader( const DomainListsReloader& ) = delete;
+    DomainListsReloader& operator=( const DomainListsReloader& ) = delete;
+    ~DomainListsReloader();
+};
+
+}} // namespace snort::dns_firewall
+
+#endif // SNORT_DNS_FIREWALL_DOMAIN_LISTS_H
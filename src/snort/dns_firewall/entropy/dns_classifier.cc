@@ -17,6 +17,7 @@
 #include <algorithm>
 #include <cmath>
 #include <numeric>
+#include <stdexcept>
 
 namespace snort { namespace dns_firewall { namespace entropy {
 
@@ -186,6 +187,22 @@ void DnsClassifier::set_entropy_distribution( const std::vector<double>& dist,
     }
 }
 
+const std::vector<unsigned>& DnsClassifier::get_observations() const noexcept
+{
+    return entropy_distribution_;
+}
+
+void DnsClassifier::add_observations( const std::vector<unsigned>& observations )
+{
+    if( observations.size() != entropy_distribution_.size() ) {
+        throw std::invalid_argument(
+          "Entropy distributions of different bins can not be added!" );
+    }
+    for( unsigned i = 0; i < observations.size(); ++i ) {
+        entropy_distribution_[i] += observations[i];
+    }
+}
+
 unsigned DnsClassifier::get_distribution_bins() const noexcept
 {
     return dist_bins_;
@@ -197,13 +214,18 @@ unsigned DnsClassifier::get_window_width() const noexcept
 }
 
 void DnsClassifier::learn( const std::string& domain ) noexcept
+{
+    learn_sld( get_dns_xld( domain, 2 ) );
+}
+
+void DnsClassifier::learn_sld( const std::string& fld ) noexcept
 {
     if( state_shift_ ) {
-        forward_shift( get_dns_xld( domain, 2 ) );
+        forward_shift( fld );
         unsigned distribution_bin = floor( current_metric_ * dist_bins_ );
         ++entropy_distribution_[distribution_bin];
     } else {
-        insert( get_dns_xld( domain, 2 ) );
+        insert( fld );
         if( dns_fifo_.size() >= window_width_ ) {
             state_shift_ = true;
         }
@@ -212,7 +234,11 @@ void DnsClassifier::learn( const std::string& domain ) noexcept
 
 double DnsClassifier::classify( const std::string& domain ) noexcept
 {
-    std::string fld = get_dns_xld( domain, 2 );
+    return classify_sld( get_dns_xld( domain, 2 ) );
+}
+
+double DnsClassifier::classify_sld( const std::string& fld ) noexcept
+{
     if( not state_shift_ ) {
         insert( fld );
         if( dns_fifo_.size() >= window_width_ ) {
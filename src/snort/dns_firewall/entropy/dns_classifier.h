@@ -13,11 +13,13 @@
 // **********************************************************************
 
 #ifndef SNORT_DNS_FIREWALL_ENTROPY_DNS_CLASSIFIER_H
-#define SNORT_DNS_FIREWAL_ENTROPY_DNS_CLASSIFIER_H
+#define SNORT_DNS_FIREWALL_ENTROPY_DNS_CLASSIFIER_H
 
 #include "distribution_scale.h"
 #include <queue>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace snort { namespace dns_firewall { namespace entropy {
 
@@ -75,6 +77,11 @@ class DnsClassifier
     void set_entropy_distribution( const std::vector<double>&,
                                    unsigned,
                                    snort::dns_firewall::DistributionScale );
+    // Get number of observations in every bin of entropy distribution
+    const std::vector<unsigned>& get_observations() const noexcept;
+    // Add observations counted by another classifier of the same bins, so that
+    // distributions learned from many shards of dataset are merged. Throws otherwise
+    void add_observations( const std::vector<unsigned>& );
     // Get number of distribution bins
     unsigned get_distribution_bins() const noexcept;
     // Get current window width
@@ -82,10 +89,59 @@ class DnsClassifier
 
     // Learn classifier with one DNS domain
     void learn( const std::string& ) noexcept;
+    // Learn classifier with second-level domain, already extracted from DNS domain
+    void learn_sld( const std::string& ) noexcept;
     // Classify DNS domain
     double classify( const std::string& ) noexcept;
+    // Classify second-level domain, already extracted from DNS domain
+    double classify_sld( const std::string& ) noexcept;
+
+    // Serialization of the whole learning state, with window of domains
+    template<class Archive>
+    void save( Archive& ) const;
+    template<class Archive>
+    void load( Archive& );
 };
 
+template<class Archive>
+void DnsClassifier::save( Archive& archive ) const
+{
+    // Window is stored as vector, from the oldest domain
+    std::vector<std::string> window;
+    std::queue<std::string> fifo = dns_fifo_;
+    window.reserve( fifo.size() );
+    while( not fifo.empty() ) {
+        window.push_back( std::move( fifo.front() ) );
+        fifo.pop();
+    }
+    archive( window,
+             dns_fifo_size_,
+             current_metric_,
+             window_width_,
+             freq_,
+             entropy_distribution_,
+             dist_bins_,
+             state_shift_ );
+}
+
+template<class Archive>
+void DnsClassifier::load( Archive& archive )
+{
+    std::vector<std::string> window;
+    archive( window,
+             dns_fifo_size_,
+             current_metric_,
+             window_width_,
+             freq_,
+             entropy_distribution_,
+             dist_bins_,
+             state_shift_ );
+    dns_fifo_ = std::queue<std::string>();
+    for( auto& domain: window ) {
+        dns_fifo_.push( std::move( domain ) );
+    }
+}
+
 }}} // namespace snort::dns_firewall::entropy
 
 #endif // SNORT_DNS_FIREWALL_ENTROPY_DNS_CLASSIFIER_H
@@ -12,43 +12,23 @@
 // GNU General Public License for more details.
 // **********************************************************************
 
-#ifndef SNORT_DNS_FIREWALL_DNS_PACKET_H
-#define SNORT_DNS_FIREWALL_DNS_PACKET_H
+#ifndef SNORT_DNS_FIREWALL_HMM_PRECISION_H
+#define SNORT_DNS_FIREWALL_HMM_PRECISION_H
 
-#include <string>
-#include <vector>
+#include <ostream>
 
 namespace snort { namespace dns_firewall {
 
-struct DnsPacket
+// Type of log10 probabilities used in HMM scoring, see QuantizedHmm
+enum HmmPrecision
 {
-    struct Question
-    {
-        unsigned qlen;
-        std::string qname;
-        unsigned qtype;
-        unsigned qclass;
-        Question()
-            : qlen( 0 )
-            , qtype( 0 )
-            , qclass( 0 )
-        {
-        }
-    };
-
-    explicit DnsPacket( const uint8_t*, unsigned );
-    explicit DnsPacket( const std::string& domain );
-
-    u_int16_t id;
-    u_int16_t flags;
-    u_int16_t question_num;
-    u_int16_t answer_num;
-    u_int16_t authority_num;
-    u_int16_t additional_num;
-    std::vector<DnsPacket::Question> questions;
-    bool malformed;
+    DOUBLE,
+    FLOAT,
+    INT16
 };
 
+std::ostream& operator<<( std::ostream&, const HmmPrecision& );
+
 }} // namespace snort::dns_firewall
 
-#endif // SNORT_DNS_FIREWALL_DNS_PACKET_H
+#endif // SNORT_DNS_FIREWALL_HMM_PRECISION_H
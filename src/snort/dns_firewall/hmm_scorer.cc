@@ -0,0 +1,87 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#include "hmm_scorer.h"
+#include "quantized_hmm.h"
+
+namespace snort { namespace dns_firewall {
+
+using scientific::ml::DynamicHmmScorer;
+using scientific::ml::FixedHmm;
+using scientific::ml::Hmm;
+using scientific::ml::HmmScorer;
+using scientific::ml::QuantizedHmm;
+
+// Create quantized scorer with scores of given type, if HMM fits any size
+template<class T>
+static std::unique_ptr<HmmScorer> make_quantized( const Hmm<char, std::string>& hmm )
+{
+    if( QuantizedHmm<4, DNS_ALPHABET_SIZE, T>::fits( hmm ) ) {
+        return std::make_unique<QuantizedHmm<4, DNS_ALPHABET_SIZE, T>>( hmm );
+    }
+    if( QuantizedHmm<8, DNS_ALPHABET_SIZE, T>::fits( hmm ) ) {
+        return std::make_unique<QuantizedHmm<8, DNS_ALPHABET_SIZE, T>>( hmm );
+    }
+    if( QuantizedHmm<16, DNS_ALPHABET_SIZE, T>::fits( hmm ) ) {
+        return std::make_unique<QuantizedHmm<16, DNS_ALPHABET_SIZE, T>>( hmm );
+    }
+    if( QuantizedHmm<32, DNS_ALPHABET_SIZE, T>::fits( hmm ) ) {
+        return std::make_unique<QuantizedHmm<32, DNS_ALPHABET_SIZE, T>>( hmm );
+    }
+    return nullptr;
+}
+
+std::unique_ptr<HmmScorer> make_quantized_hmm_scorer( const Hmm<char, std::string>& hmm,
+                                                      HmmPrecision precision )
+{
+    if( hmm.has_sparse_transitions() ) {
+        return nullptr;
+    }
+    switch( precision ) {
+    case HmmPrecision::FLOAT:
+        return make_quantized<float>( hmm );
+    case HmmPrecision::INT16:
+        return make_quantized<int16_t>( hmm );
+    default:
+        return nullptr;
+    }
+}
+
+std::unique_ptr<HmmScorer> make_hmm_scorer( const Hmm<char, std::string>& hmm,
+                                            HmmPrecision precision )
+{
+    std::unique_ptr<HmmScorer> quantized = make_quantized_hmm_scorer( hmm, precision );
+    if( quantized ) {
+        return quantized;
+    }
+    // Sparse transitions are iterated over faster than dense kernels multiply
+    if( hmm.has_sparse_transitions() ) {
+        return std::make_unique<DynamicHmmScorer>( hmm );
+    }
+    if( FixedHmm<4, DNS_ALPHABET_SIZE>::fits( hmm ) ) {
+        return std::make_unique<FixedHmm<4, DNS_ALPHABET_SIZE>>( hmm );
+    }
+    if( FixedHmm<8, DNS_ALPHABET_SIZE>::fits( hmm ) ) {
+        return std::make_unique<FixedHmm<8, DNS_ALPHABET_SIZE>>( hmm );
+    }
+    if( FixedHmm<16, DNS_ALPHABET_SIZE>::fits( hmm ) ) {
+        return std::make_unique<FixedHmm<16, DNS_ALPHABET_SIZE>>( hmm );
+    }
+    if( FixedHmm<32, DNS_ALPHABET_SIZE>::fits( hmm ) ) {
+        return std::make_unique<FixedHmm<32, DNS_ALPHABET_SIZE>>( hmm );
+    }
+    return std::make_unique<DynamicHmmScorer>( hmm );
+}
+
+}} // namespace snort::dns_firewall
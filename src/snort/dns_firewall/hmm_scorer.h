@@ -0,0 +1,44 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#ifndef SNORT_DNS_FIREWALL_HMM_SCORER_H
+#define SNORT_DNS_FIREWALL_HMM_SCORER_H
+
+#include "fixed_hmm.h"
+#include "hmm_precision.h"
+#include "smart_hmm.h"
+#include <memory>
+#include <string>
+
+namespace snort { namespace dns_firewall {
+
+// Size of the alphabet of HMMs trained by dfw3trainer
+static constexpr unsigned DNS_ALPHABET_SIZE = 54;
+
+// Create the fastest scorer for given HMM: compile-time specialized
+// FixedHmm for models of 4, 8, 16 or 32 states with DNS alphabet,
+// or scorer of any size otherwise, also for models of sparse transitions.
+// With float or int16 precision, quantized scorer is created if possible
+std::unique_ptr<scientific::ml::HmmScorer>
+make_hmm_scorer( const scientific::ml::Hmm<char, std::string>&,
+                 HmmPrecision = HmmPrecision::DOUBLE );
+
+// Create QuantizedHmm scorer of given precision for dense HMM of 4, 8, 16
+// or 32 states with DNS alphabet, or return null for any other HMM
+std::unique_ptr<scientific::ml::HmmScorer>
+make_quantized_hmm_scorer( const scientific::ml::Hmm<char, std::string>&, HmmPrecision );
+
+}} // namespace snort::dns_firewall
+
+#endif // SNORT_DNS_FIREWALL_HMM_SCORER_H
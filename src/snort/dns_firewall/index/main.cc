@@ -0,0 +1,80 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#include "domain_index.h"
+#include <chrono>
+#include <iostream>
+#include <unistd.h>
+
+extern char* optarg;
+
+using namespace snort::dns_firewall;
+
+// ----------------
+// ENTRYPOINT
+// ----------------
+int main( int argc, char* const argv[] )
+{
+    std::cout << "dfw3index 0.1.2 by Artur M. Brodzki" << std::endl << std::endl;
+    std::string help =
+      "Usage:\n"
+      "   -f: File name of the domain list to compile, one domain per line (mandatory)\n"
+      "   -o: Output index file name (mandatory)\n"
+      "   -b: Bloom filter bits per domain, from 1 to 64 (default: 16)\n"
+      "   -h: Print this help\n\n"
+      "   Output file may be used as plugin blacklist or whitelist. Bloom filter\n"
+      "   stored in it is used by the plugin as prefilter of its domains.\n";
+
+    // Parse command line options
+    int opt;
+    std::string list_filename_getopt;
+    std::string index_filename_getopt;
+    unsigned bits_per_entry_getopt = 16;
+
+    while( ( opt = getopt( argc, argv, "f:o:b:h" ) ) != -1 ) {
+        switch( opt ) {
+        case 'f':
+            list_filename_getopt = std::string( optarg );
+            break;
+        case 'o':
+            index_filename_getopt = std::string( optarg );
+            break;
+        case 'b':
+            bits_per_entry_getopt = std::stoul( optarg );
+            break;
+        case 'h':
+            std::cout << help << std::endl;
+            exit( 0 );
+            break;
+        }
+    }
+    if( list_filename_getopt == "" || index_filename_getopt == "" ) {
+        std::cout << help << std::endl;
+        exit( 1 );
+    }
+
+    // Compile index
+    auto start       = std::chrono::steady_clock::now();
+    unsigned entries = DomainIndex::compile(
+      list_filename_getopt, index_filename_getopt, bits_per_entry_getopt );
+    auto elapsed     = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start );
+
+    std::cout.imbue( std::locale( "" ) );
+    std::cout << "Index saved to " << index_filename_getopt << "!" << std::endl;
+    std::cout << "Indexed domains: " << entries << std::endl;
+    std::cout << "Elapsed time: " << elapsed.count() << " ms" << std::endl;
+
+    return 0;
+}
@@ -14,15 +14,34 @@
 
 #include "ips_option.h"
 #include "classification.h"
-#include "dns_packet.h"
+#include "dns_packet_view.h"
+#include "dns_tcp_stream.h"
+#include "module.h"
+#include <algorithm>
+#include <flow/flow.h>
+#include <optional>
+#include <protocols/tcp.h>
 
 namespace snort { namespace dns_firewall {
 
+// Both directions of DNS over TCP connection, kept between segments
+class DnsTcpFlowData : public snort::FlowData
+{
+  public:
+    DnsTcpStream streams[2]; // From client and from server
+
+    explicit DnsTcpFlowData( unsigned id )
+        : snort::FlowData( id )
+    {
+    }
+};
+
 dns_firewall::IpsOption::IpsOption( const std::string& config_filename )
     : snort::IpsOption( "dns_firewall" )
     , options( config_filename )
     , classifier( options )
     , processed_queries( 0 )
+    , flow_data_id( snort::FlowData::create_flow_data_id() )
 {
     // Load model data
     model.load_from_file( options.model.filename );
@@ -52,13 +71,95 @@ bool dns_firewall::IpsOption::operator==( const dns_firewall::IpsOption& operand
 
 snort::IpsOption::EvalStatus dns_firewall::IpsOption::eval( Cursor&, Packet* p )
 {
-    DnsPacket dns( p->data, p->dsize );
+    // DNS over UDP, one message per datagram
+    if( not p->is_tcp() ) {
+        DnsPacketView dns( p->data, p->dsize, classifier.get_canonicalizer() );
+        return eval_message( dns );
+    }
+
+    // DNS over TCP, many messages per segment or messages split between segments.
+    // Raw segments are reassembled by DnsTcpStream, so PDUs rebuilt by Snort
+    // stream would repeat their messages. Without flow, the segment is parsed on its own
+    if( p->packet_flags & PKT_REBUILT_STREAM ) {
+        return NO_MATCH;
+    }
+    DnsTcpFlowData* flow_data = nullptr;
+    if( p->flow ) {
+        flow_data = static_cast<DnsTcpFlowData*>( p->flow->get_flow_data( flow_data_id ) );
+        if( not flow_data ) {
+            flow_data = new DnsTcpFlowData( flow_data_id );
+            p->flow->set_flow_data( flow_data );
+        }
+    }
+    DnsTcpStream segment_stream;
+    DnsTcpStream& stream = flow_data ? flow_data->streams[p->is_from_server()] : segment_stream;
+
+    // Pipelined messages are collected and classified together
+    EvalStatus status = NO_MATCH;
+    std::optional<DnsPacketView> batch[MAX_BATCH];
+    unsigned batched = 0;
+    auto flush       = [&]() {
+        const DnsPacketView* messages[MAX_BATCH];
+        for( unsigned i = 0; i < batched; ++i ) {
+            messages[i] = &*batch[i];
+        }
+        if( eval_messages( messages, batched ) == MATCH ) {
+            status = MATCH;
+        }
+        batched = 0;
+    };
+    auto on_message = [&]( const uint8_t* data, unsigned size ) {
+        if( batched == MAX_BATCH ) {
+            flush();
+        }
+        batch[batched++].emplace( data, size, classifier.get_canonicalizer() );
+    };
+    if( flow_data ) {
+        // SYN takes one sequence number before payload
+        const snort::tcp::TCPHdr* tcp = p->ptrs.tcph;
+        if( tcp->is_syn() ) {
+            stream.reset();
+        }
+        stream.feed( tcp->seq() + tcp->is_syn(), p->data, p->dsize, on_message );
+    } else {
+        stream.feed( p->data, p->dsize, on_message );
+    }
+    flush();
+    return status;
+}
+
+bool dns_firewall::IpsOption::accept_message( const DnsPacketView& dns )
+{
     if( dns.malformed ) {
-        std::cout << "[DNS Firewall] Packet received on UDP port 53, but not a DNS query!"
+        std::cout << "[DNS Firewall] Packet received on port 53, but not a DNS message!"
                   << std::endl;
-        return NO_MATCH;
+        return false;
     }
     ++processed_queries;
+    ++dns_firewall_stats.queries;
+
+    // Tunnels carry data in answers too, their sections are parsed only here
+    if( dns.flags & DnsPacketView::FLAG_RESPONSE ) {
+        const DnsPacketView::AnswerSummary answers = dns.summarize_answers();
+        PegStats& stats                            = dns_firewall_stats;
+        ++stats.responses;
+        stats.response_answer_bytes += answers.rdata_bytes;
+        stats.response_max_payload = std::max<PegCount>( stats.response_max_payload,
+                                                         answers.max_payload );
+        stats.response_max_cname_chain = std::max<PegCount>( stats.response_max_cname_chain,
+                                                             answers.cname_chain );
+    }
+    return true;
+}
+
+snort::IpsOption::EvalStatus dns_firewall::IpsOption::eval_message( const DnsPacketView& dns )
+{
+    if( not accept_message( dns ) ) {
+        return NO_MATCH;
+    }
+    if( dns.truncated_questions ) {
+        return eval_truncated( dns );
+    }
 
     // Learn mode
     if( options.mode == Config::Mode::LEARN ) {
@@ -72,7 +173,54 @@ snort::IpsOption::EvalStatus dns_firewall::IpsOption::eval( Cursor&, Packet* p )
     }
 
     // Simple mode
-    Classification cls = classifier.classify( dns );
+    return eval_classification( classifier.classify( dns ) );
+}
+
+snort::IpsOption::EvalStatus
+dns_firewall::IpsOption::eval_messages( const DnsPacketView* const* messages, unsigned count )
+{
+    EvalStatus status = NO_MATCH;
+    if( options.mode == Config::Mode::LEARN || count == 1 ) {
+        for( unsigned i = 0; i < count; ++i ) {
+            if( eval_message( *messages[i] ) == MATCH ) {
+                status = MATCH;
+            }
+        }
+        return status;
+    }
+
+    // Simple mode, all valid messages scored together
+    const DnsPacketView* accepted[MAX_BATCH];
+    unsigned accepted_count = 0;
+    for( unsigned i = 0; i < count; ++i ) {
+        if( not accept_message( *messages[i] ) ) {
+            continue;
+        }
+        if( messages[i]->truncated_questions ) {
+            status = eval_truncated( *messages[i] );
+        } else {
+            accepted[accepted_count++] = messages[i];
+        }
+    }
+    Classification results[MAX_BATCH];
+    classifier.classify( accepted, accepted_count, results );
+    for( unsigned i = 0; i < accepted_count; ++i ) {
+        if( eval_classification( results[i] ) == MATCH ) {
+            status = MATCH;
+        }
+    }
+    return status;
+}
+
+snort::IpsOption::EvalStatus
+dns_firewall::IpsOption::eval_classification( const Classification& cls )
+{
+    // Add events counted by classifier in this thread to its pegs
+    const DnsClassifier::Statistics stats = DnsClassifier::take_statistics();
+    dns_firewall_stats.prefilter_queries += stats.prefilter_queries;
+    dns_firewall_stats.prefilter_hits += stats.prefilter_hits;
+    dns_firewall_stats.prefilter_false_positives += stats.prefilter_false_positives;
+    dns_firewall_stats.hmm_early_exits += stats.hmm_early_exits;
 
     // Allow query
     if( cls.note == Classification::Note::WHITELIST ||
@@ -105,4 +253,15 @@ snort::IpsOption::EvalStatus dns_firewall::IpsOption::eval( Cursor&, Packet* p )
     return NO_MATCH; // this line should never execute
 }
 
+snort::IpsOption::EvalStatus dns_firewall::IpsOption::eval_truncated( const DnsPacketView& dns )
+{
+    ++dns_firewall_stats.truncated_questions;
+    if( options.verbosity == Config::Verbosity::ALL ||
+        options.verbosity == Config::Verbosity::REJECT_ONLY ) {
+        std::cout << "[DNS Firewall] Message with " << dns.question_num << " questions REJECT"
+                  << std::endl;
+    }
+    return MATCH;
+}
+
 }} // namespace snort::dns_firewall
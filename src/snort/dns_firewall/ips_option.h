@@ -15,8 +15,10 @@
 #ifndef SNORT_DNS_FIREWALL_IPS_OPTION_H
 #define SNORT_DNS_FIREWALL_IPS_OPTION_H
 
+#include "classification.h"
 #include "config.h"
 #include "dns_classifier.h"
+#include "dns_packet_view.h"
 #include "model.h"
 #include <framework/ips_option.h>
 #include <protocols/packet.h>
@@ -30,6 +32,22 @@ class IpsOption : public snort::IpsOption
     Model model;
     DnsClassifier classifier;
     unsigned processed_queries; // statistics
+    unsigned flow_data_id;      // Id of DNS over TCP streams in Snort flows
+
+    // Maximal number of DNS over TCP messages of one segment classified together
+    static constexpr unsigned MAX_BATCH = 8;
+
+    // Check if DNS message is valid and count it
+    bool accept_message( const DnsPacketView& );
+    // Classify one DNS message
+    EvalStatus eval_message( const DnsPacketView& );
+    // Classify up to MAX_BATCH DNS messages together
+    EvalStatus eval_messages( const DnsPacketView* const*, unsigned );
+    // Allow or reject message with given classification
+    EvalStatus eval_classification( const Classification& );
+    // Reject message with questions skipped by DnsPacketView, which could
+    // otherwise carry names never classified
+    EvalStatus eval_truncated( const DnsPacketView& );
 
   public:
     explicit IpsOption( const std::string& );
@@ -27,6 +27,32 @@ static const Parameter module_params[] = {
     { nullptr, Parameter::PT_MAX, nullptr, nullptr, nullptr }
 };
 
+THREAD_LOCAL PegStats dns_firewall_stats;
+
+static const PegInfo module_pegs[] = {
+    { CountType::SUM, "queries", "DNS queries processed" },
+    { CountType::SUM, "prefilter_queries", "queries checked against lists prefilter" },
+    { CountType::SUM, "prefilter_hits", "queries passed by lists prefilter" },
+    { CountType::SUM,
+      "prefilter_false_positives",
+      "queries passed by lists prefilter, but not found on lists" },
+    { CountType::SUM,
+      "hmm_early_exits",
+      "queries with HMM scoring stopped early, as they were rejected anyway" },
+    { CountType::SUM,
+      "truncated_questions",
+      "messages rejected for too many questions to classify" },
+    { CountType::SUM, "responses", "DNS responses processed" },
+    { CountType::SUM, "response_answer_bytes", "data bytes of answers in responses" },
+    { CountType::MAX,
+      "response_max_payload",
+      "longest TXT or NULL record payload in answers of responses" },
+    { CountType::MAX,
+      "response_max_cname_chain",
+      "longest chain of CNAME records followed in answers of responses" },
+    { CountType::END, nullptr, nullptr }
+};
+
 Module::Module()
     : snort::Module( module_name, module_help, module_params ) {
 }
@@ -60,6 +86,14 @@ ProfileStats* Module::get_profile() const {
     return &dns_tunnel_perf_stats;
 }
 
+const PegInfo* Module::get_pegs() const {
+    return module_pegs;
+}
+
+PegCount* Module::get_counts() const {
+    return (PegCount*) &dns_firewall_stats;
+}
+
 Module::Usage Module::get_usage() const {
     return DETECT;
 }
@@ -24,6 +24,22 @@ static const char* module_name = "dns_firewall";
 static const char* module_help = "alert on suspicious DNS queries activity";
 static THREAD_LOCAL ProfileStats dns_tunnel_perf_stats;
 
+// Layout must match module_pegs array in module.cc
+struct PegStats
+{
+    PegCount queries;
+    PegCount prefilter_queries;
+    PegCount prefilter_hits;
+    PegCount prefilter_false_positives;
+    PegCount hmm_early_exits;
+    PegCount truncated_questions;
+    PegCount responses;
+    PegCount response_answer_bytes;
+    PegCount response_max_payload;
+    PegCount response_max_cname_chain;
+};
+extern THREAD_LOCAL PegStats dns_firewall_stats;
+
 class Module : public snort::Module
 {
   public:
@@ -37,6 +53,8 @@ class Module : public snort::Module
     bool end( const char*, int, SnortConfig* ) override;
 
     ProfileStats* get_profile() const override;
+    const PegInfo* get_pegs() const override;
+    PegCount* get_counts() const override;
     Usage get_usage() const override;
 };
 
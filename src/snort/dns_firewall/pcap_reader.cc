@@ -0,0 +1,433 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#include "pcap_reader.h"
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace snort { namespace dns_firewall {
+
+namespace {
+
+const uint32_t PCAP_MAGIC             = 0xa1b2c3d4; // Microsecond timestamps
+const uint32_t PCAP_MAGIC_NS          = 0xa1b23c4d; // Nanosecond timestamps
+const uint32_t PCAPNG_SECTION_HEADER  = 0x0a0d0d0a;
+const uint32_t PCAPNG_BYTE_ORDER      = 0x1a2b3c4d;
+const uint32_t PCAPNG_INTERFACE       = 1;
+const uint32_t PCAPNG_SIMPLE_PACKET   = 3;
+const uint32_t PCAPNG_ENHANCED_PACKET = 6;
+const uint16_t PCAPNG_IF_TSRESOL      = 9;
+
+const unsigned PCAP_HEADER_SIZE = 24;
+const unsigned RECORD_SIZE      = 16;
+const uint64_t NANOSECONDS      = 1000000000; // In a second
+
+// Link types
+const unsigned LINKTYPE_NULL       = 0;
+const unsigned LINKTYPE_ETHERNET   = 1;
+const unsigned LINKTYPE_RAW_OLD    = 12;
+const unsigned LINKTYPE_RAW        = 101;
+const unsigned LINKTYPE_LOOP       = 108;
+const unsigned LINKTYPE_LINUX_SLL  = 113;
+const unsigned LINKTYPE_IPV4       = 228;
+const unsigned LINKTYPE_IPV6       = 229;
+const unsigned LINKTYPE_LINUX_SLL2 = 276;
+
+// EtherTypes
+const uint16_t ETHERTYPE_IPV4  = 0x0800;
+const uint16_t ETHERTYPE_IPV6  = 0x86dd;
+const uint16_t ETHERTYPE_VLAN  = 0x8100;
+const uint16_t ETHERTYPE_QINQ  = 0x88a8;
+const uint16_t ETHERTYPE_QINQ2 = 0x9100;
+
+// IP protocols and IPv6 extension headers
+const uint8_t PROTOCOL_HOP_OPTIONS = 0;
+const uint8_t PROTOCOL_TCP         = 6;
+const uint8_t PROTOCOL_UDP         = 17;
+const uint8_t PROTOCOL_ROUTING     = 43;
+const uint8_t PROTOCOL_FRAGMENT    = 44;
+const uint8_t PROTOCOL_AUTH        = 51;
+const uint8_t PROTOCOL_DST_OPTIONS = 60;
+
+const uint8_t TCP_FIN = 0x01;
+const uint8_t TCP_SYN = 0x02;
+const uint8_t TCP_RST = 0x04;
+
+uint16_t big16( const uint8_t* data )
+{
+    return ( data[0] << 8 ) | data[1];
+}
+
+uint32_t big32( const uint8_t* data )
+{
+    return ( uint32_t( big16( data ) ) << 16 ) | big16( data + 2 );
+}
+
+uint32_t swap32( uint32_t value )
+{
+    return __builtin_bswap32( value );
+}
+
+// Decode UDP or TCP header of given protocol
+bool decode_transport(
+  const uint8_t* data, unsigned size, uint8_t protocol, PcapReader::Packet& packet )
+{
+    unsigned header;
+    if( protocol == PROTOCOL_UDP ) {
+        if( size < 8 || big16( data + 4 ) < 8 || big16( data + 4 ) > size ) {
+            return false;
+        }
+        header     = 8;
+        size       = big16( data + 4 );
+        packet.tcp      = false;
+        packet.syn      = false;
+        packet.fin      = false;
+        packet.sequence = 0;
+    } else if( protocol == PROTOCOL_TCP ) {
+        if( size < 20 ) {
+            return false;
+        }
+        header = ( data[12] >> 4 ) * 4;
+        if( header < 20 || header > size ) {
+            return false;
+        }
+        packet.tcp = true;
+        packet.syn = data[13] & TCP_SYN;
+        packet.fin = data[13] & ( TCP_FIN | TCP_RST );
+        // SYN takes one sequence number before payload
+        packet.sequence = big32( data + 4 ) + packet.syn;
+    } else {
+        return false;
+    }
+    if( big16( data ) != PcapReader::DNS_PORT && big16( data + 2 ) != PcapReader::DNS_PORT ) {
+        return false;
+    }
+    std::memcpy( packet.flow + 33, data, 4 );
+    packet.data = data + header;
+    packet.size = size - header;
+    return true;
+}
+
+// Decode IPv4 header
+bool decode_ipv4( const uint8_t* data, unsigned size, PcapReader::Packet& packet )
+{
+    if( size < 20 || ( data[0] >> 4 ) != 4 ) {
+        return false;
+    }
+    unsigned header = ( data[0] & 0x0f ) * 4;
+    unsigned total  = big16( data + 2 );
+    // Total length excludes link layer padding
+    if( header < 20 || total < header || total > size ) {
+        return false;
+    }
+    // Fragments are skipped: more fragments flag or non-zero offset
+    if( big16( data + 6 ) & 0x3fff ) {
+        return false;
+    }
+    std::memset( packet.flow, 0, 33 );
+    packet.flow[0] = 4;
+    std::memcpy( packet.flow + 1, data + 12, 4 );
+    std::memcpy( packet.flow + 17, data + 16, 4 );
+    return decode_transport( data + header, total - header, data[9], packet );
+}
+
+// Decode IPv6 header and extension headers
+bool decode_ipv6( const uint8_t* data, unsigned size, PcapReader::Packet& packet )
+{
+    if( size < 40 || ( data[0] >> 4 ) != 6 || 40u + big16( data + 4 ) > size ) {
+        return false;
+    }
+    packet.flow[0] = 6;
+    std::memcpy( packet.flow + 1, data + 8, 32 );
+    uint8_t next = data[6];
+    size         = 40 + big16( data + 4 );
+    unsigned pos = 40;
+    while( next == PROTOCOL_HOP_OPTIONS || next == PROTOCOL_ROUTING ||
+           next == PROTOCOL_DST_OPTIONS || next == PROTOCOL_AUTH ) {
+        if( pos + 2 > size ) {
+            return false;
+        }
+        unsigned length = next == PROTOCOL_AUTH ? ( data[pos + 1] + 2 ) * 4
+                                                : ( data[pos + 1] + 1 ) * 8;
+        next = data[pos];
+        pos += length;
+    }
+    if( next == PROTOCOL_FRAGMENT || pos > size ) {
+        return false;
+    }
+    return decode_transport( data + pos, size - pos, next, packet );
+}
+
+// Decode IP packet of given EtherType
+bool decode_ip( const uint8_t* data, unsigned size, uint16_t type, PcapReader::Packet& packet )
+{
+    if( type == ETHERTYPE_IPV4 ) {
+        return decode_ipv4( data, size, packet );
+    }
+    if( type == ETHERTYPE_IPV6 ) {
+        return decode_ipv6( data, size, packet );
+    }
+    return false;
+}
+
+// Decode IP packet of any version
+bool decode_raw_ip( const uint8_t* data, unsigned size, PcapReader::Packet& packet )
+{
+    if( size == 0 ) {
+        return false;
+    }
+    return decode_ip(
+      data, size, ( data[0] >> 4 ) == 4 ? ETHERTYPE_IPV4 : ETHERTYPE_IPV6, packet );
+}
+
+} // namespace
+
+PcapReader::PcapReader( const std::string& filename )
+    : filename_( filename )
+    , file_( open( filename.c_str(), O_RDONLY ) )
+    , data_( nullptr )
+    , size_( 0 )
+    , pos_( 0 )
+    , swapped_( false )
+    , nanoseconds_( 1000 )
+    , link_type_( LINKTYPE_ETHERNET )
+{
+    struct stat st;
+    if( file_ < 0 || fstat( file_, &st ) != 0 ) {
+        if( file_ >= 0 ) {
+            close( file_ );
+        }
+        throw std::invalid_argument( "Could not open capture file " + filename );
+    }
+    size_ = st.st_size;
+    if( size_ >= 4 ) {
+        void* data = mmap( nullptr, size_, PROT_READ, MAP_PRIVATE, file_, 0 );
+        if( data == MAP_FAILED ) {
+            close( file_ );
+            throw std::invalid_argument( "Could not map capture file " + filename );
+        }
+        // Capture is read once, from the beginning to the end
+        madvise( data, size_, MADV_SEQUENTIAL );
+        data_ = static_cast<const uint8_t*>( data );
+    }
+
+    uint32_t magic = size_ >= 4 ? read32( 0 ) : 0;
+    if( magic == PCAPNG_SECTION_HEADER ) {
+        // Byte order is read with the first section header block
+        format_ = PCAPNG;
+    } else if( size_ >= PCAP_HEADER_SIZE &&
+               ( magic == PCAP_MAGIC || magic == swap32( PCAP_MAGIC ) ||
+                 magic == PCAP_MAGIC_NS || magic == swap32( PCAP_MAGIC_NS ) ) ) {
+        format_      = PCAP;
+        swapped_     = magic == swap32( PCAP_MAGIC ) || magic == swap32( PCAP_MAGIC_NS );
+        nanoseconds_ = magic == PCAP_MAGIC || magic == swap32( PCAP_MAGIC ) ? 1000 : 1;
+        link_type_   = read32( 20 ) & 0xffff;
+        pos_         = PCAP_HEADER_SIZE;
+    } else {
+        if( data_ ) {
+            munmap( const_cast<uint8_t*>( data_ ), size_ );
+        }
+        close( file_ );
+        throw std::invalid_argument( "Not a pcap or pcapng file " + filename );
+    }
+}
+
+PcapReader::~PcapReader()
+{
+    munmap( const_cast<uint8_t*>( data_ ), size_ );
+    close( file_ );
+}
+
+bool PcapReader::is_capture( const std::string& filename )
+{
+    // Only regular files may be mapped, and reading from pipe would consume its data
+    struct stat st;
+    if( stat( filename.c_str(), &st ) != 0 || not S_ISREG( st.st_mode ) ) {
+        return false;
+    }
+    uint32_t magic = 0;
+    int file       = open( filename.c_str(), O_RDONLY );
+    if( file < 0 ) {
+        return false;
+    }
+    bool read = ::read( file, &magic, sizeof( magic ) ) == sizeof( magic );
+    close( file );
+    return read && ( magic == PCAPNG_SECTION_HEADER || magic == PCAP_MAGIC ||
+                     magic == swap32( PCAP_MAGIC ) || magic == PCAP_MAGIC_NS ||
+                     magic == swap32( PCAP_MAGIC_NS ) );
+}
+
+uint16_t PcapReader::read16( std::size_t pos ) const noexcept
+{
+    uint16_t value;
+    std::memcpy( &value, data_ + pos, sizeof( value ) );
+    return swapped_ ? __builtin_bswap16( value ) : value;
+}
+
+uint32_t PcapReader::read32( std::size_t pos ) const noexcept
+{
+    uint32_t value;
+    std::memcpy( &value, data_ + pos, sizeof( value ) );
+    return swapped_ ? swap32( value ) : value;
+}
+
+bool PcapReader::next_frame( const uint8_t*& frame,
+                             unsigned& size,
+                             unsigned& link_type,
+                             uint64_t& timestamp )
+{
+    if( format_ == PCAP ) {
+        if( pos_ + RECORD_SIZE > size_ ) {
+            return false;
+        }
+        // Last record may be truncated, if capture was interrupted
+        uint32_t captured = read32( pos_ + 8 );
+        if( pos_ + RECORD_SIZE + captured > size_ ) {
+            return false;
+        }
+        timestamp = read32( pos_ ) * NANOSECONDS + nanoseconds_ * read32( pos_ + 4 );
+        frame     = data_ + pos_ + RECORD_SIZE;
+        size      = captured;
+        link_type = link_type_;
+        pos_ += RECORD_SIZE + captured;
+        return true;
+    }
+
+    // Walk pcapng blocks, until a packet block
+    while( pos_ + 12 <= size_ ) {
+        uint32_t type = read32( pos_ );
+        if( type == PCAPNG_SECTION_HEADER ) {
+            // Byte order of section, its magic is the same in both orders
+            uint32_t order;
+            std::memcpy( &order, data_ + pos_ + 8, sizeof( order ) );
+            if( order != PCAPNG_BYTE_ORDER && order != swap32( PCAPNG_BYTE_ORDER ) ) {
+                throw std::invalid_argument( "Invalid pcapng section in " + filename_ );
+            }
+            swapped_ = order != PCAPNG_BYTE_ORDER;
+            interfaces_.clear();
+        }
+        std::size_t length = read32( pos_ + 4 );
+        if( length < 12 || length % 4 != 0 || pos_ + length > size_ ) {
+            return false;
+        }
+        const std::size_t block = pos_;
+        pos_ += length;
+
+        if( type == PCAPNG_INTERFACE && length >= 20 ) {
+            Interface interface = { read16( block + 8 ), 1000000 };
+            // Options, padded to 4 bytes, up to the trailing block length
+            for( std::size_t option = block + 16; option + 4 <= block + length - 4; ) {
+                uint16_t code   = read16( option );
+                uint16_t olength = read16( option + 2 );
+                if( code == PCAPNG_IF_TSRESOL && olength >= 1 ) {
+                    uint8_t resolution = data_[option + 4];
+                    unsigned exponent  = resolution & 0x7f;
+                    uint64_t base      = resolution & 0x80 ? 2 : 10;
+                    interface.units    = 1;
+                    for( unsigned e = 0; e < exponent && interface.units < 1ull << 60; ++e ) {
+                        interface.units *= base;
+                    }
+                }
+                if( code == 0 ) {
+                    break;
+                }
+                option += 4 + ( olength + 3 ) / 4 * 4;
+            }
+            interfaces_.push_back( interface );
+        } else if( type == PCAPNG_ENHANCED_PACKET && length >= 32 ) {
+            uint32_t id       = read32( block + 8 );
+            uint32_t captured = read32( block + 20 );
+            // Captured data must fit between block header and trailing length,
+            // compared without a sum that could overflow for a crafted length
+            if( id >= interfaces_.size() || captured > length - 32 ) {
+                continue;
+            }
+            uint64_t units = interfaces_[id].units;
+            uint64_t time  = ( uint64_t( read32( block + 12 ) ) << 32 ) | read32( block + 16 );
+            timestamp      = time / units * NANOSECONDS + time % units * NANOSECONDS / units;
+            frame          = data_ + block + 28;
+            size           = captured;
+            link_type      = interfaces_[id].link_type;
+            return true;
+        } else if( type == PCAPNG_SIMPLE_PACKET && length >= 16 && not interfaces_.empty() ) {
+            // Simple packets have no timestamp and belong to the first interface
+            timestamp = 0;
+            frame     = data_ + block + 12;
+            size      = std::min<std::size_t>( read32( block + 8 ), length - 16 );
+            link_type = interfaces_[0].link_type;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PcapReader::decode( const uint8_t* frame,
+                         unsigned size,
+                         unsigned link_type,
+                         Packet& packet )
+{
+    switch( link_type ) {
+    case LINKTYPE_ETHERNET: {
+        unsigned pos = 12;
+        if( size < pos + 2 ) {
+            return false;
+        }
+        uint16_t type = big16( frame + pos );
+        // Skip VLAN tags, possibly stacked
+        while( type == ETHERTYPE_VLAN || type == ETHERTYPE_QINQ || type == ETHERTYPE_QINQ2 ) {
+            pos += 4;
+            if( size < pos + 2 ) {
+                return false;
+            }
+            type = big16( frame + pos );
+        }
+        return decode_ip( frame + pos + 2, size - pos - 2, type, packet );
+    }
+    case LINKTYPE_LINUX_SLL:
+        return size >= 16 && decode_ip( frame + 16, size - 16, big16( frame + 14 ), packet );
+    case LINKTYPE_LINUX_SLL2:
+        return size >= 20 && decode_ip( frame + 20, size - 20, big16( frame ), packet );
+    case LINKTYPE_NULL:
+    case LINKTYPE_LOOP:
+        // Address family, in byte order of capturing host, is skipped
+        // as IP version is known from the packet itself
+        return size >= 4 && decode_raw_ip( frame + 4, size - 4, packet );
+    case LINKTYPE_RAW:
+    case LINKTYPE_RAW_OLD:
+    case LINKTYPE_IPV4:
+    case LINKTYPE_IPV6:
+        return decode_raw_ip( frame, size, packet );
+    default:
+        return false;
+    }
+}
+
+bool PcapReader::next( Packet& packet )
+{
+    const uint8_t* frame;
+    unsigned size;
+    unsigned link_type;
+    while( next_frame( frame, size, link_type, packet.timestamp ) ) {
+        if( decode( frame, size, link_type, packet ) ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}} // namespace snort::dns_firewall
@@ -0,0 +1,142 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#ifndef SNORT_DNS_FIREWALL_PCAP_READER_H
+#define SNORT_DNS_FIREWALL_PCAP_READER_H
+
+#include "dns_tcp_stream.h"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace snort { namespace dns_firewall {
+
+// Reader of DNS messages from capture file in pcap or pcapng format, without libpcap.
+// The file is mapped into memory and walked once, record by record. Ethernet (with
+// VLAN tags), Linux cooked, loopback and raw IP link layers are decoded, then IPv4
+// or IPv6 and UDP or TCP to or from port 53. Fragmented IP packets are skipped.
+// UDP payloads are passed in place, DNS over TCP is reassembled by DnsTcpStream,
+// assuming segments of every connection are captured in order. Retransmitted
+// segments are skipped and messages split by lost ones are dropped.
+class PcapReader
+{
+  public:
+    static constexpr uint16_t DNS_PORT = 53;
+
+    // Transport payload of one captured packet
+    struct Packet
+    {
+        uint64_t timestamp;  // Capture time, in nanoseconds since epoch
+        bool tcp;            // Payload of TCP segment, otherwise of UDP datagram
+        bool syn;            // TCP connection is opened, stream must be reset
+        bool fin;            // TCP connection is closed, by FIN or RST
+        uint32_t sequence;   // TCP sequence number of payload
+        uint8_t flow[37];    // IP version, addresses and ports of TCP connection
+        const uint8_t* data; // Payload
+        unsigned size;       // Payload size
+    };
+
+  private:
+    // Format of capture file
+    enum Format
+    {
+        PCAP,
+        PCAPNG
+    };
+    // Interface of pcapng section
+    struct Interface
+    {
+        unsigned link_type;
+        uint64_t units; // Timestamp units per second
+    };
+    typedef std::string Flow; // Bytes of Packet::flow
+
+    std::string filename_;
+    int file_;                                 // Descriptor of capture file
+    const uint8_t* data_;                      // Mapped file
+    std::size_t size_;                         // File size
+    std::size_t pos_;                          // Position of next record or block
+    Format format_;                            // Format of file
+    bool swapped_;                             // File byte order differs from the host one
+    uint64_t nanoseconds_;                     // Nanoseconds in unit of pcap timestamp
+    unsigned link_type_;                       // Link type of pcap file
+    std::vector<Interface> interfaces_;        // Interfaces of current pcapng section
+    std::map<Flow, DnsTcpStream> tcp_streams_; // Open DNS over TCP connections
+
+    uint16_t read16( std::size_t pos ) const noexcept;
+    uint32_t read32( std::size_t pos ) const noexcept;
+    // Get next captured frame, with its link type and timestamp
+    // Returns false at the end of file
+    bool next_frame( const uint8_t*& frame,
+                     unsigned& size,
+                     unsigned& link_type,
+                     uint64_t& timestamp );
+    // Decode headers of frame of given link type, down to DNS payload
+    // Returns false if frame does not carry DNS over UDP or TCP
+    static bool decode( const uint8_t* frame, unsigned size, unsigned link_type, Packet& );
+
+  public:
+    // Map given capture file. Throws if it can not be read or is not a capture
+    explicit PcapReader( const std::string& filename );
+    PcapReader( const PcapReader& ) = delete;
+    PcapReader& operator=( const PcapReader& ) = delete;
+    ~PcapReader();
+
+    // Check if given file is a regular file of pcap or pcapng capture, by its magic number
+    static bool is_capture( const std::string& filename );
+    // Get next packet carrying DNS, in capture order
+    // Returns false at the end of file
+    bool next( Packet& );
+    // Call on_message( uint64_t timestamp, const uint8_t* data, unsigned size )
+    // for every DNS message of the capture, in capture order, until it returns false.
+    // Message data is valid only during the call
+    template<typename F> void read_messages( F&& on_message );
+};
+
+template<typename F>
+void PcapReader::read_messages( F&& on_message )
+{
+    Packet packet;
+    while( next( packet ) ) {
+        if( not packet.tcp ) {
+            if( not on_message( packet.timestamp, packet.data, packet.size ) ) {
+                return;
+            }
+            continue;
+        }
+        Flow flow( reinterpret_cast<const char*>( packet.flow ), sizeof( packet.flow ) );
+        DnsTcpStream& stream = tcp_streams_[flow];
+        if( packet.syn ) {
+            stream.reset();
+        }
+        bool running = true;
+        stream.feed( packet.sequence,
+                     packet.data,
+                     packet.size,
+                     [&]( const uint8_t* data, unsigned size ) {
+                         running = running && on_message( packet.timestamp, data, size );
+                     } );
+        if( packet.fin ) {
+            tcp_streams_.erase( flow );
+        }
+        if( not running ) {
+            return;
+        }
+    }
+}
+
+}} // namespace snort::dns_firewall
+
+#endif // SNORT_DNS_FIREWALL_PCAP_READER_H
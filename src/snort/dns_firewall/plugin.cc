@@ -46,7 +46,7 @@ static const IpsApi dns_firewall_api = { { PT_IPS_OPTION,
                                            mod_dtor },
                                          OPT_TYPE_DETECTION,
                                          1,
-                                         PROTO_BIT__TCP,
+                                         PROTO_BIT__TCP | PROTO_BIT__UDP,
                                          nullptr, // pinit
                                          nullptr, // pterm
                                          nullptr, // tinit
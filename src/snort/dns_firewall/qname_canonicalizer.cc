@@ -0,0 +1,305 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#include "qname_canonicalizer.h"
+#include <algorithm>
+#include <cstring>
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <immintrin.h>
+#define QNAME_CANONICALIZER_X86
+#endif
+
+namespace snort { namespace dns_firewall {
+
+static constexpr unsigned BLOCK_SIZE = 64;
+
+// Vowels a, e, i, o, u as nibble tables, see QnameCanonicalizer::alphabet_low_
+alignas( 16 ) static const uint8_t vowels_low[16]  = { 0, 1, 0, 0, 0, 3, 0, 0,
+                                                      0, 1, 0, 0, 0, 0, 0, 1 };
+alignas( 16 ) static const uint8_t vowels_high[16] = { 0, 0, 0, 0, 0, 0, 1, 2,
+                                                       0, 0, 0, 0, 0, 0, 0, 0 };
+
+// Bit masks of character classes in one block, bit i describes character i
+struct BlockMasks
+{
+    uint64_t uppercase;
+    uint64_t digits;
+    uint64_t hex;
+    uint64_t hyphens;
+    uint64_t dots;
+    uint64_t consonants;
+    uint64_t known;
+};
+
+// Lowercase block of BLOCK_SIZE characters in place and compute its masks
+using ScanBlock = BlockMasks ( * )( char* block,
+                                    const uint8_t* alphabet_low,
+                                    const uint8_t* alphabet_high );
+
+static BlockMasks scan_block_scalar( char* block,
+                                     const uint8_t* alphabet_low,
+                                     const uint8_t* alphabet_high ) noexcept
+{
+    BlockMasks m;
+    std::memset( &m, 0, sizeof( m ) );
+    for( unsigned i = 0; i < BLOCK_SIZE; ++i ) {
+        uint8_t c  = block[i];
+        bool upper = c >= 'A' && c <= 'Z';
+        c |= upper ? 0x20 : 0;
+        block[i] = c;
+
+        bool digit   = c >= '0' && c <= '9';
+        bool letter  = c >= 'a' && c <= 'z';
+        bool vowel   = vowels_low[c & 0x0F] & vowels_high[c >> 4];
+        bool known   = alphabet_low[c & 0x0F] & alphabet_high[c >> 4];
+        uint64_t bit = uint64_t( 1 ) << i;
+
+        m.uppercase |= upper ? bit : 0;
+        m.digits |= digit ? bit : 0;
+        m.hex |= digit || ( c >= 'a' && c <= 'f' ) ? bit : 0;
+        m.hyphens |= c == '-' ? bit : 0;
+        m.dots |= c == '.' ? bit : 0;
+        m.consonants |= letter && not vowel ? bit : 0;
+        m.known |= known ? bit : 0;
+    }
+    return m;
+}
+
+#ifdef QNAME_CANONICALIZER_X86
+
+// Check if unsigned characters are in range [low, high], using signed comparison
+__attribute__( ( target( "avx2" ) ) ) static inline __m256i
+in_range_avx2( __m256i c, int low, int high )
+{
+    __m256i shifted = _mm256_sub_epi8( c, _mm256_set1_epi8( char( low - 128 ) ) );
+    return _mm256_cmpgt_epi8( _mm256_set1_epi8( char( high - low - 127 ) ), shifted );
+}
+
+// Look characters up in pair of nibble tables
+__attribute__( ( target( "avx2" ) ) ) static inline __m256i
+lookup_avx2( __m256i c, const uint8_t* low, const uint8_t* high )
+{
+    const __m256i nibble = _mm256_set1_epi8( 0x0F );
+    __m256i low_table =
+      _mm256_broadcastsi128_si256( _mm_load_si128( reinterpret_cast<const __m128i*>( low ) ) );
+    __m256i high_table =
+      _mm256_broadcastsi128_si256( _mm_load_si128( reinterpret_cast<const __m128i*>( high ) ) );
+    __m256i bits = _mm256_and_si256(
+      _mm256_shuffle_epi8( low_table, _mm256_and_si256( c, nibble ) ),
+      _mm256_shuffle_epi8( high_table,
+                           _mm256_and_si256( _mm256_srli_epi16( c, 4 ), nibble ) ) );
+    return _mm256_xor_si256( _mm256_cmpeq_epi8( bits, _mm256_setzero_si256() ),
+                             _mm256_set1_epi8( -1 ) );
+}
+
+__attribute__( ( target( "avx2" ) ) ) static inline uint64_t mask_avx2( __m256i m )
+{
+    return uint32_t( _mm256_movemask_epi8( m ) );
+}
+
+__attribute__( ( target( "avx2" ) ) ) static BlockMasks scan_block_avx2(
+  char* block, const uint8_t* alphabet_low, const uint8_t* alphabet_high ) noexcept
+{
+    BlockMasks m;
+    const __m256i case_bit = _mm256_set1_epi8( 0x20 );
+    std::memset( &m, 0, sizeof( m ) );
+    for( unsigned i = 0; i < BLOCK_SIZE; i += 32 ) {
+        __m256i c     = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( block + i ) );
+        __m256i upper = in_range_avx2( c, 'A', 'Z' );
+        c             = _mm256_or_si256( c, _mm256_and_si256( upper, case_bit ) );
+        _mm256_storeu_si256( reinterpret_cast<__m256i*>( block + i ), c );
+
+        __m256i digit  = in_range_avx2( c, '0', '9' );
+        __m256i letter = in_range_avx2( c, 'a', 'z' );
+        __m256i vowel  = lookup_avx2( c, vowels_low, vowels_high );
+
+        m.uppercase |= mask_avx2( upper ) << i;
+        m.digits |= mask_avx2( digit ) << i;
+        m.hex |= mask_avx2( _mm256_or_si256( digit, in_range_avx2( c, 'a', 'f' ) ) ) << i;
+        m.hyphens |= mask_avx2( _mm256_cmpeq_epi8( c, _mm256_set1_epi8( '-' ) ) ) << i;
+        m.dots |= mask_avx2( _mm256_cmpeq_epi8( c, _mm256_set1_epi8( '.' ) ) ) << i;
+        m.consonants |= mask_avx2( _mm256_andnot_si256( vowel, letter ) ) << i;
+        m.known |= mask_avx2( lookup_avx2( c, alphabet_low, alphabet_high ) ) << i;
+    }
+    return m;
+}
+
+__attribute__( ( target( "ssse3" ) ) ) static inline __m128i
+in_range_ssse3( __m128i c, int low, int high )
+{
+    __m128i shifted = _mm_sub_epi8( c, _mm_set1_epi8( char( low - 128 ) ) );
+    return _mm_cmpgt_epi8( _mm_set1_epi8( char( high - low - 127 ) ), shifted );
+}
+
+__attribute__( ( target( "ssse3" ) ) ) static inline __m128i
+lookup_ssse3( __m128i c, const uint8_t* low, const uint8_t* high )
+{
+    const __m128i nibble = _mm_set1_epi8( 0x0F );
+    __m128i bits         = _mm_and_si128(
+      _mm_shuffle_epi8( _mm_load_si128( reinterpret_cast<const __m128i*>( low ) ),
+                        _mm_and_si128( c, nibble ) ),
+      _mm_shuffle_epi8( _mm_load_si128( reinterpret_cast<const __m128i*>( high ) ),
+                        _mm_and_si128( _mm_srli_epi16( c, 4 ), nibble ) ) );
+    return _mm_xor_si128( _mm_cmpeq_epi8( bits, _mm_setzero_si128() ), _mm_set1_epi8( -1 ) );
+}
+
+__attribute__( ( target( "ssse3" ) ) ) static inline uint64_t mask_ssse3( __m128i m )
+{
+    return uint32_t( _mm_movemask_epi8( m ) );
+}
+
+__attribute__( ( target( "ssse3" ) ) ) static BlockMasks scan_block_ssse3(
+  char* block, const uint8_t* alphabet_low, const uint8_t* alphabet_high ) noexcept
+{
+    BlockMasks m;
+    const __m128i case_bit = _mm_set1_epi8( 0x20 );
+    std::memset( &m, 0, sizeof( m ) );
+    for( unsigned i = 0; i < BLOCK_SIZE; i += 16 ) {
+        __m128i c     = _mm_loadu_si128( reinterpret_cast<const __m128i*>( block + i ) );
+        __m128i upper = in_range_ssse3( c, 'A', 'Z' );
+        c             = _mm_or_si128( c, _mm_and_si128( upper, case_bit ) );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( block + i ), c );
+
+        __m128i digit  = in_range_ssse3( c, '0', '9' );
+        __m128i letter = in_range_ssse3( c, 'a', 'z' );
+        __m128i vowel  = lookup_ssse3( c, vowels_low, vowels_high );
+
+        m.uppercase |= mask_ssse3( upper ) << i;
+        m.digits |= mask_ssse3( digit ) << i;
+        m.hex |= mask_ssse3( _mm_or_si128( digit, in_range_ssse3( c, 'a', 'f' ) ) ) << i;
+        m.hyphens |= mask_ssse3( _mm_cmpeq_epi8( c, _mm_set1_epi8( '-' ) ) ) << i;
+        m.dots |= mask_ssse3( _mm_cmpeq_epi8( c, _mm_set1_epi8( '.' ) ) ) << i;
+        m.consonants |= mask_ssse3( _mm_andnot_si128( vowel, letter ) ) << i;
+        m.known |= mask_ssse3( lookup_ssse3( c, alphabet_low, alphabet_high ) ) << i;
+    }
+    return m;
+}
+
+#endif // QNAME_CANONICALIZER_X86
+
+// Get the widest block scanner supported by the CPU
+static ScanBlock best_scan_block()
+{
+#ifdef QNAME_CANONICALIZER_X86
+    // May run before constructors which would initialize CPU model otherwise
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports( "avx2" ) ) {
+        return scan_block_avx2;
+    }
+    if( __builtin_cpu_supports( "ssse3" ) ) {
+        return scan_block_ssse3;
+    }
+#endif
+    return scan_block_scalar;
+}
+
+// Block scanner selected once, at program startup
+static const ScanBlock scan_block = best_scan_block();
+
+// Get length of the longest run of set bits
+static unsigned longest_run( uint64_t bits ) noexcept
+{
+    unsigned run = 0;
+    while( bits ) {
+        bits &= bits << 1;
+        ++run;
+    }
+    return run;
+}
+
+QnameCanonicalizer::QnameCanonicalizer()
+    : QnameCanonicalizer( "abcdefghijklmnopqrstuvwxyz0123456789-_." )
+{
+}
+
+QnameCanonicalizer::QnameCanonicalizer( std::string_view alphabet )
+{
+    std::memset( alphabet_low_, 0, sizeof( alphabet_low_ ) );
+    std::memset( alphabet_high_, 0, sizeof( alphabet_high_ ) );
+    // Characters with highest bit set are never in the alphabet
+    for( unsigned high = 0; high < 8; ++high ) {
+        alphabet_high_[high] = 1 << high;
+    }
+    for( unsigned char c: alphabet ) {
+        if( c < 0x80 ) {
+            alphabet_low_[c & 0x0F] |= 1 << ( c >> 4 );
+        }
+    }
+}
+
+QnameFeatures QnameCanonicalizer::canonicalize( const char* name,
+                                                unsigned length,
+                                                char* lowercase ) const noexcept
+{
+    QnameFeatures f;
+    std::memset( &f, 0, sizeof( f ) );
+    f.length = length;
+
+    unsigned label_start     = 0;        // Position of current label
+    unsigned dots[2]         = { 0, 0 }; // Positions of last two dots
+    unsigned dots_count      = 0;        // Number of dots
+    unsigned consonant_carry = 0;        // Consonants at the end of previous block
+
+    alignas( 32 ) char block[BLOCK_SIZE];
+    for( unsigned base = 0; base < length; base += BLOCK_SIZE ) {
+        unsigned n = std::min( BLOCK_SIZE, length - base );
+        std::memcpy( block, name + base, n );
+        std::memset( block + n, 0, BLOCK_SIZE - n );
+        BlockMasks m = scan_block( block, alphabet_low_, alphabet_high_ );
+        if( lowercase ) {
+            std::memcpy( lowercase + base, block, n );
+        }
+
+        uint64_t valid = n == BLOCK_SIZE ? ~uint64_t( 0 ) : ( uint64_t( 1 ) << n ) - 1;
+        f.uppercase += __builtin_popcountll( m.uppercase & valid );
+        f.digits += __builtin_popcountll( m.digits & valid );
+        f.hex += __builtin_popcountll( m.hex & valid );
+        f.hyphens += __builtin_popcountll( m.hyphens & valid );
+        f.unknown += __builtin_popcountll( ~m.known & valid );
+
+        // Label boundaries
+        for( uint64_t d = m.dots & valid; d; d &= d - 1 ) {
+            unsigned pos       = base + __builtin_ctzll( d );
+            f.max_label_length = std::max<unsigned>( f.max_label_length, pos - label_start );
+            label_start        = pos + 1;
+            dots[0]            = dots[1];
+            dots[1]            = pos;
+            ++dots_count;
+        }
+
+        // Consonant runs, including runs crossing block boundary
+        uint64_t c = m.consonants & valid;
+        if( c == ~uint64_t( 0 ) ) {
+            consonant_carry += BLOCK_SIZE;
+        } else {
+            unsigned leading = __builtin_ctzll( ~c );
+            unsigned run     = std::max( consonant_carry + leading, longest_run( c ) );
+            f.max_consonant_run = std::max<unsigned>( f.max_consonant_run, run );
+            consonant_carry     = __builtin_clzll( ~c );
+        }
+    }
+    f.max_consonant_run = std::max<unsigned>( f.max_consonant_run, consonant_carry );
+
+    if( length > 0 ) {
+        f.labels           = dots_count + 1;
+        f.max_label_length = std::max<unsigned>( f.max_label_length, length - label_start );
+    }
+    // Same as second-level domain of entropy classifier: dot at position 0 is not a boundary
+    if( dots_count >= 2 && dots[0] > 0 ) {
+        f.sld_offset = dots[0] + 1;
+    }
+    return f;
+}
+
+}} // namespace snort::dns_firewall
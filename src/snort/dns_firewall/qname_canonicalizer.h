@@ -0,0 +1,68 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#ifndef SNORT_DNS_FIREWALL_QNAME_CANONICALIZER_H
+#define SNORT_DNS_FIREWALL_QNAME_CANONICALIZER_H
+
+#include <cstdint>
+#include <string_view>
+
+namespace snort { namespace dns_firewall {
+
+// Features of question name, computed during canonicalization
+// and shared by all classifiers
+struct QnameFeatures
+{
+    uint16_t length;            // Name length
+    uint16_t labels;            // Number of labels
+    uint16_t max_label_length;  // Length of the longest label
+    uint16_t sld_offset;        // Offset of second-level domain, e.g. of google.com
+                                // in www.google.com, or 0 if there is no parent domain
+    uint16_t uppercase;         // Uppercase letters (0x20 randomization), now lowercased
+    uint16_t digits;            // Digits
+    uint16_t hex;               // Digits and letters a-f
+    uint16_t hyphens;           // Hyphens
+    uint16_t max_consonant_run; // Length of the longest run of consonants
+    uint16_t unknown;           // Characters outside of canonicalizer alphabet
+};
+
+// Canonicalizes question names in a single pass: lowercases letters,
+// counts characters outside of given alphabet, finds label boundaries
+// and computes character classes. Names are processed 64 characters at a time,
+// using AVX2 or SSSE3 when the CPU supports them, chosen at program startup.
+class QnameCanonicalizer
+{
+  private:
+    // Alphabet as a pair of nibble tables: character c belongs to the alphabet
+    // if alphabet_low_[c & 0xF] & alphabet_high_[c >> 4] is not zero.
+    // Every ASCII set may be stored this way, with one bit per high nibble
+    alignas( 16 ) uint8_t alphabet_low_[16];
+    alignas( 16 ) uint8_t alphabet_high_[16];
+
+  public:
+    // Create canonicalizer of host names: letters, digits, '-', '_' and '.'
+    QnameCanonicalizer();
+    // Create canonicalizer with given alphabet, e.g. of HMM classifier.
+    // Uppercase letters are accepted if their lowercase counterparts are
+    explicit QnameCanonicalizer( std::string_view alphabet );
+
+    // Compute features of given name and write its lowercase form to given buffer,
+    // which may be the name itself or nullptr
+    QnameFeatures canonicalize( const char* name, unsigned length, char* lowercase ) const
+      noexcept;
+};
+
+}} // namespace snort::dns_firewall
+
+#endif // SNORT_DNS_FIREWALL_QNAME_CANONICALIZER_H
@@ -14,13 +14,47 @@
 
 #include "config.h"
 #include "dns_classifier.h"
-#include "dns_packet.h"
+#include "dns_packet_view.h"
 #include "model.h"
+#include "pcap_reader.h"
+#include <deque>
+#include <iomanip>
+#include <vector>
 
 extern char* optarg;
 
 using namespace snort::dns_firewall;
 
+// Number of lines classified together
+static const unsigned BATCH_SIZE = 256;
+
+// Classify batch of lines and write results to output file,
+// preceded by capture timestamps of lines, if there are any
+static void classify_batch( DnsClassifier& cls,
+                            const std::vector<std::string>& lines,
+                            const std::vector<uint64_t>& timestamps,
+                            std::ofstream& output_file )
+{
+    std::deque<DnsPacketView> views;
+    std::vector<const DnsPacketView*> messages;
+    for( auto& line: lines ) {
+        views.emplace_back( line, cls.get_canonicalizer() );
+        messages.push_back( &views.back() );
+    }
+
+    std::vector<Classification> results( lines.size() );
+    cls.classify( messages.data(), messages.size(), results.data() );
+    for( std::size_t i = 0; i < results.size(); ++i ) {
+        const Classification& result = results[i];
+        if( not timestamps.empty() ) {
+            output_file << timestamps[i] / 1000000000 << "." << std::setw( 9 )
+                        << std::setfill( '0' ) << timestamps[i] % 1000000000 << ";";
+        }
+        output_file << result.domain << ";" << result.score1 << ";" << result.score2 << ";"
+                    << result.score << std::endl;
+    }
+}
+
 // ----------------
 // ENTRYPOINT
 // ----------------
@@ -32,7 +66,7 @@ int main( int argc, char* const argv[] )
       "   -c: YAML config file name (mandatory)\n\n"
       "       If -f, -n, -m, -o option is specified, configuration\n"
       "       from YAML file is overwritten.\n\n"
-      "   -f: File name of the test dataset to process\n"
+      "   -f: File name of the test dataset to process: text or pcap\n"
       "   -n: max number of lines to process\n"
       "   -m: Model file name\n"
       "   -o: Output file name\n"
@@ -82,6 +116,9 @@ int main( int argc, char* const argv[] )
     }
     // Turn off timeframe classifier
     options.timeframe.enabled = false;
+    // Report exact HMM scores, bounds of early exit and beam pruning are not comparable
+    options.hmm.early_exit = false;
+    options.hmm.beam_width = 0;
 
     // Load model
     Model model;
@@ -97,27 +134,28 @@ int main( int argc, char* const argv[] )
     std::ofstream output_file( output_filename_getopt );
     std::string line;
     unsigned processed_lines = 0;
-    unsigned skipped_lines   = 0;
     std::cout.imbue( std::locale( "" ) );
 
-    output_file << "DOMAIN;HMM;ENTROPY;TOTAL" << std::endl;
+    std::vector<std::string> batch;
+    std::vector<uint64_t> timestamps;
 
-    while( getline( dataset_file, line ) ) {
-        if( line.empty() ) {
-            continue;
-        }
+    bool capture = PcapReader::is_capture( dataset_filename_getopt );
+
+    // Classify given line, captured at given time if dataset is a capture.
+    // Returns false if max number of lines is processed
+    auto process_line = [&]( std::string_view line, uint64_t timestamp ) {
         if( max_lines_getopt > 0 && processed_lines >= (unsigned) max_lines_getopt ) {
-            break;
+            return false;
         }
-        if( processed_lines % 1 == 0 && line.size() >= options.hmm.min_length ) {
-            try {
-                auto result = cls.classify( DnsPacket( line ) );
-                output_file << result.domain << ";" << result.score1 << ";" << result.score2
-                            << ";" << result.score << std::endl;
-            } catch( ... ) {
-                std::cout << "CATCH: " << line << std::endl;
-                ++skipped_lines;
-                continue;
+        if( line.size() >= options.hmm.min_length ) {
+            batch.emplace_back( line );
+            if( capture ) {
+                timestamps.push_back( timestamp );
+            }
+            if( batch.size() == BATCH_SIZE ) {
+                classify_batch( cls, batch, timestamps, output_file );
+                batch.clear();
+                timestamps.clear();
             }
         }
         ++processed_lines;
@@ -125,11 +163,53 @@ int main( int argc, char* const argv[] )
         if( processed_lines % 1024 == 0 ) {
             std::cout << "\rProcessed lines: " << processed_lines << "    " << std::flush;
         }
+        return true;
+    };
+
+    if( capture ) {
+        // Question names of captured queries, with their timestamps
+        output_file << "TIME;DOMAIN;HMM;ENTROPY;TOTAL" << std::endl;
+        PcapReader capture( dataset_filename_getopt );
+        capture.read_messages( [&]( uint64_t timestamp, const uint8_t* data, unsigned size ) {
+            DnsPacketView message( data, size, cls.get_canonicalizer() );
+            // Responses repeat questions of their queries
+            if( message.malformed || ( message.flags & DnsPacketView::FLAG_RESPONSE ) ) {
+                return true;
+            }
+            for( auto& question: message ) {
+                if( not process_line( question.qname, timestamp ) ) {
+                    return false;
+                }
+            }
+            return true;
+        } );
+    } else {
+        output_file << "DOMAIN;HMM;ENTROPY;TOTAL" << std::endl;
+        while( getline( dataset_file, line ) ) {
+            if( line.empty() ) {
+                continue;
+            }
+            if( not process_line( line, 0 ) ) {
+                break;
+            }
+        }
     }
 
+    classify_batch( cls, batch, timestamps, output_file );
+
     std::cout << "\rTest results saved to " << output_filename_getopt << "!" << std::endl;
     std::cout << "Processed lines: " << processed_lines << std::endl;
-    std::cout << "Skipped lines: " << skipped_lines << std::endl;
+    // Questions are classified by this thread only
+    const DnsClassifier::Statistics stats = DnsClassifier::take_statistics();
+    if( options.prefilter.enabled ) {
+        std::cout << "Prefilter hits: " << stats.prefilter_hits << "/"
+                  << stats.prefilter_queries << std::endl;
+        std::cout << "Prefilter false positives: " << stats.prefilter_false_positives
+                  << std::endl;
+    }
+    if( options.hmm.early_exit ) {
+        std::cout << "HMM early exits: " << stats.hmm_early_exits << std::endl;
+    }
 
     return 0;
 }
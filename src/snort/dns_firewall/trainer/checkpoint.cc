@@ -0,0 +1,185 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#include "checkpoint.h"
+#include <cereal/archives/binary.hpp>
+#include <cereal/types/string.hpp>
+#include <cereal/types/unordered_map.hpp>
+#include <cereal/types/vector.hpp>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace snort { namespace dns_firewall { namespace trainer {
+
+namespace {
+
+// Make sure data of given file reached the disk
+void sync_file( const std::string& filename )
+{
+    int file = open( filename.c_str(), O_RDONLY );
+    if( file < 0 || fsync( file ) != 0 ) {
+        if( file >= 0 ) {
+            close( file );
+        }
+        throw std::invalid_argument( "Could not sync checkpoint file " + filename );
+    }
+    close( file );
+}
+
+} // namespace
+
+Checkpoint::Checkpoint()
+    : position{ 0, 0 }
+    , processed_lines( 0 )
+    , skipped_lines( 0 )
+    , learned_lines( 0 )
+{
+}
+
+template<class Archive>
+void Checkpoint::save( Archive& archive ) const
+{
+    archive( dataset,
+             position.offset,
+             position.lines,
+             processed_lines,
+             skipped_lines,
+             learned_lines,
+             hmm,
+             domain_lengths,
+             last_batch );
+    // Entropy classifiers can not be default constructed by vector serialization
+    uint64_t size = fifos.size();
+    archive( size );
+    for( auto& f: fifos ) {
+        archive( f );
+    }
+}
+
+template<class Archive>
+void Checkpoint::load( Archive& archive )
+{
+    archive( dataset,
+             position.offset,
+             position.lines,
+             processed_lines,
+             skipped_lines,
+             learned_lines,
+             hmm,
+             domain_lengths,
+             last_batch );
+    uint64_t size;
+    archive( size );
+    fifos.assign( size, entropy::DnsClassifier( 0, 0 ) );
+    for( auto& f: fifos ) {
+        archive( f );
+    }
+}
+
+void Checkpoint::save_to_file( const std::string& filename ) const
+{
+    std::string temporary = filename + ".tmp";
+    {
+        std::ofstream fs( temporary, std::ios::binary );
+        cereal::BinaryOutputArchive oarchive( fs );
+        oarchive( *this );
+        fs.close();
+        if( not fs ) {
+            throw std::invalid_argument( "Could not write checkpoint file " + temporary );
+        }
+    }
+    // Data must reach the disk before rename, otherwise a crash could leave
+    // the new name pointing to incomplete file
+    sync_file( temporary );
+    if( std::rename( temporary.c_str(), filename.c_str() ) != 0 ) {
+        throw std::invalid_argument( "Could not rename checkpoint file to " + filename );
+    }
+}
+
+void Checkpoint::load_from_file( const std::string& filename )
+{
+    std::ifstream fs( filename, std::ios::binary );
+    if( not fs ) {
+        throw std::invalid_argument( "Could not open checkpoint file " + filename );
+    }
+    cereal::BinaryInputArchive iarchive( fs );
+    iarchive( *this );
+    fs.close();
+}
+
+CheckpointWriter::CheckpointWriter( const std::string& filename )
+    : filename_( filename )
+    , busy_( false )
+    , stopped_( false )
+{
+    writer_ = std::thread( &CheckpointWriter::run, this );
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        stopped_ = true;
+    }
+    condition_.notify_all();
+    writer_.join();
+}
+
+void CheckpointWriter::run()
+{
+    std::unique_lock<std::mutex> lock( mutex_ );
+    while( true ) {
+        condition_.wait( lock, [&]() { return stopped_ || pending_; } );
+        // Pending checkpoint is written even if stopped
+        if( not pending_ ) {
+            return;
+        }
+        std::unique_ptr<Checkpoint> checkpoint = std::move( pending_ );
+        lock.unlock();
+        try {
+            checkpoint->save_to_file( filename_ );
+        } catch( const std::exception& e ) {
+            std::cout << std::endl << "Could not save checkpoint: " << e.what() << std::endl;
+        }
+        checkpoint.reset();
+        lock.lock();
+        busy_ = false;
+    }
+}
+
+bool CheckpointWriter::busy()
+{
+    std::lock_guard<std::mutex> lock( mutex_ );
+    return busy_;
+}
+
+bool CheckpointWriter::write( std::unique_ptr<Checkpoint> checkpoint )
+{
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        if( busy_ ) {
+            return false;
+        }
+        pending_ = std::move( checkpoint );
+        busy_    = true;
+    }
+    condition_.notify_all();
+    return true;
+}
+
+}}} // namespace snort::dns_firewall::trainer
@@ -0,0 +1,91 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#ifndef SNORT_DNS_FIREWALL_TRAINER_CHECKPOINT_H
+#define SNORT_DNS_FIREWALL_TRAINER_CHECKPOINT_H
+
+#include "entropy/dns_classifier.h"
+#include "smart_hmm.h"
+#include "trainer/dataset_reader.h"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace snort { namespace dns_firewall { namespace trainer {
+
+// Learning state of training run after some lines of dataset, from which
+// the run may be resumed, e.g. after a crash.
+struct Checkpoint
+{
+    std::string dataset;              // Dataset file name
+    DatasetReader::Position position; // Position in dataset after learned lines
+    unsigned long processed_lines;
+    unsigned long skipped_lines;
+    unsigned long learned_lines; // Lines learned by HMM
+    scientific::ml::Hmm<char, std::string> hmm;
+    std::vector<entropy::DnsClassifier> fifos;
+    std::unordered_map<unsigned, unsigned> domain_lengths;
+    std::vector<std::string> last_batch; // Ring of domains learned last by HMM
+
+    Checkpoint();
+
+    template<class Archive>
+    void save( Archive& ) const;
+    template<class Archive>
+    void load( Archive& );
+
+    // Save checkpoint to temporary file, which atomically replaces given one,
+    // so that the previous checkpoint is kept, if saving fails
+    void save_to_file( const std::string& filename ) const;
+    void load_from_file( const std::string& filename );
+};
+
+// Writer of checkpoints in background thread, so that learning is not stalled
+// by serialization and disk I/O. Only one checkpoint is written at a time,
+// and errors are printed, but do not stop learning.
+class CheckpointWriter
+{
+  private:
+    std::string filename_;
+    std::unique_ptr<Checkpoint> pending_; // Checkpoint to be written
+    bool busy_;                           // Checkpoint is pending or being written
+    bool stopped_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::thread writer_;
+
+    // Writer thread main loop
+    void run();
+
+  public:
+    explicit CheckpointWriter( const std::string& filename );
+    CheckpointWriter( const CheckpointWriter& ) = delete;
+    CheckpointWriter& operator=( const CheckpointWriter& ) = delete;
+    // Waits for the checkpoint being written
+    ~CheckpointWriter();
+
+    // Check if the last checkpoint is still being written
+    bool busy();
+    // Write given checkpoint in background. Returns false without waiting,
+    // and drops the checkpoint, if the previous one is still being written
+    bool write( std::unique_ptr<Checkpoint> );
+};
+
+}}} // namespace snort::dns_firewall::trainer
+
+#endif // SNORT_DNS_FIREWALL_TRAINER_CHECKPOINT_H
@@ -17,6 +17,19 @@
 
 namespace snort { namespace dns_firewall { namespace trainer {
 
+std::ostream& operator<<( std::ostream& os, const Config::Algorithm& algorithm )
+{
+    switch( algorithm ) {
+    case Config::Algorithm::VITERBI:
+        os << "viterbi";
+        break;
+    case Config::Algorithm::BAUM_WELCH:
+        os << "baum-welch";
+        break;
+    }
+    return os;
+}
+
 bool Config::DatasetConfig::operator==( const Config::DatasetConfig& operand2 ) const
 {
     return filename == operand2.filename && max_lines == operand2.max_lines;
@@ -61,16 +74,89 @@ std::ostream& operator<<( std::ostream& os, const Config::EntropyConfig& entropy
 
 bool Config::HmmConfig::operator==( const Config::HmmConfig& operand2 ) const
 {
-    return min_length == operand2.min_length && hidden_states == operand2.hidden_states &&
-           learning_rate == operand2.learning_rate && batch_size == operand2.batch_size;
+    return algorithm == operand2.algorithm && min_length == operand2.min_length &&
+           hidden_states == operand2.hidden_states && seed == operand2.seed &&
+           learning_rate == operand2.learning_rate &&
+           batch_size == operand2.batch_size && prune_epsilon == operand2.prune_epsilon &&
+           threads == operand2.threads && deterministic == operand2.deterministic &&
+           epochs == operand2.epochs &&
+           tolerance == operand2.tolerance && pseudo_count == operand2.pseudo_count &&
+           deduplicate == operand2.deduplicate &&
+           dedup_max_domains == operand2.dedup_max_domains &&
+           dedup_directory == operand2.dedup_directory;
 }
 
 std::ostream& operator<<( std::ostream& os, const Config::HmmConfig& hmm )
 {
+    os << "   * algorithm: " << hmm.algorithm << std::endl;
     os << "   * min length: " << hmm.min_length << std::endl;
     os << "   * hidden states: " << hmm.hidden_states << std::endl;
+    os << "   * seed: " << hmm.seed << std::endl;
     os << "   * learning rate: " << hmm.learning_rate << std::endl;
-    os << "   * batch size: " << hmm.batch_size;
+    os << "   * batch size: " << hmm.batch_size << std::endl;
+    os << "   * prune epsilon: " << hmm.prune_epsilon << std::endl;
+    os << "   * threads: " << hmm.threads << std::endl;
+    os << "   * deterministic: " << ( hmm.deterministic ? "true" : "false" ) << std::endl;
+    os << "   * epochs: " << hmm.epochs << std::endl;
+    os << "   * tolerance: " << hmm.tolerance << std::endl;
+    os << "   * pseudo count: " << hmm.pseudo_count << std::endl;
+    os << "   * deduplicate: " << ( hmm.deduplicate ? "true" : "false" ) << std::endl;
+    os << "   * dedup max domains: " << hmm.dedup_max_domains << std::endl;
+    os << "   * dedup directory: " << hmm.dedup_directory;
+    return os;
+}
+
+bool Config::SweepConfig::operator==( const Config::SweepConfig& operand2 ) const
+{
+    return enabled == operand2.enabled && hidden_states == operand2.hidden_states &&
+           learning_rates == operand2.learning_rates && bins == operand2.bins &&
+           window_widths == operand2.window_widths &&
+           holdout_every == operand2.holdout_every &&
+           holdout_lines == operand2.holdout_lines && threads == operand2.threads;
+}
+
+std::ostream& operator<<( std::ostream& os, const Config::SweepConfig& sweep )
+{
+    os << "   * enabled: " << ( sweep.enabled ? "true" : "false" ) << std::endl;
+    os << "   * hidden states: ";
+    for( auto& s: sweep.hidden_states ) {
+        os << s << " ";
+    }
+    os << std::endl;
+    os << "   * learning rates: ";
+    for( auto& r: sweep.learning_rates ) {
+        os << r << " ";
+    }
+    os << std::endl;
+    os << "   * distribution bins: ";
+    for( auto& b: sweep.bins ) {
+        os << b << " ";
+    }
+    os << std::endl;
+    os << "   * window widths: ";
+    for( auto& widths: sweep.window_widths ) {
+        os << "[ ";
+        for( auto& w: widths ) {
+            os << w << " ";
+        }
+        os << "] ";
+    }
+    os << std::endl;
+    os << "   * holdout every: " << sweep.holdout_every << std::endl;
+    os << "   * holdout lines: " << sweep.holdout_lines << std::endl;
+    os << "   * threads: " << sweep.threads;
+    return os;
+}
+
+bool Config::CheckpointConfig::operator==( const Config::CheckpointConfig& operand2 ) const
+{
+    return file == operand2.file && interval == operand2.interval;
+}
+
+std::ostream& operator<<( std::ostream& os, const Config::CheckpointConfig& checkpoint )
+{
+    os << "   * file: " << checkpoint.file << std::endl;
+    os << "   * interval: " << checkpoint.interval;
     return os;
 }
 
@@ -78,7 +164,8 @@ bool Config::operator==( const Config& operand2 ) const
 {
     return dataset == operand2.dataset && model_file == operand2.model_file &&
            max_length == operand2.max_length && hmm == operand2.hmm &&
-           entropy == operand2.entropy;
+           entropy == operand2.entropy && sweep == operand2.sweep &&
+           checkpoint == operand2.checkpoint;
 }
 
 Config::Config( const std::string& config_filename )
@@ -93,10 +180,26 @@ Config::Config( const std::string& config_filename )
     max_length.percentile = node["trainer"]["max-length"]["percentile"].as<double>();
     max_length.penalty    = node["trainer"]["max-length"]["penalty"].as<double>();
 
-    hmm.min_length    = node["trainer"]["hmm"]["min-length"].as<int>();
-    hmm.hidden_states = node["trainer"]["hmm"]["hidden-states"].as<int>();
-    hmm.learning_rate = node["trainer"]["hmm"]["learning-rate"].as<double>();
-    hmm.batch_size    = node["trainer"]["hmm"]["batch-size"].as<int>();
+    if( node["trainer"]["hmm"]["algorithm"].as<std::string>() == "viterbi" ) {
+        hmm.algorithm = Config::Algorithm::VITERBI;
+    }
+    if( node["trainer"]["hmm"]["algorithm"].as<std::string>() == "baum-welch" ) {
+        hmm.algorithm = Config::Algorithm::BAUM_WELCH;
+    }
+    hmm.min_length        = node["trainer"]["hmm"]["min-length"].as<int>();
+    hmm.hidden_states     = node["trainer"]["hmm"]["hidden-states"].as<int>();
+    hmm.seed              = node["trainer"]["hmm"]["seed"].as<unsigned>();
+    hmm.learning_rate     = node["trainer"]["hmm"]["learning-rate"].as<double>();
+    hmm.batch_size        = node["trainer"]["hmm"]["batch-size"].as<int>();
+    hmm.prune_epsilon     = node["trainer"]["hmm"]["prune-epsilon"].as<double>();
+    hmm.threads           = node["trainer"]["hmm"]["threads"].as<int>();
+    hmm.deterministic     = node["trainer"]["hmm"]["deterministic"].as<bool>();
+    hmm.epochs            = node["trainer"]["hmm"]["epochs"].as<int>();
+    hmm.tolerance         = node["trainer"]["hmm"]["tolerance"].as<double>();
+    hmm.pseudo_count      = node["trainer"]["hmm"]["pseudo-count"].as<double>();
+    hmm.deduplicate       = node["trainer"]["hmm"]["deduplicate"].as<bool>();
+    hmm.dedup_max_domains = node["trainer"]["hmm"]["dedup-max-domains"].as<int>();
+    hmm.dedup_directory   = node["trainer"]["hmm"]["dedup-directory"].as<std::string>();
 
     entropy.min_length    = node["trainer"]["entropy"]["min-length"].as<int>();
     entropy.bins          = node["trainer"]["entropy"]["bins"].as<int>();
@@ -112,6 +215,30 @@ Config::Config( const std::string& config_filename )
     for( auto&& w: win_widths ) {
         entropy.window_widths.push_back( w.as<int>() );
     }
+
+    YAML::Node sweep_node = node["trainer"]["sweep"];
+    sweep.enabled         = sweep_node["enabled"].as<bool>();
+    for( auto&& s: sweep_node["hidden-states"] ) {
+        sweep.hidden_states.push_back( s.as<int>() );
+    }
+    for( auto&& r: sweep_node["learning-rate"] ) {
+        sweep.learning_rates.push_back( r.as<double>() );
+    }
+    for( auto&& b: sweep_node["bins"] ) {
+        sweep.bins.push_back( b.as<int>() );
+    }
+    for( auto&& widths: sweep_node["window-widths"] ) {
+        sweep.window_widths.emplace_back();
+        for( auto&& w: widths ) {
+            sweep.window_widths.back().push_back( w.as<int>() );
+        }
+    }
+    sweep.holdout_every = sweep_node["holdout-every"].as<int>();
+    sweep.holdout_lines = sweep_node["holdout-lines"].as<int>();
+    sweep.threads       = sweep_node["threads"].as<int>();
+
+    checkpoint.file     = node["trainer"]["checkpoint"]["file"].as<std::string>();
+    checkpoint.interval = node["trainer"]["checkpoint"]["interval"].as<int>();
 }
 
 std::ostream& operator<<( std::ostream& os, const Config& options )
@@ -124,7 +251,11 @@ std::ostream& operator<<( std::ostream& os, const Config& options )
     os << " - Entropy classifier: " << std::endl;
     os << options.entropy << std::endl;
     os << " - HMM classifier: " << std::endl;
-    os << options.hmm;
+    os << options.hmm << std::endl;
+    os << " - Hyperparameter sweep: " << std::endl;
+    os << options.sweep << std::endl;
+    os << " - Checkpoints: " << std::endl;
+    os << options.checkpoint;
     return os;
 }
 
@@ -23,6 +23,11 @@ namespace snort { namespace dns_firewall { namespace trainer {
 
 struct Config
 {
+    enum Algorithm
+    {
+        VITERBI,
+        BAUM_WELCH
+    };
     struct DatasetConfig
     {
         std::string filename;
@@ -39,10 +44,22 @@ struct Config
     };
     struct HmmConfig
     {
+        Algorithm algorithm;
         unsigned min_length;
         unsigned hidden_states;
+        unsigned seed; // Seed of random starting HMM, the same for all shards of dataset
         double learning_rate;
         unsigned batch_size;
+        double prune_epsilon; // Transitions less probable are pruned, 0 disables pruning
+        unsigned threads;     // Threads finding Viterbi paths, 0 for all cores
+        bool deterministic;   // Learned model does not depend on number of threads
+        unsigned epochs;      // Maximum number of Baum-Welch passes over dataset
+        double tolerance;     // Baum-Welch stops when log10 probability per character
+                              // grows less than that in a pass
+        double pseudo_count;  // Added to Baum-Welch expected counts
+        bool deduplicate;     // Learn every unique domain once, weighted with its count
+        unsigned dedup_max_domains;  // Unique domains counted in memory, before spilling
+        std::string dedup_directory; // Directory of spilled counts
         bool operator==( const HmmConfig& ) const;
         friend std::ostream& operator<<( std::ostream&, const HmmConfig& );
     };
@@ -56,17 +73,43 @@ struct Config
         friend std::ostream& operator<<( std::ostream&, const EntropyConfig& );
     };
 
+    struct SweepConfig
+    {
+        bool enabled;
+        std::vector<unsigned> hidden_states;
+        std::vector<double> learning_rates;
+        std::vector<unsigned> bins;
+        std::vector<std::vector<unsigned>> window_widths;
+        unsigned holdout_every; // Every such line is held out from learning, 0 for none
+        unsigned holdout_lines; // Held out lines at most
+        unsigned threads;       // Threads learning models, 0 for all cores
+        bool operator==( const SweepConfig& ) const;
+        friend std::ostream& operator<<( std::ostream&, const SweepConfig& );
+    };
+
+    struct CheckpointConfig
+    {
+        std::string file;  // Checkpoint file, replaced by every checkpoint
+        unsigned interval; // Seconds between checkpoints, 0 disables them
+        bool operator==( const CheckpointConfig& ) const;
+        friend std::ostream& operator<<( std::ostream&, const CheckpointConfig& );
+    };
+
     DatasetConfig dataset;
     std::string model_file;
     MaxLengthConfig max_length;
     HmmConfig hmm;
     EntropyConfig entropy;
+    SweepConfig sweep;
+    CheckpointConfig checkpoint;
 
     explicit Config( const std::string& );
     bool operator==( const Config& ) const;
     friend std::ostream& operator<<( std::ostream&, const Config& );
 };
 
+std::ostream& operator<<( std::ostream&, const Config::Algorithm& );
+
 }}} // namespace snort::dns_firewall::trainer
 
 #endif // SNORT_DNS_FIREWALL_TRAINER_CONFIG_H
@@ -0,0 +1,292 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#include "dataset_reader.h"
+#include "dns_packet_view.h"
+#include "pcap_reader.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <stdexcept>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace snort { namespace dns_firewall { namespace trainer {
+
+namespace {
+
+// Size of chunks read from file and decompressed at once
+constexpr std::size_t CHUNK_SIZE = 1 << 20;
+
+// Gzip decompressor, accepting many concatenated gzip members
+class Inflater
+{
+  private:
+    z_stream stream_;
+
+  public:
+    Inflater()
+    {
+        std::memset( &stream_, 0, sizeof( stream_ ) );
+        // Window bits increased by 16 select gzip format
+        if( inflateInit2( &stream_, 16 + MAX_WBITS ) != Z_OK ) {
+            throw std::invalid_argument( "Could not initialize gzip decompression" );
+        }
+    }
+    Inflater( const Inflater& ) = delete;
+    Inflater& operator=( const Inflater& ) = delete;
+    ~Inflater()
+    {
+        inflateEnd( &stream_ );
+    }
+
+    // Decompress given input, passing decompressed data to given consumer
+    // until it returns false. Returns false if consumer did so
+    template<class Consumer>
+    bool
+    inflate( unsigned char* input, std::size_t size, unsigned char* output, Consumer consume )
+    {
+        stream_.next_in  = input;
+        stream_.avail_in = size;
+        do {
+            stream_.next_out  = output;
+            stream_.avail_out = CHUNK_SIZE;
+            int status        = ::inflate( &stream_, Z_NO_FLUSH );
+            if( status == Z_STREAM_END ) {
+                inflateReset( &stream_ );
+            } else if( status != Z_OK && status != Z_BUF_ERROR ) {
+                throw std::invalid_argument( "Corrupted gzip data" );
+            }
+            if( not consume( reinterpret_cast<const char*>( output ),
+                             CHUNK_SIZE - stream_.avail_out ) ) {
+                return false;
+            }
+        } while( stream_.avail_in > 0 || stream_.avail_out == 0 );
+        return true;
+    }
+
+    // Check if the last gzip member is complete
+    bool finished() const
+    {
+        return stream_.total_in == 0;
+    }
+};
+
+} // namespace
+
+DatasetReader::DatasetReader( const std::string& filename,
+                              const Position& start,
+                              std::size_t batch_lines,
+                              std::size_t queue_batches )
+    : filename_( filename )
+    , file_( open( filename.c_str(), O_RDONLY ) )
+    , capture_( PcapReader::is_capture( filename ) )
+    , batch_lines_( std::max<std::size_t>( batch_lines, 1 ) )
+    , queue_batches_( std::max<std::size_t>( queue_batches, 1 ) )
+    , start_( start )
+    , position_( start )
+    , finished_( false )
+    , stopped_( false )
+{
+    if( file_ < 0 ) {
+        throw std::invalid_argument( "Could not open dataset file " + filename );
+    }
+    reader_ = std::thread( &DatasetReader::run, this );
+}
+
+DatasetReader::~DatasetReader()
+{
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        stopped_ = true;
+    }
+    queue_condition_.notify_all();
+    reader_.join();
+    close( file_ );
+}
+
+void DatasetReader::run()
+{
+    try {
+        if( capture_ ) {
+            read_capture();
+        } else {
+            read_batches();
+        }
+    } catch( ... ) {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        error_ = std::current_exception();
+    }
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        finished_ = true;
+    }
+    queue_condition_.notify_all();
+}
+
+void DatasetReader::read_batches()
+{
+    std::vector<unsigned char> input( CHUNK_SIZE );
+    std::vector<unsigned char> output( CHUNK_SIZE );
+    std::unique_ptr<Inflater> inflater;
+    Batch batch;
+    std::string partial;               // Line not terminated yet
+    uint64_t skip     = start_.offset; // Text before the first line read, not skipped yet
+    Position position = start_;        // Position after the last line split
+
+    // Split data into lines, putting full batches into the queue
+    auto split = [&]( const char* data, std::size_t size ) {
+        // Drop text before the first line read
+        std::size_t skipped = std::min<uint64_t>( skip, size );
+        skip -= skipped;
+        data += skipped;
+        const char* end = data + size - skipped;
+        while( data < end ) {
+            auto eol = static_cast<const char*>( std::memchr( data, '\n', end - data ) );
+            if( eol == nullptr ) {
+                partial.append( data, end );
+                break;
+            }
+            partial.append( data, eol );
+            position.offset += partial.size() + 1;
+            ++position.lines;
+            batch.push_back( std::move( partial ) );
+            partial.clear();
+            data = eol + 1;
+            if( batch.size() == batch_lines_ && not put( batch, position ) ) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    bool first = true;
+    while( true ) {
+        ssize_t size = ::read( file_, input.data(), input.size() );
+        if( size < 0 && errno == EINTR ) {
+            continue;
+        }
+        if( size < 0 ) {
+            throw std::invalid_argument( "Could not read dataset file " + filename_ );
+        }
+        if( size == 0 ) {
+            break;
+        }
+        // Gzip files are recognized by their magic number
+        if( first && size >= 2 && input[0] == 0x1f && input[1] == 0x8b ) {
+            inflater.reset( new Inflater() );
+        }
+        first = false;
+        // Text is skipped by seeking, unless it is compressed or not seekable, like pipe
+        if( not inflater && skip > 0 && lseek( file_, skip, SEEK_SET ) >= 0 ) {
+            skip = 0;
+            continue;
+        }
+        bool running = inflater ? inflater->inflate( input.data(), size, output.data(), split )
+                                : split( reinterpret_cast<const char*>( input.data() ), size );
+        if( not running ) {
+            return;
+        }
+    }
+    if( inflater && not inflater->finished() ) {
+        throw std::invalid_argument( "Truncated gzip dataset file " + filename_ );
+    }
+
+    // Last line may be not terminated
+    if( not partial.empty() ) {
+        position.offset += partial.size();
+        ++position.lines;
+        batch.push_back( std::move( partial ) );
+    }
+    if( not batch.empty() ) {
+        put( batch, position );
+    }
+}
+
+void DatasetReader::read_capture()
+{
+    PcapReader capture( filename_ );
+    QnameCanonicalizer canonicalizer;
+    Batch batch;
+    uint64_t skip     = start_.lines; // Lines before the first line read, not skipped yet
+    Position position = start_;       // Position after the last line
+    capture.read_messages( [&]( uint64_t, const uint8_t* data, unsigned size ) {
+        DnsPacketView message( data, size, canonicalizer );
+        // Responses repeat questions of their queries
+        if( message.malformed || ( message.flags & DnsPacketView::FLAG_RESPONSE ) ) {
+            return true;
+        }
+        for( auto& question: message ) {
+            if( skip > 0 ) {
+                --skip;
+                continue;
+            }
+            batch.emplace_back( question.qname );
+            ++position.lines;
+            if( batch.size() == batch_lines_ && not put( batch, position ) ) {
+                return false;
+            }
+        }
+        return true;
+    } );
+    if( not batch.empty() ) {
+        put( batch, position );
+    }
+}
+
+bool DatasetReader::put( Batch& batch, const Position& position )
+{
+    std::unique_lock<std::mutex> lock( mutex_ );
+    queue_condition_.wait(
+      lock, [&]() { return stopped_ || queue_.size() < queue_batches_; } );
+    if( stopped_ ) {
+        return false;
+    }
+    queue_.emplace_back( std::move( batch ), position );
+    lock.unlock();
+    queue_condition_.notify_all();
+    batch = Batch();
+    batch.reserve( batch_lines_ );
+    return true;
+}
+
+bool DatasetReader::next( Batch& batch )
+{
+    std::unique_lock<std::mutex> lock( mutex_ );
+    queue_condition_.wait( lock, [&]() { return finished_ || not queue_.empty(); } );
+    if( queue_.empty() ) {
+        if( error_ ) {
+            std::exception_ptr error = error_;
+            error_                   = nullptr;
+            std::rethrow_exception( error );
+        }
+        return false;
+    }
+    batch     = std::move( queue_.front().first );
+    position_ = queue_.front().second;
+    queue_.pop_front();
+    lock.unlock();
+    queue_condition_.notify_all();
+    return true;
+}
+
+DatasetReader::Position DatasetReader::position()
+{
+    std::lock_guard<std::mutex> lock( mutex_ );
+    return position_;
+}
+
+}}} // namespace snort::dns_firewall::trainer
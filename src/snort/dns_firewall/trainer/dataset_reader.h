@@ -0,0 +1,97 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#ifndef SNORT_DNS_FIREWALL_TRAINER_DATASET_READER_H
+#define SNORT_DNS_FIREWALL_TRAINER_DATASET_READER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace snort { namespace dns_firewall { namespace trainer {
+
+// Reader of dataset lines, plain text or gzip compressed.
+// Background thread reads the file in big chunks, decompresses it if needed,
+// splits it into batches of lines and puts them into a bounded queue, so that
+// I/O and decompression overlap with learning. Lines are returned in the order
+// of the file, exactly as by std::getline.
+// Captures in pcap or pcapng format are read with PcapReader instead, and question
+// names of DNS queries are returned as lines, in capture order.
+// Reading may start from position of earlier reading, e.g. saved in a checkpoint.
+class DatasetReader
+{
+  public:
+    typedef std::vector<std::string> Batch;
+
+    // Position in dataset, just after some line
+    struct Position
+    {
+        uint64_t offset; // Bytes of text before, decompressed if needed, 0 for captures
+        uint64_t lines;  // Lines before
+    };
+
+  private:
+    std::string filename_;
+    int file_;                  // Descriptor of dataset file
+    bool capture_;              // Dataset file is a pcap or pcapng capture
+    std::size_t batch_lines_;   // Lines in each batch
+    std::size_t queue_batches_; // Batches read ahead at most
+    Position start_;            // Position of the first line read
+    Position position_;         // Position after the last batch taken
+    std::deque<std::pair<Batch, Position>> queue_; // Batches read, but not taken yet,
+                                                   // with positions after them
+    bool finished_;             // Reader thread has put the last batch
+    bool stopped_;              // Reader thread must stop as soon as possible
+    std::exception_ptr error_;  // Error of reader thread, thrown by next()
+    std::mutex mutex_;
+    std::condition_variable queue_condition_;
+    std::thread reader_;
+
+    // Reader thread main loop
+    void run();
+    // Read whole file into batches, until the end of file or stop
+    void read_batches();
+    // Read question names of whole capture into batches, until the end of file or stop
+    void read_capture();
+    // Put batch into the queue, with position after it, waiting for free space.
+    // Returns false if stopped
+    bool put( Batch&, const Position& );
+
+  public:
+    // Read dataset from given position. Text is skipped by seeking the file,
+    // if possible, compressed text is decompressed and dropped, and lines of
+    // captures are read and dropped
+    explicit DatasetReader( const std::string& filename,
+                            const Position& start     = Position{ 0, 0 },
+                            std::size_t batch_lines   = 4096,
+                            std::size_t queue_batches = 16 );
+    DatasetReader( const DatasetReader& ) = delete;
+    DatasetReader& operator=( const DatasetReader& ) = delete;
+    ~DatasetReader();
+
+    // Get next batch of lines, waiting for it if needed.
+    // Returns false at the end of dataset, throws if file could not be read
+    bool next( Batch& );
+    // Get position just after the last batch taken by next()
+    Position position();
+};
+
+}}} // namespace snort::dns_firewall::trainer
+
+#endif // SNORT_DNS_FIREWALL_TRAINER_DATASET_READER_H
@@ -0,0 +1,175 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#include "domain_counts.h"
+#include "bloom_filter.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace snort { namespace dns_firewall { namespace trainer {
+
+namespace {
+
+// Domain with its count, ordered by hash and domain
+struct Entry
+{
+    uint64_t hash;
+    std::string domain;
+    uint64_t count;
+
+    bool operator<( const Entry& operand2 ) const
+    {
+        return hash < operand2.hash || ( hash == operand2.hash && domain < operand2.domain );
+    }
+};
+
+// Sequential reader of run file, written by DomainCounts::spill
+class RunReader
+{
+  private:
+    std::ifstream file_;
+
+  public:
+    Entry entry; // Current entry, valid until next() returns false
+
+    explicit RunReader( const std::string& filename )
+        : file_( filename, std::ios::binary )
+    {
+        if( not file_ ) {
+            throw std::invalid_argument( "Could not open run file " + filename );
+        }
+    }
+
+    // Read next entry, returns false at the end of file
+    bool next()
+    {
+        uint32_t length;
+        if( not file_.read( reinterpret_cast<char*>( &entry.count ), sizeof( entry.count ) ) ||
+            not file_.read( reinterpret_cast<char*>( &length ), sizeof( length ) ) ) {
+            return false;
+        }
+        entry.domain.resize( length );
+        if( not file_.read( &entry.domain[0], length ) ) {
+            return false;
+        }
+        entry.hash = BloomFilter::hash( entry.domain );
+        return true;
+    }
+};
+
+// Sort counts by hash and domain
+std::vector<Entry> sorted_entries( const std::unordered_map<std::string, uint64_t>& counts )
+{
+    std::vector<Entry> entries;
+    entries.reserve( counts.size() );
+    for( auto& c: counts ) {
+        entries.push_back( Entry{ BloomFilter::hash( c.first ), c.first, c.second } );
+    }
+    std::sort( entries.begin(), entries.end() );
+    return entries;
+}
+
+} // namespace
+
+DomainCounts::DomainCounts( unsigned max_domains, const std::string& directory )
+    : max_domains_( std::max( 1u, max_domains ) )
+    , directory_( directory )
+{
+}
+
+DomainCounts::~DomainCounts()
+{
+    for( auto& run: runs_ ) {
+        std::remove( run.c_str() );
+    }
+}
+
+// Write counts kept in memory to a new run file
+void DomainCounts::spill()
+{
+    std::string filename = directory_ + "/dfw3trainer-" + std::to_string( getpid() ) + "-" +
+                           std::to_string( runs_.size() ) + ".run";
+    runs_.push_back( filename );
+    std::ofstream file( filename, std::ios::binary | std::ios::trunc );
+    for( auto& entry: sorted_entries( counts_ ) ) {
+        uint32_t length = entry.domain.size();
+        file.write( reinterpret_cast<const char*>( &entry.count ), sizeof( entry.count ) );
+        file.write( reinterpret_cast<const char*>( &length ), sizeof( length ) );
+        file.write( entry.domain.data(), length );
+    }
+    if( not file.flush() ) {
+        throw std::invalid_argument( "Could not write run file " + filename );
+    }
+    counts_.clear();
+}
+
+void DomainCounts::add( const std::string& domain )
+{
+    ++counts_[domain];
+    if( counts_.size() >= max_domains_ ) {
+        spill();
+    }
+}
+
+void DomainCounts::visit( const Visitor& visitor )
+{
+    if( runs_.empty() ) {
+        for( auto& entry: sorted_entries( counts_ ) ) {
+            visitor( entry.domain, entry.count );
+        }
+        return;
+    }
+
+    // Merge all runs, summing up counts of the same domain in different runs
+    if( not counts_.empty() ) {
+        spill();
+    }
+    std::vector<std::unique_ptr<RunReader>> readers;
+    auto later = [&readers]( std::size_t r1, std::size_t r2 ) {
+        return readers[r2]->entry < readers[r1]->entry;
+    };
+    using Heads = std::priority_queue<std::size_t, std::vector<std::size_t>, decltype( later )>;
+    Heads heads( later );
+    for( auto& run: runs_ ) {
+        readers.push_back( std::make_unique<RunReader>( run ) );
+        if( readers.back()->next() ) {
+            heads.push( readers.size() - 1 );
+        }
+    }
+    while( not heads.empty() ) {
+        Entry current = readers[heads.top()]->entry;
+        current.count = 0;
+        while( not heads.empty() && not( current < readers[heads.top()]->entry ) ) {
+            std::size_t r = heads.top();
+            heads.pop();
+            current.count += readers[r]->entry.count;
+            if( readers[r]->next() ) {
+                heads.push( r );
+            }
+        }
+        visitor( current.domain, current.count );
+    }
+}
+
+std::size_t DomainCounts::runs() const
+{
+    return runs_.size();
+}
+
+}}} // namespace snort::dns_firewall::trainer
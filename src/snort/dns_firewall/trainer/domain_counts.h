@@ -0,0 +1,62 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#ifndef SNORT_DNS_FIREWALL_TRAINER_DOMAIN_COUNTS_H
+#define SNORT_DNS_FIREWALL_TRAINER_DOMAIN_COUNTS_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace snort { namespace dns_firewall { namespace trainer {
+
+// Number of occurrences of each unique domain of a dataset.
+// Counts are kept in memory up to given number of unique domains, and then
+// spilled to a run file in given directory, sorted by hash of domain and domain.
+// Runs are merged when domains are visited, so data bigger than memory may be
+// counted. Domains are visited in order of their hashes, which is pseudo-random,
+// but independent of the order of the dataset.
+class DomainCounts
+{
+  public:
+    using Visitor = std::function<void( const std::string&, uint64_t )>;
+
+  private:
+    unsigned max_domains_;
+    std::string directory_;
+    std::unordered_map<std::string, uint64_t> counts_; // Counts not spilled yet
+    std::vector<std::string> runs_;                    // Run files, removed in destructor
+
+    // Write counts kept in memory to a new run file
+    void spill();
+
+  public:
+    DomainCounts( unsigned max_domains, const std::string& directory );
+    DomainCounts( const DomainCounts& ) = delete;
+    DomainCounts& operator=( const DomainCounts& ) = delete;
+    ~DomainCounts();
+
+    // Count one more occurrence of given domain
+    void add( const std::string& domain );
+    // Call given visitor once for every unique domain, with its total count
+    void visit( const Visitor& );
+    // Get number of run files spilled so far
+    std::size_t runs() const;
+};
+
+}}} // namespace snort::dns_firewall::trainer
+
+#endif // SNORT_DNS_FIREWALL_TRAINER_DOMAIN_COUNTS_H
@@ -14,14 +14,130 @@
 
 #include "distribution_scale.h"
 #include "entropy/dns_classifier.h"
+#include "hmm_scorer.h"
 #include "model.h"
 #include "smart_hmm.h"
+#include "trainer/checkpoint.h"
 #include "trainer/config.h"
+#include "trainer/dataset_reader.h"
+#include "trainer/domain_counts.h"
+#include "trainer/partial_model.h"
+#include "trainer/sweep.h"
+#include <getopt.h>
+#include <sys/stat.h>
 
 extern char* optarg;
+extern int optind;
 
 using namespace snort::dns_firewall;
 
+namespace {
+
+// Domains streamed to expectation step of Baum-Welch algorithm at once
+const std::size_t BAUM_WELCH_CHUNK = 65536;
+
+// Create the final model of given statistics, save it and print its evaluation
+// on domains learned last, optionally saving graphs of distributions
+void save_model( const trainer::Config& options,
+                 const trainer::PartialModel& statistics,
+                 bool save_graphs,
+                 const std::string& graphs_path )
+{
+    const auto& hmm        = statistics.hmm;
+    const auto& last_batch = statistics.last_batch;
+
+    // Score last batch of learned domains with trained HMM, all at once
+    std::vector<const char*> batch_names;
+    std::vector<std::size_t> batch_lengths;
+    for( auto& domain: last_batch ) {
+        batch_names.push_back( domain.data() );
+        batch_lengths.push_back( domain.size() );
+    }
+    std::vector<double> batch_scores( last_batch.size() );
+    const char terminator = '$';
+    hmm.find_viterbi_scores( batch_names.data(),
+                             batch_lengths.data(),
+                             last_batch.size(),
+                             batch_scores.data(),
+                             &terminator );
+    double mean_score = 0;
+    for( unsigned i = 0; i < batch_scores.size(); ++i ) {
+        mean_score += batch_scores[i] / ( batch_lengths[i] + 1 ) / batch_scores.size();
+    }
+
+    // Create model file
+    Model model = statistics.to_model( options );
+
+    // Save result distribution to file
+    model.save_to_file( options.model_file );
+    unsigned hidden_states = hmm.get_states().size();
+    std::cout << "\rDistribution saved to " << options.model_file << "!" << std::endl;
+    std::cout << "Processed lines: " << statistics.processed_lines << std::endl;
+    std::cout << "Skipped lines: " << statistics.skipped_lines << std::endl;
+    std::cout << "Mean HMM log10 probability per character of last batch: " << mean_score
+              << std::endl;
+    std::cout << "HMM non-zero transitions: " << hmm.get_transitions_count() << "/"
+              << hidden_states * hidden_states
+              << ( hmm.has_sparse_transitions() ? " (sparse)" : "" ) << std::endl;
+
+    // Score last batch again with quantized HMMs, which plugin may use instead
+    for( HmmPrecision precision: { HmmPrecision::FLOAT, HmmPrecision::INT16 } ) {
+        std::cout << "HMM max " << precision << " score deviation per character: ";
+        auto scorer = make_quantized_hmm_scorer( hmm, precision );
+        if( not scorer ) {
+            std::cout << "not available" << std::endl;
+            continue;
+        }
+        std::vector<double> quantized_scores( last_batch.size() );
+        scorer->score( batch_names.data(),
+                       batch_lengths.data(),
+                       last_batch.size(),
+                       quantized_scores.data(),
+                       &terminator );
+        double max_deviation = 0;
+        for( unsigned i = 0; i < batch_scores.size(); ++i ) {
+            max_deviation = std::max( max_deviation,
+                                      std::fabs( quantized_scores[i] - batch_scores[i] ) /
+                                        ( batch_lengths[i] + 1 ) );
+        }
+        std::cout << max_deviation << std::endl;
+    }
+
+    // Test save
+    Model model2;
+    model2.load_from_file( options.model_file );
+
+    if( save_graphs ) {
+        if( options.entropy.scale == DistributionScale::LINEAR ) {
+            model.save_graphs( graphs_path, "-lin.csv" );
+        }
+        if( options.entropy.scale == DistributionScale::LOG ) {
+            model.save_graphs( graphs_path, "-log.csv" );
+        }
+
+        // Calculate lengths distribution
+        unsigned long all_domain_num = 0;
+        for( auto& d: statistics.domain_lengths ) {
+            all_domain_num += d.second;
+        }
+        unsigned max_domain_length =
+          statistics.domain_lengths.empty() ? 0 : statistics.domain_lengths.rbegin()->first;
+        std::vector<double> domains_lengths_freqencies( max_domain_length + 1, 0 );
+        for( auto& freq: statistics.domain_lengths ) {
+            domains_lengths_freqencies[freq.first] =
+              double( freq.second ) / double( all_domain_num );
+        }
+
+        std::ofstream fs( graphs_path + "domains_lengths.csv" );
+        for( auto& length_freq: domains_lengths_freqencies ) {
+            fs << length_freq << std::endl;
+        }
+        fs.close();
+    }
+}
+
+} // namespace
+
 // ----------------
 // ENTRYPOINT
 // ----------------
@@ -30,26 +146,47 @@ int main( int argc, char* const argv[] )
     std::cout << "snort3trainer 0.1.1 by Artur M. Brodzki" << std::endl << std::endl;
     std::string help =
       "Usage:\n"
+      "   dfw3trainer -c config [options]\n"
+      "   dfw3trainer merge -c config [-o model] [-g path] partial...\n\n"
+      "       Merge mode sums statistics of partial models learned\n"
+      "       from shards of dataset and saves the final model.\n\n"
       "   -c: YAML config file name (mandatory)\n\n"
       "       If -f, -n, -o option is specified, configuration\n"
       "       from YAML file is overwritten.\n\n"
-      "   -f: File name of the dataset to process\n"
+      "   -f: File name of the dataset to process: text, gzip or pcap\n"
       "   -n: max number of lines to process\n"
       "   -s: Markov hidden states\n"
       "   -o: Model file name\n"
+      "   -p: Save partial model of this shard of dataset, to be merged\n"
+      "       All shards must start from the same HMM: the one of -i\n"
+      "       model, or random one drawn from trainer.hmm.seed\n"
+      "   -i: Initial model file name, whose HMM is learned further\n"
+      "   -r, --resume: Resume training from the last checkpoint\n"
       "   -h: Print this help\n";
 
     // Parse command line options
     int opt;
+    bool merge       = argc > 1 && std::string( argv[1] ) == "merge";
+    bool partial     = false;
+    bool resume      = false;
     bool save_graphs = false;
     std::string graphs_path;
     std::string yaml_filename_getopt;
     std::string dataset_filename_getopt;
     std::string model_filename_getopt;
+    std::string initial_model_getopt;
     int max_lines_getopt = -1;
     int hidden_states    = -1;
 
-    while( ( opt = getopt( argc, argv, "g:c:f:n:s:o:h" ) ) != -1 ) {
+    // Options of merge mode follow its name, which getopt takes for program name
+    if( merge ) {
+        --argc;
+        ++argv;
+    }
+    const struct option long_options[] = { { "resume", no_argument, nullptr, 'r' },
+                                           { nullptr, 0, nullptr, 0 } };
+    while( ( opt = getopt_long( argc, argv, "g:c:f:n:s:o:i:prh", long_options, nullptr ) ) !=
+           -1 ) {
         switch( opt ) {
         case 'g':
             save_graphs = true;
@@ -70,13 +207,22 @@ int main( int argc, char* const argv[] )
         case 'o':
             model_filename_getopt = std::string( optarg );
             break;
+        case 'i':
+            initial_model_getopt = std::string( optarg );
+            break;
+        case 'p':
+            partial = true;
+            break;
+        case 'r':
+            resume = true;
+            break;
         case 'h':
             std::cout << help << std::endl;
             exit( 0 );
             break;
         }
     }
-    if( yaml_filename_getopt == "" ) {
+    if( yaml_filename_getopt == "" || ( merge && optind >= argc ) ) {
         std::cout << help << std::endl;
         exit( 1 );
     }
@@ -100,120 +246,319 @@ int main( int argc, char* const argv[] )
     // Print trainer options
     std::cout << options << std::endl << std::endl;
 
+    // Merge statistics of partial models, learning the final model from them
+    if( merge ) {
+        trainer::PartialModel statistics;
+        for( int i = optind; i < argc; ++i ) {
+            trainer::PartialModel shard;
+            shard.load_from_file( argv[i] );
+            std::cout << "Partial model " << argv[i] << ": " << shard.processed_lines
+                      << " processed lines" << std::endl;
+            if( i == optind ) {
+                statistics = shard;
+            } else {
+                statistics.merge( shard );
+            }
+        }
+        statistics.hmm.set_transitions_epsilon( options.hmm.prune_epsilon );
+        statistics.update_hmm( options );
+        save_model( options, statistics, save_graphs, graphs_path );
+        return 0;
+    }
+
     // Create line_processor objects
     std::string dns_alphabet = "%:/=+_1234567890abcdefghijklmnopqrstuvwxyz.,-$#@<>()[]";
-    scientific::ml::Hmm<char, std::string> hmm( options.hmm.hidden_states, dns_alphabet );
+    // Random starting HMM is drawn from configured seed, so that all shards
+    // of sharded training, learned without initial model, start from the same one
+    scientific::ml::Hmm<char, std::string> hmm(
+      options.hmm.hidden_states, dns_alphabet, options.hmm.seed );
+    // Learn HMM of initial model further, e.g. the one merged in previous round
+    // of sharded training, which all shards of the next round start from
+    if( initial_model_getopt != "" ) {
+        Model initial_model;
+        initial_model.load_from_file( initial_model_getopt );
+        hmm = initial_model.hmm;
+        hmm.clear_learning_state();
+    }
+    hmm.set_transitions_epsilon( options.hmm.prune_epsilon );
+    hmm.set_learning_threads( options.hmm.threads, options.hmm.deterministic );
     std::vector<entropy::DnsClassifier> fifos;
     for( auto& w: options.entropy.window_widths ) {
         fifos.push_back( entropy::DnsClassifier( w, options.entropy.bins ) );
     }
     // Collect domain length stats
     std::unordered_map<unsigned, unsigned> domain_lengths;
+    // Last batch of domains learned by HMM, used to evaluate the trained model
+    std::vector<std::string> last_batch( options.hmm.batch_size );
+    unsigned learned_lines = 0;
+    // Unique domains learned by HMM after the whole dataset is read, if deduplicated
+    trainer::DomainCounts domain_counts( options.hmm.dedup_max_domains,
+                                         options.hmm.dedup_directory );
 
-    // Process data line by line
-    std::ifstream dataset_file( options.dataset.filename );
-    std::string line;
+    // Learn HMM with domain counted given number of times, with Viterbi algorithm
+    // at once, while Baum-Welch algorithm learns all domains again after them
+    auto learn_domain = [&]( const std::string& domain, double weight ) {
+        if( options.hmm.algorithm == trainer::Config::Algorithm::VITERBI ) {
+            if( partial ) {
+                hmm.accumulate_parallel( domain + "$", options.hmm.batch_size, weight );
+            } else {
+                hmm.learn_parallel(
+                  domain + "$", options.hmm.learning_rate, options.hmm.batch_size, weight );
+            }
+        }
+        last_batch[learned_lines++ % last_batch.size()] = domain;
+    };
+
+    // Models of all configurations of hyperparameters sweep, learned instead of single one
+    std::unique_ptr<trainer::Sweep> sweep;
+    std::vector<std::string> sweep_batch;
+    if( options.sweep.enabled ) {
+        if( options.hmm.algorithm != trainer::Config::Algorithm::VITERBI ||
+            options.hmm.deduplicate || partial || initial_model_getopt != "" ) {
+            throw std::invalid_argument( "Sweep supports Viterbi algorithm without "
+                                         "deduplication, partial and initial models only!" );
+        }
+        sweep.reset( new trainer::Sweep( options, dns_alphabet ) );
+        std::cout << "Sweep configurations: " << sweep->size() << std::endl;
+    }
+
+    // Baum-Welch algorithm reads dataset again in every epoch, unless it learns
+    // unique domains counted in the first pass, so pipes can not be read
+    struct stat dataset_stat;
+    if( options.hmm.algorithm == trainer::Config::Algorithm::BAUM_WELCH &&
+        not options.hmm.deduplicate &&
+        ( stat( options.dataset.filename.c_str(), &dataset_stat ) != 0 ||
+          not S_ISREG( dataset_stat.st_mode ) ) ) {
+        throw std::invalid_argument( "Baum-Welch algorithm without deduplication needs "
+                                     "dataset in a regular file!" );
+    }
+
+    // Resume learning from the last checkpoint, with position in dataset after it
+    if( ( resume || options.checkpoint.interval > 0 ) &&
+        ( options.hmm.deduplicate || sweep ) ) {
+        throw std::invalid_argument(
+          "Checkpoints are not supported with deduplication and sweep!" );
+    }
+    trainer::DatasetReader::Position start{ 0, 0 };
     unsigned processed_lines = 0;
     unsigned skipped_lines   = 0;
+    if( resume ) {
+        trainer::Checkpoint checkpoint;
+        checkpoint.load_from_file( options.checkpoint.file );
+        if( checkpoint.dataset != options.dataset.filename ) {
+            throw std::invalid_argument(
+              "Checkpoint of different dataset can not be resumed!" );
+        }
+        start           = checkpoint.position;
+        processed_lines = checkpoint.processed_lines;
+        skipped_lines   = checkpoint.skipped_lines;
+        learned_lines   = checkpoint.learned_lines;
+        hmm             = checkpoint.hmm;
+        hmm.set_transitions_epsilon( options.hmm.prune_epsilon );
+        hmm.set_learning_threads( options.hmm.threads, options.hmm.deterministic );
+        fifos          = checkpoint.fifos;
+        domain_lengths = checkpoint.domain_lengths;
+        last_batch     = checkpoint.last_batch;
+        std::cout << "Resumed from checkpoint " << options.checkpoint.file << " after "
+                  << processed_lines << " processed lines" << std::endl;
+    }
+    // Checkpoints are saved by background thread, so that learning goes on meanwhile
+    std::unique_ptr<trainer::CheckpointWriter> checkpoint_writer;
+    if( options.checkpoint.interval > 0 ) {
+        checkpoint_writer.reset( new trainer::CheckpointWriter( options.checkpoint.file ) );
+    }
+
+    // Process data line by line, in batches read ahead by background thread
+    trainer::DatasetReader dataset_reader( options.dataset.filename, start );
+    trainer::DatasetReader::Batch batch;
+    bool finished        = false;
+    auto last_progress   = std::chrono::steady_clock::now();
+    auto last_checkpoint = last_progress;
     std::cout.imbue( std::locale( "" ) );
 
-    while( getline( dataset_file, line ) ) {
-        // Max processed lines check
-        if( options.dataset.max_lines > 0 &&
-            processed_lines >= (unsigned) options.dataset.max_lines ) {
-            break;
-        }
-        // Collect domains length statistics
-        ++domain_lengths[line.size()];
-        // Learn HMM
-        if( line.size() >= options.hmm.min_length ) {
-            try {
-                hmm.learn( line + "$", options.hmm.learning_rate, options.hmm.batch_size );
-            } catch( ... ) {
-                std::cout << "CATCH: " << line << std::endl;
+    while( not finished && dataset_reader.next( batch ) ) {
+        for( auto& line: batch ) {
+            // Max processed lines check
+            if( options.dataset.max_lines > 0 &&
+                processed_lines >= (unsigned) options.dataset.max_lines ) {
+                finished = true;
+                break;
+            }
+            // Collect domains length statistics
+            ++domain_lengths[line.size()];
+            // Skip domains learned by HMM with characters outside of its alphabet,
+            // they are counted and reported at the end
+            if( line.size() >= options.hmm.min_length && not hmm.in_alphabet( line ) ) {
                 ++skipped_lines;
                 continue;
             }
-        }
-        // Learn entropy
-        if( line.size() >= options.entropy.min_length ) {
-            for( unsigned i = 0; i < fifos.size(); ++i ) {
-                fifos[i].learn( line );
+            // Learn all models of sweep together, with whole batch
+            if( sweep ) {
+                sweep_batch.push_back( line );
+                ++processed_lines;
+                continue;
+            }
+            // Learn HMM
+            if( line.size() >= options.hmm.min_length ) {
+                if( options.hmm.deduplicate ) {
+                    domain_counts.add( line );
+                } else {
+                    learn_domain( line, 1 );
+                }
             }
+            // Learn entropy, which depends on order of domains
+            if( line.size() >= options.entropy.min_length ) {
+                for( unsigned i = 0; i < fifos.size(); ++i ) {
+                    fifos[i].learn( line );
+                }
+            }
+            // Count processed lines
+            ++processed_lines;
+        }
+        if( sweep ) {
+            sweep->learn( sweep_batch );
+            sweep_batch.clear();
         }
-        // Count processed lines
-        ++processed_lines;
-        // Print results in real-time
-        if( processed_lines % 1 == 0 ) {
+        // Print progress once a second
+        auto now = std::chrono::steady_clock::now();
+        if( now - last_progress >= std::chrono::seconds( 1 ) ) {
             std::cout << "\rProcessed lines: " << processed_lines << "    " << std::flush;
+            last_progress = now;
+        }
+        // Take checkpoint after the whole batch, unless the previous one is being saved
+        if( checkpoint_writer && not finished &&
+            now - last_checkpoint >= std::chrono::seconds( options.checkpoint.interval ) &&
+            not checkpoint_writer->busy() ) {
+            std::unique_ptr<trainer::Checkpoint> checkpoint( new trainer::Checkpoint() );
+            checkpoint->dataset         = options.dataset.filename;
+            checkpoint->position        = dataset_reader.position();
+            checkpoint->processed_lines = processed_lines;
+            checkpoint->skipped_lines   = skipped_lines;
+            checkpoint->learned_lines   = learned_lines;
+            checkpoint->hmm             = hmm;
+            checkpoint->fifos           = fifos;
+            checkpoint->domain_lengths  = domain_lengths;
+            checkpoint->last_batch      = last_batch;
+            checkpoint_writer->write( std::move( checkpoint ) );
+            last_checkpoint = now;
         }
     }
+    std::cout << "\rProcessed lines: " << processed_lines << "    " << std::flush;
 
-    // Calculate lengths distribution
-    unsigned max_domain_length = 0;
-    for( auto& d: domain_lengths ) {
-        max_domain_length = std::max( max_domain_length, d.first );
+    // Learn every unique domain once, weighted with its count
+    if( options.hmm.deduplicate ) {
+        domain_counts.visit( learn_domain );
+        std::cout << std::endl
+                  << "Unique domains learned by HMM: " << learned_lines
+                  << " (spilled runs: " << domain_counts.runs() << ")" << std::endl;
     }
-    unsigned all_domain_num = 0;
-    for( auto& d: domain_lengths ) {
-        all_domain_num += d.second;
-    }
-    std::vector<double> domains_lengths_freqencies( max_domain_length + 1, 0 );
-    for( auto& freq: domain_lengths ) {
-        domains_lengths_freqencies[freq.first] =
-          double( freq.second ) / double( all_domain_num );
-    }
-    // Calculate length percentile
-    unsigned cumulative        = 0;
-    unsigned percentile_length = 0;
-    for( auto& d: domain_lengths ) {
-        cumulative += d.second;
-        if( double( cumulative ) / all_domain_num > options.max_length.percentile ) {
-            percentile_length = d.first;
-            break;
+
+    // Learn domains of unfinished batch, which are not applied to the model
+    hmm.flush_learning_buffer();
+
+    // Learn all domains with Baum-Welch algorithm, until log10 probability
+    // of dataset stops growing, or only count them, if partial
+    if( options.hmm.algorithm == trainer::Config::Algorithm::BAUM_WELCH ) {
+        std::cout << std::endl;
+        // Accumulate expected counts of all learned domains, streamed in chunks,
+        // so that they are never kept in memory all at once: unique ones are
+        // visited again if deduplicated, otherwise dataset is read again up to
+        // the lines processed, which are filtered as in the first pass.
+        // Returns log10 probability of them per character
+        auto expect_baum_welch = [&]() {
+            std::vector<std::string> chunk;
+            std::vector<double> weights;
+            double log_prob   = 0;
+            double characters = 0;
+            auto expect       = [&]( const std::string& domain, double weight ) {
+                chunk.push_back( domain + "$" );
+                weights.push_back( weight );
+                characters += weight * chunk.back().size();
+                if( chunk.size() >= BAUM_WELCH_CHUNK ) {
+                    log_prob += hmm.accumulate_baum_welch( chunk, weights );
+                    chunk.clear();
+                    weights.clear();
+                }
+            };
+            if( options.hmm.deduplicate ) {
+                domain_counts.visit( expect );
+            } else {
+                trainer::DatasetReader reader( options.dataset.filename );
+                trainer::DatasetReader::Batch lines;
+                unsigned read_lines = 0;
+                while( read_lines < processed_lines && reader.next( lines ) ) {
+                    for( auto& line: lines ) {
+                        if( read_lines >= processed_lines ) {
+                            break;
+                        }
+                        if( line.size() < options.hmm.min_length ) {
+                            ++read_lines;
+                        } else if( hmm.in_alphabet( line ) ) {
+                            ++read_lines;
+                            expect( line, 1 );
+                        }
+                    }
+                }
+            }
+            log_prob += hmm.accumulate_baum_welch( chunk, weights );
+            return log_prob / std::max( characters, 1.0 );
+        };
+        if( partial ) {
+            double score = expect_baum_welch();
+            std::cout << "Baum-Welch expectation: log10 probability per character: " << score
+                      << std::endl;
+        }
+        double previous = -std::numeric_limits<double>::infinity();
+        for( unsigned epoch = 1; epoch <= options.hmm.epochs && not partial; ++epoch ) {
+            double score = expect_baum_welch();
+            hmm.maximize( options.hmm.pseudo_count );
+            std::cout << "Baum-Welch epoch " << epoch
+                      << ": log10 probability per character: " << score << std::endl;
+            if( score - previous < options.hmm.tolerance ) {
+                break;
+            }
+            previous = score;
         }
     }
 
-    // Create model file
-    snort::dns_firewall::Model model;
-    model.query_max_length   = percentile_length;
-    model.max_length_penalty = options.max_length.penalty;
+    // Statistics of the whole dataset, with HMM learned already, unless partial
+    trainer::PartialModel statistics;
+    statistics.algorithm = options.hmm.algorithm;
+    statistics.bins      = options.entropy.bins;
+    statistics.hmm       = hmm;
     for( auto& f: fifos ) {
-        unsigned win_width = f.get_window_width();
-        model.entropy_distribution[win_width] =
-          f.get_entropy_distribution( options.entropy.scale );
+        statistics.entropy_observations[f.get_window_width()] = f.get_observations();
     }
-    model.bins = options.entropy.bins;
-    model.hmm  = hmm;
-
-    // Save result distribution to file
-    model.save_to_file( options.model_file );
-    std::cout << "\rDistribution saved to " << options.model_file << "!" << std::endl;
-    std::cout << "Processed lines: " << processed_lines << std::endl;
-    std::cout << "Skipped lines: " << skipped_lines << std::endl;
+    statistics.domain_lengths.insert( domain_lengths.begin(), domain_lengths.end() );
+    last_batch.resize( std::min<std::size_t>( learned_lines, last_batch.size() ) );
+    statistics.last_batch      = last_batch;
+    statistics.processed_lines = processed_lines;
+    statistics.skipped_lines   = skipped_lines;
 
-    // Test save
-    Model model2;
-    model2.load_from_file( options.model_file );
-
-    // std::cout << hmm.find_viterbi_path( "www.youtube.com$" ) << std::endl;
-    // std::cout << model.hmm.find_viterbi_path( "www.youtube.com$" ) << std::endl;
-    // std::cout << model2.hmm.find_viterbi_path( "www.youtube.com$" ) << std::endl;
-
-    if( save_graphs ) {
-        if( options.entropy.scale == DistributionScale::LINEAR ) {
-            model.save_graphs( graphs_path, "-lin.csv" );
-        }
-        if( options.entropy.scale == DistributionScale::LOG ) {
-            model.save_graphs( graphs_path, "-log.csv" );
-        }
+    // Save models of all sweep configurations and summary of their training
+    if( sweep ) {
+        auto results =
+          sweep->save( statistics.percentile_length( options.max_length.percentile ) );
+        std::string summary_file = options.model_file + ".sweep.csv";
+        std::ofstream summary( summary_file );
+        trainer::Sweep::write_results( results, summary );
+        std::cout << "\rSweep models saved, summary saved to " << summary_file << "!"
+                  << std::endl;
+        std::cout << "Processed lines: " << processed_lines << std::endl;
+        std::cout << "Skipped lines: " << skipped_lines << std::endl;
+        trainer::Sweep::write_results( results, std::cout );
+        return 0;
+    }
 
-        std::ofstream fs( graphs_path + "domains_lengths.csv" );
-        for( auto& length_freq: domains_lengths_freqencies ) {
-            fs << length_freq << std::endl;
-        }
-        fs.close();
+    // Save statistics of this shard, to be merged with the others
+    if( partial ) {
+        statistics.save_to_file( options.model_file );
+        std::cout << "\rPartial model saved to " << options.model_file << "!" << std::endl;
+        std::cout << "Processed lines: " << processed_lines << std::endl;
+        std::cout << "Skipped lines: " << skipped_lines << std::endl;
+        return 0;
     }
 
+    save_model( options, statistics, save_graphs, graphs_path );
     return 0;
 }
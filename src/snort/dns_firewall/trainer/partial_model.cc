@@ -0,0 +1,143 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#include "partial_model.h"
+#include "entropy/dns_classifier.h"
+#include <cereal/archives/binary.hpp>
+#include <cereal/types/map.hpp>
+#include <cereal/types/string.hpp>
+#include <cereal/types/vector.hpp>
+#include <fstream>
+#include <stdexcept>
+
+namespace snort { namespace dns_firewall { namespace trainer {
+
+PartialModel::PartialModel()
+    : algorithm( Config::Algorithm::VITERBI )
+    , bins( 0 )
+    , processed_lines( 0 )
+    , skipped_lines( 0 )
+{
+}
+
+template<class Archive>
+void PartialModel::serialize( Archive& archive )
+{
+    uint32_t magic = MAGIC;
+    archive( magic );
+    if( magic != MAGIC ) {
+        throw std::invalid_argument( "Not a partial model file!" );
+    }
+    archive( algorithm,
+             bins,
+             hmm,
+             entropy_observations,
+             domain_lengths,
+             last_batch,
+             processed_lines,
+             skipped_lines );
+}
+
+void PartialModel::save_to_file( const std::string& filename )
+{
+    std::ofstream fs( filename );
+    cereal::BinaryOutputArchive oarchive( fs );
+    oarchive( *this );
+    fs.close();
+}
+
+void PartialModel::load_from_file( const std::string& filename )
+{
+    std::ifstream fs( filename );
+    if( not fs ) {
+        throw std::invalid_argument( "Could not open partial model file " + filename );
+    }
+    cereal::BinaryInputArchive iarchive( fs );
+    iarchive( *this );
+    fs.close();
+}
+
+void PartialModel::merge( const PartialModel& partial )
+{
+    if( algorithm != partial.algorithm || bins != partial.bins ||
+        entropy_observations.size() != partial.entropy_observations.size() ) {
+        throw std::invalid_argument( "Partial models of different configs can not be merged!" );
+    }
+    for( auto& observations: partial.entropy_observations ) {
+        auto found = entropy_observations.find( observations.first );
+        if( found == entropy_observations.end() ||
+            found->second.size() != observations.second.size() ) {
+            throw std::invalid_argument(
+              "Partial models of different entropy windows can not be merged!" );
+        }
+    }
+    hmm.add_learning_state( partial.hmm );
+
+    for( auto& observations: partial.entropy_observations ) {
+        auto& sum = entropy_observations[observations.first];
+        for( unsigned i = 0; i < sum.size(); ++i ) {
+            sum[i] += observations.second[i];
+        }
+    }
+    for( auto& length: partial.domain_lengths ) {
+        domain_lengths[length.first] += length.second;
+    }
+    last_batch.insert( last_batch.end(), partial.last_batch.begin(), partial.last_batch.end() );
+    processed_lines += partial.processed_lines;
+    skipped_lines += partial.skipped_lines;
+}
+
+void PartialModel::update_hmm( const Config& options )
+{
+    hmm.flush_learning_buffer();
+    if( algorithm == Config::Algorithm::BAUM_WELCH ) {
+        hmm.maximize( options.hmm.pseudo_count );
+    } else {
+        hmm.update( options.hmm.learning_rate );
+    }
+}
+
+unsigned PartialModel::percentile_length( double percentile ) const
+{
+    unsigned long all_domain_num = 0;
+    for( auto& d: domain_lengths ) {
+        all_domain_num += d.second;
+    }
+    unsigned long cumulative = 0;
+    for( auto& d: domain_lengths ) {
+        cumulative += d.second;
+        if( double( cumulative ) / all_domain_num > percentile ) {
+            return d.first;
+        }
+    }
+    return 0;
+}
+
+Model PartialModel::to_model( const Config& options ) const
+{
+    Model model;
+    model.query_max_length   = percentile_length( options.max_length.percentile );
+    model.max_length_penalty = options.max_length.penalty;
+    for( auto& observations: entropy_observations ) {
+        entropy::DnsClassifier classifier( observations.first, bins );
+        classifier.add_observations( observations.second );
+        model.entropy_distribution[observations.first] =
+          classifier.get_entropy_distribution( options.entropy.scale );
+    }
+    model.bins = bins;
+    model.hmm  = hmm;
+    return model;
+}
+
+}}} // namespace snort::dns_firewall::trainer
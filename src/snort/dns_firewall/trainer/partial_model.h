@@ -0,0 +1,73 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#ifndef SNORT_DNS_FIREWALL_TRAINER_PARTIAL_MODEL_H
+#define SNORT_DNS_FIREWALL_TRAINER_PARTIAL_MODEL_H
+
+#include "model.h"
+#include "smart_hmm.h"
+#include "trainer/config.h"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace snort { namespace dns_firewall { namespace trainer {
+
+// Sufficient statistics of model learned from one shard of dataset, so that shards
+// may be learned on separate machines and then merged into the final model.
+// All shards count HMM paths against the same, starting HMM, without updating it,
+// so that counts accumulated in its *_prim matrices are additive, and the merged
+// HMM is learned from their sum with one update, or one maximization step of
+// Baum-Welch algorithm. Many such rounds, each starting from HMM merged in the
+// previous one, make distributed version of Baum-Welch algorithm.
+// Entropy distributions and domain lengths are kept as numbers of observations.
+struct PartialModel
+{
+    // Number at the beginning of partial model files, to tell them from models
+    static constexpr uint32_t MAGIC = 0x50574644; // "DFWP"
+
+    Config::Algorithm algorithm;
+    unsigned bins;
+    scientific::ml::Hmm<char, std::string> hmm; // Starting HMM, with counts of shard
+    std::map<unsigned, std::vector<unsigned>> entropy_observations; // By window width
+    std::map<unsigned, unsigned long> domain_lengths; // Number of domains of each length
+    std::vector<std::string> last_batch; // Domains learned last, to evaluate the model
+    unsigned long processed_lines;
+    unsigned long skipped_lines;
+
+    PartialModel();
+
+    template<class Archive>
+    void serialize( Archive& );
+
+    void save_to_file( const std::string& filename );
+    // Load partial model from file. Throws if it is not a partial model file
+    void load_from_file( const std::string& filename );
+
+    // Add statistics of another shard. Throws if shards were learned with
+    // different algorithms, entropy classifiers or starting HMMs
+    void merge( const PartialModel& );
+    // Learn HMM from counts of all shards, with learning rate or pseudo count
+    // of given config, depending on the algorithm
+    void update_hmm( const Config& );
+    // Get the shortest length, which longer domains are less than given fraction of
+    unsigned percentile_length( double percentile ) const;
+    // Create the final model, with HMM learned already
+    Model to_model( const Config& ) const;
+};
+
+}}} // namespace snort::dns_firewall::trainer
+
+#endif // SNORT_DNS_FIREWALL_TRAINER_PARTIAL_MODEL_H
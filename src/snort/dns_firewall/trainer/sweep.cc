@@ -0,0 +1,231 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#include "sweep.h"
+#include "model.h"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <sstream>
+#include <thread>
+
+namespace snort { namespace dns_firewall { namespace trainer {
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double seconds_since( Clock::time_point start )
+{
+    return std::chrono::duration<double>( Clock::now() - start ).count();
+}
+
+} // namespace
+
+Sweep::Sweep( const Config& options, const std::string& alphabet )
+    : options_( options )
+    , lines_( 0 )
+{
+    for( unsigned states: options.sweep.hidden_states ) {
+        for( double rate: options.sweep.learning_rates ) {
+            scientific::ml::Hmm<char, std::string> hmm( states, alphabet, options.hmm.seed );
+            hmms_.push_back( HmmLearner{ states, rate, hmm, 0, 0 } );
+            hmms_.back().hmm.set_transitions_epsilon( options.hmm.prune_epsilon );
+            // Learners run in parallel, each of them on a single thread
+            hmms_.back().hmm.set_learning_threads( 1, false );
+
+            for( unsigned bins: options.sweep.bins ) {
+                for( auto& widths: options.sweep.window_widths ) {
+                    Point point{ bins, widths, hmms_.size() - 1, {} };
+                    for( unsigned width: widths ) {
+                        // Entropy classifiers are shared by configurations of all HMMs
+                        auto found = std::find_if(
+                          entropies_.begin(), entropies_.end(), [&]( const EntropyLearner& e ) {
+                              return e.window_width == width && e.bins == bins;
+                          } );
+                        point.entropy.push_back( found - entropies_.begin() );
+                        if( found == entropies_.end() ) {
+                            entropies_.push_back( EntropyLearner{
+                              width, bins, entropy::DnsClassifier( width, bins ), 0, 0 } );
+                        }
+                    }
+                    points_.push_back( point );
+                }
+            }
+        }
+    }
+}
+
+std::size_t Sweep::size() const
+{
+    return points_.size();
+}
+
+unsigned Sweep::threads() const
+{
+    if( options_.sweep.threads == 0 ) {
+        return std::max( 1u, std::thread::hardware_concurrency() );
+    }
+    return options_.sweep.threads;
+}
+
+void Sweep::learn_task( std::size_t task )
+{
+    auto start = Clock::now();
+    if( task < hmms_.size() ) {
+        HmmLearner& learner = hmms_[task];
+        for( auto& line: learned_ ) {
+            if( line.size() >= options_.hmm.min_length ) {
+                learner.hmm.learn_parallel(
+                  line + "$", learner.learning_rate, options_.hmm.batch_size );
+            }
+        }
+        learner.seconds += seconds_since( start );
+    } else {
+        EntropyLearner& learner = entropies_[task - hmms_.size()];
+        for( auto& line: learned_ ) {
+            if( line.size() >= options_.entropy.min_length ) {
+                learner.classifier.learn( line );
+            }
+        }
+        learner.seconds += seconds_since( start );
+    }
+}
+
+void Sweep::learn( const std::vector<std::string>& lines )
+{
+    learned_.clear();
+    for( auto& line: lines ) {
+        ++lines_;
+        if( options_.sweep.holdout_every > 0 && lines_ % options_.sweep.holdout_every == 0 &&
+            holdout_.size() < options_.sweep.holdout_lines ) {
+            holdout_.push_back( line );
+        } else {
+            learned_.push_back( line );
+        }
+    }
+
+    std::size_t tasks = hmms_.size() + entropies_.size();
+#pragma omp parallel for schedule( dynamic ) num_threads( threads() )
+    for( std::size_t task = 0; task < tasks; ++task ) {
+        learn_task( task );
+    }
+}
+
+void Sweep::evaluate_task( std::size_t task )
+{
+    if( task < hmms_.size() ) {
+        // Learn sequences of unfinished batch, as trainer does
+        HmmLearner& learner = hmms_[task];
+        auto start          = Clock::now();
+        learner.hmm.flush_learning_buffer();
+        learner.seconds += seconds_since( start );
+
+        std::vector<const char*> names;
+        std::vector<std::size_t> lengths;
+        for( auto& line: holdout_ ) {
+            if( line.size() >= options_.hmm.min_length ) {
+                names.push_back( line.data() );
+                lengths.push_back( line.size() );
+            }
+        }
+        std::vector<double> scores( names.size() );
+        const char terminator = '$';
+        learner.hmm.find_viterbi_scores(
+          names.data(), lengths.data(), names.size(), scores.data(), &terminator );
+        learner.score = names.empty() ? std::numeric_limits<double>::quiet_NaN() : 0;
+        for( std::size_t i = 0; i < scores.size(); ++i ) {
+            learner.score += scores[i] / ( lengths[i] + 1 ) / scores.size();
+        }
+    } else {
+        // Held out lines continue the window of learned ones
+        EntropyLearner& learner           = entropies_[task - hmms_.size()];
+        entropy::DnsClassifier classifier = learner.classifier;
+        std::size_t count                 = 0;
+        learner.score                     = 0;
+        for( auto& line: holdout_ ) {
+            if( line.size() >= options_.entropy.min_length ) {
+                learner.score += classifier.classify( line );
+                ++count;
+            }
+        }
+        learner.score = count ? learner.score / count
+                              : std::numeric_limits<double>::quiet_NaN();
+    }
+}
+
+std::vector<Sweep::Result> Sweep::save( unsigned query_max_length )
+{
+    std::size_t tasks = hmms_.size() + entropies_.size();
+#pragma omp parallel for schedule( dynamic ) num_threads( threads() )
+    for( std::size_t task = 0; task < tasks; ++task ) {
+        evaluate_task( task );
+    }
+
+    std::vector<Result> results;
+    for( auto& point: points_ ) {
+        const HmmLearner& hmm = hmms_[point.hmm];
+        Result result;
+        result.hidden_states = hmm.hidden_states;
+        result.learning_rate = hmm.learning_rate;
+        result.bins          = point.bins;
+        result.window_widths = point.window_widths;
+        result.seconds       = hmm.seconds;
+        result.hmm_score     = hmm.score;
+        result.entropy_score = 0;
+
+        // Model file is named after its configuration
+        std::ostringstream filename;
+        filename << options_.model_file << ".s" << hmm.hidden_states << "-r"
+                 << hmm.learning_rate << "-b" << point.bins << "-w";
+        for( std::size_t w = 0; w < point.window_widths.size(); ++w ) {
+            filename << ( w ? "_" : "" ) << point.window_widths[w];
+        }
+        result.model_file = filename.str();
+
+        Model model;
+        model.query_max_length   = query_max_length;
+        model.max_length_penalty = options_.max_length.penalty;
+        for( std::size_t e: point.entropy ) {
+            const EntropyLearner& entropy = entropies_[e];
+            model.entropy_distribution[entropy.window_width] =
+              entropy.classifier.get_entropy_distribution( options_.entropy.scale );
+            result.seconds += entropy.seconds;
+            result.entropy_score += entropy.score / point.entropy.size();
+        }
+        model.bins = point.bins;
+        model.hmm  = hmm.hmm;
+        model.save_to_file( result.model_file );
+        results.push_back( result );
+    }
+    return results;
+}
+
+void Sweep::write_results( const std::vector<Result>& results, std::ostream& os )
+{
+    os << "MODEL;HIDDEN_STATES;LEARNING_RATE;BINS;WINDOW_WIDTHS;SECONDS;HOLDOUT_HMM;"
+          "HOLDOUT_ENTROPY"
+       << std::endl;
+    for( auto& result: results ) {
+        os << result.model_file << ";" << result.hidden_states << ";" << result.learning_rate
+           << ";" << result.bins << ";";
+        for( std::size_t w = 0; w < result.window_widths.size(); ++w ) {
+            os << ( w ? " " : "" ) << result.window_widths[w];
+        }
+        os << ";" << result.seconds << ";" << result.hmm_score << ";" << result.entropy_score
+           << std::endl;
+    }
+}
+
+}}} // namespace snort::dns_firewall::trainer
@@ -0,0 +1,108 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#ifndef SNORT_DNS_FIREWALL_TRAINER_SWEEP_H
+#define SNORT_DNS_FIREWALL_TRAINER_SWEEP_H
+
+#include "entropy/dns_classifier.h"
+#include "smart_hmm.h"
+#include "trainer/config.h"
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace snort { namespace dns_firewall { namespace trainer {
+
+// Training of models of all configurations of hyperparameters grid at once,
+// in a single pass over dataset. Configurations are all combinations of hidden
+// states, learning rates, distribution bins and window widths of SweepConfig.
+// Every HMM and every entropy classifier is learned once, even if it is shared
+// by many configurations, and all of them learn each batch of lines in parallel.
+// Every holdout_every-th line is held out from learning and used to evaluate
+// trained models.
+class Sweep
+{
+  public:
+    // Trained model of one configuration, with its evaluation
+    struct Result
+    {
+        unsigned hidden_states;
+        double learning_rate;
+        unsigned bins;
+        std::vector<unsigned> window_widths;
+        std::string model_file;
+        double seconds;       // Training time of HMM and entropy classifiers of model
+        double hmm_score;     // Mean HMM log10 probability per character of held out lines
+        double entropy_score; // Mean entropy score of held out lines
+    };
+
+  private:
+    struct HmmLearner
+    {
+        unsigned hidden_states;
+        double learning_rate;
+        scientific::ml::Hmm<char, std::string> hmm;
+        double seconds; // Time spent on learning
+        double score;   // Evaluation on held out lines
+    };
+    struct EntropyLearner
+    {
+        unsigned window_width;
+        unsigned bins;
+        entropy::DnsClassifier classifier;
+        double seconds; // Time spent on learning
+        double score;   // Evaluation on held out lines
+    };
+    // Configuration of grid, with indexes of its learners
+    struct Point
+    {
+        unsigned bins;
+        std::vector<unsigned> window_widths;
+        std::size_t hmm;
+        std::vector<std::size_t> entropy;
+    };
+
+    Config options_;
+    std::vector<HmmLearner> hmms_;
+    std::vector<EntropyLearner> entropies_;
+    std::vector<Point> points_;
+    std::vector<std::string> learned_; // Lines of current batch, which are learned
+    std::vector<std::string> holdout_; // Held out lines
+    unsigned long lines_;              // Lines passed to learn so far
+
+    // Get number of threads running learners
+    unsigned threads() const;
+    // Learn learner of given index, HMMs first, with current batch
+    void learn_task( std::size_t );
+    // Evaluate learner of given index, HMMs first, on held out lines
+    void evaluate_task( std::size_t );
+
+  public:
+    // Create learners of all configurations, for HMMs of given alphabet
+    Sweep( const Config&, const std::string& alphabet );
+
+    // Get number of configurations
+    std::size_t size() const;
+    // Learn all models with batch of lines, in parallel
+    void learn( const std::vector<std::string>& );
+    // Finish learning, evaluate all models on held out lines and save them
+    // to files named after model-file and configuration
+    std::vector<Result> save( unsigned query_max_length );
+    // Write results as CSV table, with header
+    static void write_results( const std::vector<Result>&, std::ostream& );
+};
+
+}}} // namespace snort::dns_firewall::trainer
+
+#endif // SNORT_DNS_FIREWALL_TRAINER_SWEEP_H
@@ -0,0 +1,36 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#include "bloom_filter.h"
+#include "unittest.h"
+#include <string>
+
+using namespace snort::dns_firewall;
+
+TEST( bloom_filter_contains_inserted_domains )
+{
+    BloomFilter filter( 10000, 16 );
+    for( unsigned i = 0; i < 10000; ++i ) {
+        filter.insert( BloomFilter::hash( "domain" + std::to_string( i ) + ".com" ) );
+    }
+    unsigned found           = 0;
+    unsigned false_positives = 0;
+    for( unsigned i = 0; i < 10000; ++i ) {
+        found += filter.contains_suffix( "www.domain" + std::to_string( i ) + ".com" );
+        false_positives += filter.contains( BloomFilter::hash( "other" + std::to_string( i ) ) );
+    }
+    CHECK( found == 10000 );
+    CHECK( false_positives < 100 );
+    CHECK( not BloomFilter().contains_suffix( "domain0.com" ) );
+}
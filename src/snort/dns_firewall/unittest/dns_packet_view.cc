@@ -0,0 +1,247 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#include "dns_packet_view.h"
+#include "qname_canonicalizer.h"
+#include "unittest.h"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace snort::dns_firewall;
+
+// Builder of DNS messages, in wire format
+class Message
+{
+  public:
+    std::vector<uint8_t> bytes;
+
+    Message( uint16_t flags,
+             unsigned questions,
+             unsigned answers    = 0,
+             unsigned authority  = 0,
+             unsigned additional = 0 )
+    {
+        u16( 0x1234 ).u16( flags ).u16( questions ).u16( answers );
+        u16( authority ).u16( additional );
+    }
+    Message& u8( uint8_t value )
+    {
+        bytes.push_back( value );
+        return *this;
+    }
+    Message& u16( uint16_t value )
+    {
+        return u8( value >> 8 ).u8( value );
+    }
+    Message& u32( uint32_t value )
+    {
+        return u16( value >> 16 ).u16( value );
+    }
+    // Append uncompressed name
+    Message& name( const std::string& domain )
+    {
+        std::size_t begin = 0;
+        while( begin < domain.size() ) {
+            std::size_t dot = std::min( domain.find( '.', begin ), domain.size() );
+            u8( dot - begin );
+            bytes.insert( bytes.end(), domain.begin() + begin, domain.begin() + dot );
+            begin = dot + 1;
+        }
+        return u8( 0 );
+    }
+    // Append compression pointer to given position, ending a name
+    Message& pointer( unsigned pos )
+    {
+        return u16( 0xC000 | pos );
+    }
+    Message& question( const std::string& domain )
+    {
+        return name( domain ).u16( 1 ).u16( 1 );
+    }
+    // Append type, class, TTL and data of record, after its name
+    Message& record( uint16_t type, const std::string& rdata, uint16_t rdlength )
+    {
+        u16( type ).u16( 1 ).u32( 300 ).u16( rdlength );
+        bytes.insert( bytes.end(), rdata.begin(), rdata.end() );
+        return *this;
+    }
+    Message& record( uint16_t type, const std::string& rdata )
+    {
+        return record( type, rdata, rdata.size() );
+    }
+    // Name in wire format, as record data
+    static std::string wire_name( const std::string& domain )
+    {
+        Message name( 0, 0 );
+        name.bytes.clear();
+        name.name( domain );
+        return std::string( name.bytes.begin(), name.bytes.end() );
+    }
+};
+
+// Position of the first question name, right after the header
+static const unsigned QUESTION_POS = DnsPacketView::HEADER_SIZE;
+
+TEST( dns_packet_view_signals_truncated_questions )
+{
+    QnameCanonicalizer canonicalizer;
+    Message query( 0, DnsPacketView::MAX_QUESTIONS + 1 );
+    for( unsigned i = 0; i < DnsPacketView::MAX_QUESTIONS; ++i ) {
+        query.question( "www.example.com" );
+    }
+    query.question( "tunnel.example.com" );
+    DnsPacketView dns( query.bytes.data(), query.bytes.size(), canonicalizer );
+    CHECK( not dns.malformed );
+    CHECK( dns.truncated_questions );
+    CHECK( dns.size() == DnsPacketView::MAX_QUESTIONS );
+
+    Message single( 0, 1 );
+    single.question( "www.example.com" );
+    DnsPacketView view( single.bytes.data(), single.bytes.size(), canonicalizer );
+    CHECK( not view.truncated_questions );
+    CHECK( view.size() == 1 && view.begin()->qname == "www.example.com" );
+}
+
+TEST( dns_packet_view_rejects_compression_pointer_loops )
+{
+    QnameCanonicalizer canonicalizer;
+    // Name pointing to itself
+    Message self( 0, 1 );
+    self.pointer( QUESTION_POS ).u16( 1 ).u16( 1 );
+    CHECK( DnsPacketView( self.bytes.data(), self.bytes.size(), canonicalizer ).malformed );
+    // Label followed by pointer back to it
+    Message loop( 0, 1 );
+    loop.u8( 1 ).u8( 'a' ).pointer( QUESTION_POS ).u16( 1 ).u16( 1 );
+    CHECK( DnsPacketView( loop.bytes.data(), loop.bytes.size(), canonicalizer ).malformed );
+    // Pointer forward, to a name placed after the question
+    Message forward( 0, 1 );
+    forward.pointer( QUESTION_POS + 6 ).u16( 1 ).u16( 1 ).name( "example.com" );
+    CHECK( DnsPacketView( forward.bytes.data(), forward.bytes.size(), canonicalizer )
+             .malformed );
+
+    // Answer names pointing back to the question are decoded
+    Message response( DnsPacketView::FLAG_RESPONSE, 1, 1 );
+    response.question( "www.example.com" ).pointer( QUESTION_POS ).record( 1, "abcd" );
+    DnsPacketView dns( response.bytes.data(), response.bytes.size(), canonicalizer );
+    CHECK( not dns.malformed && not dns.sections_malformed() );
+    char buffer[DnsPacketView::MAX_NAME_LENGTH];
+    std::string_view owner;
+    for( auto& r: dns.records( DnsPacketView::ANSWER ) ) {
+        CHECK( dns.decode_name( r.name_pos, buffer, owner ) && owner == "www.example.com" );
+        CHECK( r.type == 1 && r.ttl == 300 && r.rdlength == 4 );
+    }
+    // Answer name pointing to itself
+    Message answer_loop( DnsPacketView::FLAG_RESPONSE, 1, 1 );
+    answer_loop.question( "www.example.com" );
+    unsigned answer_pos = answer_loop.bytes.size();
+    answer_loop.pointer( answer_pos ).record( 1, "abcd" );
+    DnsPacketView looped( answer_loop.bytes.data(), answer_loop.bytes.size(), canonicalizer );
+    for( auto& r: looped.records( DnsPacketView::ANSWER ) ) {
+        CHECK( not looped.decode_name( r.name_pos, buffer, owner ) );
+    }
+}
+
+TEST( dns_packet_view_skips_truncated_record_data )
+{
+    QnameCanonicalizer canonicalizer;
+    Message response( DnsPacketView::FLAG_RESPONSE, 1, 3 );
+    response.question( "www.example.com" );
+    response.pointer( QUESTION_POS ).record( 1, "abcd" );
+    // Record data longer than the rest of the message
+    response.pointer( QUESTION_POS ).record( 1, "abcd", 100 );
+    DnsPacketView dns( response.bytes.data(), response.bytes.size(), canonicalizer );
+    CHECK( not dns.malformed );
+    CHECK( dns.sections_malformed() );
+    unsigned records = 0;
+    for( auto& r: dns.records( DnsPacketView::ANSWER ) ) {
+        CHECK( r.rdlength == 4 );
+        ++records;
+    }
+    CHECK( records == 1 );
+    CHECK( dns.summarize_answers().rdata_bytes == 4 );
+}
+
+TEST( dns_packet_view_summarizes_payloads )
+{
+    QnameCanonicalizer canonicalizer;
+    Message response( DnsPacketView::FLAG_RESPONSE, 1, 3 );
+    response.question( "t.example.com" );
+    response.pointer( QUESTION_POS ).record( DnsPacketView::TYPE_TXT, "\3abc\2de" );
+    response.pointer( QUESTION_POS ).record( DnsPacketView::TYPE_NULL, "0123456" );
+    // String longer than the rest of record data counts only bytes present
+    response.pointer( QUESTION_POS ).record( DnsPacketView::TYPE_TXT, "\5abc" );
+    DnsPacketView dns( response.bytes.data(), response.bytes.size(), canonicalizer );
+    DnsPacketView::AnswerSummary summary = dns.summarize_answers();
+    CHECK( summary.rdata_bytes == 7 + 7 + 4 );
+    CHECK( summary.max_payload == 7 );
+    CHECK( summary.cname_chain == 0 );
+
+    Message txt( DnsPacketView::FLAG_RESPONSE, 1, 1 );
+    txt.question( "t.example.com" );
+    txt.pointer( QUESTION_POS ).record( DnsPacketView::TYPE_TXT, "\3abc\2de\4abc" );
+    DnsPacketView truncated( txt.bytes.data(), txt.bytes.size(), canonicalizer );
+    CHECK( truncated.summarize_answers().max_payload == 3 + 2 + 3 );
+}
+
+TEST( dns_packet_view_follows_cname_chain )
+{
+    QnameCanonicalizer canonicalizer;
+    Message response( DnsPacketView::FLAG_RESPONSE, 1, 4 );
+    response.question( "www.example.com" );
+    // CNAME not on the chain, then chain with owner pointing to the previous target
+    response.name( "other.example.org" )
+      .record( DnsPacketView::TYPE_CNAME, Message::wire_name( "www.example.com" ) );
+    unsigned target_pos = response.bytes.size() + 2 + 10;
+    response.pointer( QUESTION_POS )
+      .record( DnsPacketView::TYPE_CNAME, Message::wire_name( "cdn.Example.NET" ) );
+    response.pointer( target_pos )
+      .record( DnsPacketView::TYPE_CNAME, Message::wire_name( "edge.cdn.net" ) );
+    response.name( "edge.cdn.net" ).record( 1, "abcd" );
+    DnsPacketView dns( response.bytes.data(), response.bytes.size(), canonicalizer );
+    CHECK( not dns.sections_malformed() );
+    CHECK( dns.summarize_answers().cname_chain == 2 );
+
+    // CNAME loop is followed at most as many times as there are answers
+    Message loop( DnsPacketView::FLAG_RESPONSE, 1, 2 );
+    loop.question( "a.example.com" );
+    loop.pointer( QUESTION_POS )
+      .record( DnsPacketView::TYPE_CNAME, Message::wire_name( "b.example.com" ) );
+    loop.name( "b.example.com" )
+      .record( DnsPacketView::TYPE_CNAME, Message::wire_name( "a.example.com" ) );
+    DnsPacketView looped( loop.bytes.data(), loop.bytes.size(), canonicalizer );
+    CHECK( looped.summarize_answers().cname_chain == 2 );
+}
+
+TEST( dns_packet_view_parses_edns )
+{
+    QnameCanonicalizer canonicalizer;
+    Message query( 0, 1, 0, 0, 1 );
+    query.question( "www.example.com" );
+    // OPT record: root name, UDP size as class, extended rcode, version and DO bit as TTL
+    query.u8( 0 ).u16( DnsPacketView::TYPE_OPT ).u16( 4096 );
+    query.u8( 1 ).u8( 0 ).u16( 0x8000 ).u16( 0 );
+    DnsPacketView dns( query.bytes.data(), query.bytes.size(), canonicalizer );
+    const DnsPacketView::Edns& edns = dns.edns();
+    CHECK( edns.present );
+    CHECK( edns.udp_size == 4096 );
+    CHECK( edns.extended_rcode == 1 && edns.version == 0 );
+    CHECK( edns.dnssec_ok );
+
+    Message plain( 0, 1 );
+    plain.question( "www.example.com" );
+    DnsPacketView without( plain.bytes.data(), plain.bytes.size(), canonicalizer );
+    CHECK( not without.edns().present );
+}
@@ -0,0 +1,60 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#include "dns_tcp_stream.h"
+#include "unittest.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace snort::dns_firewall;
+
+// Feed TCP segment with given sequence number, returning its complete messages
+static std::vector<std::string>
+feed( DnsTcpStream& stream, uint32_t sequence, const std::string& segment )
+{
+    std::vector<std::string> messages;
+    stream.feed( sequence,
+                 reinterpret_cast<const uint8_t*>( segment.data() ),
+                 segment.size(),
+                 [&]( const uint8_t* data, unsigned size ) {
+                     messages.emplace_back( reinterpret_cast<const char*>( data ), size );
+                 } );
+    return messages;
+}
+
+TEST( dns_tcp_stream_skips_retransmitted_segments )
+{
+    const std::string message = std::string( "\0\5", 2 ) + "hello";
+    DnsTcpStream stream;
+    CHECK( feed( stream, 0xfffffffe, message.substr( 0, 4 ) ).empty() );
+    CHECK( feed( stream, 0xfffffffe, message.substr( 0, 4 ) ).empty() );
+    // Overlapping segment, across wrap of sequence numbers
+    std::vector<std::string> messages = feed( stream, 0, message.substr( 2 ) );
+    CHECK( messages.size() == 1 && messages[0] == "hello" );
+    CHECK( feed( stream, 0, message.substr( 2 ) ).empty() );
+    CHECK( stream.pending() == 0 );
+}
+
+TEST( dns_tcp_stream_drops_message_split_by_gap )
+{
+    const std::string message = std::string( "\0\5", 2 ) + "hello";
+    DnsTcpStream stream;
+    CHECK( feed( stream, 100, message.substr( 0, 4 ) ).empty() );
+    CHECK( stream.pending() == 4 );
+    // Rest of the message is lost, next one starts after the gap
+    std::vector<std::string> messages = feed( stream, 110, message );
+    CHECK( messages.size() == 1 && messages[0] == "hello" );
+    CHECK( stream.pending() == 0 );
+}
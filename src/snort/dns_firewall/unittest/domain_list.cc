@@ -0,0 +1,102 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#include "bloom_filter.h"
+#include "domain_index.h"
+#include "domain_list.h"
+#include "unittest.h"
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace snort::dns_firewall;
+
+TEST( domain_list_matches_mixed_case_entry )
+{
+    // Queries are lowercased by QnameCanonicalizer before they are matched
+    DomainList list;
+    list.insert( "WWW.Example.COM" );
+    list.insert( "^Evil[0-9]+\\..*" );
+    CHECK( list.match( "www.example.com" ) );
+    CHECK( list.match( "cdn.www.example.com" ) );
+    CHECK( not list.match( "example.com" ) );
+    CHECK( list.match( "evil12.org" ) );
+    CHECK( not list.match( "evil.org" ) );
+
+    std::vector<uint64_t> hashes;
+    list.hash_entries( hashes );
+    CHECK( hashes == std::vector<uint64_t>( { BloomFilter::hash( "www.example.com" ) } ) );
+}
+
+TEST( domain_index_matches_mixed_case_entry )
+{
+    std::string list_filename  = unittest::temporary_file();
+    std::string index_filename = list_filename + ".idx";
+    std::ofstream( list_filename ) << "Mixed.Example.ORG\n"
+                                   << "*.Wildcard.Net.\n"
+                                   << "^Evil[0-9]+\\..*\n";
+    CHECK( DomainIndex::compile( list_filename, index_filename ) == 3 );
+
+    DomainList list;
+    list.load_from_file( index_filename );
+    CHECK( list.match( "mixed.example.org" ) );
+    CHECK( list.match( "www.wildcard.net" ) );
+    CHECK( not list.match( "example.org" ) );
+    CHECK( list.match( "evil7.com" ) );
+    std::remove( list_filename.c_str() );
+    std::remove( index_filename.c_str() );
+}
+
+TEST( domain_index_maps_prefilter_of_entries )
+{
+    std::string list_filename  = unittest::temporary_file();
+    std::string index_filename = list_filename + ".idx";
+    {
+        std::ofstream list_file( list_filename );
+        for( unsigned i = 0; i < 1000; ++i ) {
+            list_file << "Domain" << i << ".com\n";
+        }
+    }
+    CHECK( DomainIndex::compile( list_filename, index_filename, 16 ) == 1000 );
+
+    // Entries of index are not hashed into prefilter built on load
+    DomainList list;
+    list.load_from_file( index_filename );
+    std::vector<uint64_t> hashes;
+    list.hash_entries( hashes );
+    CHECK( hashes.empty() );
+    unsigned found           = 0;
+    unsigned false_positives = 0;
+    for( unsigned i = 0; i < 1000; ++i ) {
+        found += list.may_match_index( "www.domain" + std::to_string( i ) + ".com" );
+        false_positives += list.may_match_index( "other" + std::to_string( i ) + ".com" );
+    }
+    CHECK( found == 1000 );
+    CHECK( false_positives < 10 );
+    CHECK( not DomainList().may_match_index( "domain0.com" ) );
+    std::remove( list_filename.c_str() );
+    std::remove( index_filename.c_str() );
+}
+
+TEST( domain_list_pattern_matches_only_at_end )
+{
+    // Whitelisted name in the middle of a query must not whitelist it
+    DomainList whitelist;
+    whitelist.insert( "google\\.com" );
+    CHECK( whitelist.match( "google.com" ) );
+    CHECK( whitelist.match( "www.google.com" ) );
+    CHECK( not whitelist.match( "google.com.attacker.net" ) );
+    CHECK( not whitelist.match( "www.google.com.attacker.net" ) );
+}
@@ -0,0 +1,66 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#include "hmm_precision.h"
+#include "hmm_scorer.h"
+#include "smart_hmm.h"
+#include "unittest.h"
+#include <armadillo>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace snort::dns_firewall;
+using scientific::ml::Hmm;
+using scientific::ml::HmmScorer;
+
+TEST( hmm_scorer_batches_score_as_single_sequences )
+{
+    // Sequences of different lengths, with empty ones and characters outside
+    // of the alphabet, more than one group of every batch kernel
+    const std::string alphabet = "abcdefghijklmnopqrstuvwxyz0123456789-.";
+    std::vector<std::string> sequences;
+    for( unsigned s = 0; s < 77; ++s ) {
+        std::string sequence;
+        for( unsigned i = 0; i < ( s * 7 ) % 23; ++i ) {
+            sequence += alphabet[( s * 13 + i * 5 ) % alphabet.size()];
+        }
+        if( s % 11 == 3 ) {
+            sequence += '_';
+        }
+        sequences.push_back( sequence );
+    }
+    std::vector<const char*> data;
+    std::vector<std::size_t> lengths;
+    for( const std::string& sequence: sequences ) {
+        data.push_back( sequence.data() );
+        lengths.push_back( sequence.size() );
+    }
+    const char terminator = '.';
+
+    for( unsigned states: { 4, 8, 16, 32 } ) {
+        const Hmm<char, std::string> hmm( states, alphabet );
+        for( HmmPrecision precision:
+             { HmmPrecision::DOUBLE, HmmPrecision::FLOAT, HmmPrecision::INT16 } ) {
+            std::unique_ptr<HmmScorer> scorer = make_hmm_scorer( hmm, precision );
+            for( const char* end: { &terminator, static_cast<const char*>( nullptr ) } ) {
+                std::vector<double> scores( sequences.size() );
+                scorer->score( data.data(), lengths.data(), data.size(), scores.data(), end );
+                for( std::size_t s = 0; s < sequences.size(); ++s ) {
+                    CHECK( scores[s] == scorer->score( data[s], lengths[s], end ) );
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,78 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#include "unittest.h"
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace snort { namespace dns_firewall { namespace unittest {
+
+namespace {
+
+unsigned failures = 0;
+
+} // namespace
+
+std::vector<TestCase>& test_cases()
+{
+    static std::vector<TestCase> cases;
+    return cases;
+}
+
+void fail( const char* file, int line, const char* expression )
+{
+    std::cerr << file << ":" << line << ": check failed: " << expression << std::endl;
+    ++failures;
+}
+
+std::string temporary_file()
+{
+    char name[] = "/tmp/dfw3unittestXXXXXX";
+    int file    = mkstemp( name );
+    if( file < 0 ) {
+        throw std::invalid_argument( "Could not create temporary file" );
+    }
+    close( file );
+    return name;
+}
+
+}}} // namespace snort::dns_firewall::unittest
+
+using namespace snort::dns_firewall::unittest;
+
+// ----------------
+// ENTRYPOINT
+// ----------------
+int main()
+{
+    unsigned failed = 0;
+    for( const TestCase& test : test_cases() ) {
+        unsigned before = failures;
+        try {
+            test.run();
+        } catch( std::exception& e ) {
+            std::cerr << test.name << ": exception: " << e.what() << std::endl;
+            ++failures;
+        }
+        bool passed = failures == before;
+        failed += passed ? 0 : 1;
+        std::cout << ( passed ? "[ OK ] " : "[FAIL] " ) << test.name << std::endl;
+    }
+    std::cout << test_cases().size() - failed << " of " << test_cases().size()
+              << " tests passed" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
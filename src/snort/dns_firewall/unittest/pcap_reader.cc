@@ -0,0 +1,140 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#include "pcap_reader.h"
+#include "unittest.h"
+#include <cstdio>
+#include <fstream>
+
+using namespace snort::dns_firewall;
+
+namespace {
+
+// Pcapng capture built in host byte order
+class Capture
+{
+    std::vector<uint8_t> bytes;
+
+  public:
+    void put16( uint16_t value )
+    {
+        const uint8_t* data = reinterpret_cast<const uint8_t*>( &value );
+        bytes.insert( bytes.end(), data, data + 2 );
+    }
+    void put32( uint32_t value )
+    {
+        const uint8_t* data = reinterpret_cast<const uint8_t*>( &value );
+        bytes.insert( bytes.end(), data, data + 4 );
+    }
+    void section()
+    {
+        put32( 0x0a0d0d0a );
+        put32( 28 );
+        put32( 0x1a2b3c4d );
+        put16( 1 );
+        put16( 0 );
+        put32( 0xffffffff );
+        put32( 0xffffffff );
+        put32( 28 );
+    }
+    void interface( uint16_t link_type )
+    {
+        put32( 1 );
+        put32( 20 );
+        put16( link_type );
+        put16( 0 );
+        put32( 0 );
+        put32( 20 );
+    }
+    // Enhanced packet block of given length, claiming given captured length,
+    // carrying raw IPv4 UDP datagram to port 53 with 4 bytes of DNS payload
+    void packet( uint32_t length, uint32_t captured, uint16_t dns_id )
+    {
+        put32( 6 );
+        put32( length );
+        put32( 0 );
+        put32( 0 );
+        put32( 0 );
+        put32( captured );
+        put32( 32 );
+        const uint8_t ip[] = { 0x45, 0, 0, 32, 0, 0, 0, 0, 64, 17, 0, 0,
+                               10, 0, 0, 1, 10, 0, 0, 2 };
+        const uint8_t udp[] = { 0x30, 0x39, 0, 53, 0, 12, 0, 0 };
+        const uint8_t dns[] = { uint8_t( dns_id >> 8 ), uint8_t( dns_id ), 1, 0 };
+        bytes.insert( bytes.end(), ip, ip + sizeof( ip ) );
+        bytes.insert( bytes.end(), udp, udp + sizeof( udp ) );
+        bytes.insert( bytes.end(), dns, dns + sizeof( dns ) );
+        bytes.resize( bytes.size() + length - 64, 0 );
+        put32( length );
+    }
+    void truncate( std::size_t size )
+    {
+        bytes.resize( size );
+    }
+    std::size_t size() const
+    {
+        return bytes.size();
+    }
+    // Write capture to temporary file, returns its name
+    std::string write() const
+    {
+        std::string filename = unittest::temporary_file();
+        std::ofstream( filename, std::ios::binary )
+          .write( reinterpret_cast<const char*>( bytes.data() ), bytes.size() );
+        return filename;
+    }
+};
+
+// Read DNS ids of all messages of capture
+std::vector<uint16_t> read_ids( const Capture& capture )
+{
+    std::string filename = capture.write();
+    std::vector<uint16_t> ids;
+    {
+        PcapReader reader( filename );
+        reader.read_messages( [&]( uint64_t, const uint8_t* data, unsigned size ) {
+            CHECK( size == 4 );
+            ids.push_back( ( data[0] << 8 ) | data[1] );
+            return true;
+        } );
+    }
+    std::remove( filename.c_str() );
+    return ids;
+}
+
+} // namespace
+
+TEST( pcapng_skips_oversized_enhanced_packet )
+{
+    // Captured length wraps 32 bit sum of block header size and itself
+    Capture capture;
+    capture.section();
+    capture.interface( 101 );
+    capture.packet( 64, 32, 1 );
+    capture.packet( 64, 0xffffffe8, 2 );
+    capture.packet( 64, 33, 3 );
+    capture.packet( 64, 32, 4 );
+    CHECK( read_ids( capture ) == std::vector<uint16_t>( { 1, 4 } ) );
+}
+
+TEST( pcapng_stops_at_truncated_block )
+{
+    Capture capture;
+    capture.section();
+    capture.interface( 101 );
+    capture.packet( 64, 32, 1 );
+    capture.packet( 64, 32, 2 );
+    capture.truncate( capture.size() - 8 );
+    CHECK( read_ids( capture ) == std::vector<uint16_t>( { 1 } ) );
+}
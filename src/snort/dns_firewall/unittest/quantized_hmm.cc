@@ -0,0 +1,61 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#include "hmm_precision.h"
+#include "hmm_scorer.h"
+#include "smart_hmm.h"
+#include "unittest.h"
+#include <armadillo>
+#include <cmath>
+#include <memory>
+#include <string>
+
+using namespace snort::dns_firewall;
+using scientific::ml::Hmm;
+using scientific::ml::HmmScorer;
+
+// Likely state 0 emits only 'a', unlikely state 1 emits mostly 'c', both never
+// leave. Unreachable states 2 and 3 are the only ones emitting 'd'
+static Hmm<char, std::string> make_hmm()
+{
+    const arma::mat transitions = { { 1, 0, 0, 0 },
+                                    { 0, 1, 0, 0 },
+                                    { 0, 0, 1, 1 },
+                                    { 0, 0, 1, 1 } };
+    const arma::mat emissions   = { { 1, 0, 0, 0 },
+                                  { 1e-7, 1e-7, 1, 0 },
+                                  { 1, 1, 1, 1 },
+                                  { 1, 1, 1, 1 } };
+    const arma::mat initial     = { { 1, 1e-7, 0, 0 } };
+    return Hmm<char, std::string>( transitions, emissions, initial, "abcd" );
+}
+
+TEST( quantized_hmm_keeps_impossible_paths_impossible )
+{
+    const Hmm<char, std::string> hmm = make_hmm();
+    for( HmmPrecision precision : { HmmPrecision::FLOAT, HmmPrecision::INT16 } ) {
+        std::unique_ptr<HmmScorer> scorer = make_quantized_hmm_scorer( hmm, precision );
+        CHECK( scorer );
+        // The likely path through state 0 is impossible at 'b', so the least
+        // probable one through state 1 must win
+        const double exact = hmm.find_viterbi_score( "ab", 2 );
+        CHECK( std::abs( exact + 21 ) < 1e-3 );
+        CHECK( std::abs( scorer->score( "ab", 2, nullptr ) - exact ) < 1e-2 );
+        // No path emits 'd'
+        CHECK( std::isinf( hmm.find_viterbi_score( "ad", 2 ) ) );
+        CHECK( std::isinf( scorer->score( "ad", 2, nullptr ) ) );
+        bool stopped = false;
+        CHECK( std::isinf( scorer->score_bounded( "ad", 2, nullptr, -100, 100, stopped ) ) );
+    }
+}
@@ -0,0 +1,60 @@
+// **********************************************************************
+// Copyright (c) Artur M. Brodzki 2019-2020. All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// **********************************************************************
+
+#ifndef SNORT_DNS_FIREWALL_UNITTEST_H
+#define SNORT_DNS_FIREWALL_UNITTEST_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace snort { namespace dns_firewall { namespace unittest {
+
+// Test case, registered by TEST macro before main is entered
+struct TestCase
+{
+    std::string name;
+    std::function<void()> run;
+};
+
+// Registered test cases, in order of registration
+std::vector<TestCase>& test_cases();
+// Record failed check of running test case
+void fail( const char* file, int line, const char* expression );
+// Create empty temporary file, returns its name
+std::string temporary_file();
+
+struct Registrar
+{
+    Registrar( const char* name, std::function<void()> run )
+    {
+        test_cases().push_back( { name, std::move( run ) } );
+    }
+};
+
+}}} // namespace snort::dns_firewall::unittest
+
+#define TEST( name )                                                                           \
+    static void test_##name();                                                                 \
+    static snort::dns_firewall::unittest::Registrar registrar_##name( #name, test_##name );   \
+    static void test_##name()
+
+#define CHECK( expression )                                                                    \
+    do {                                                                                       \
+        if( not( expression ) ) {                                                              \
+            snort::dns_firewall::unittest::fail( __FILE__, __LINE__, #expression );            \
+        }                                                                                      \
+    } while( false )
+
+#endif // SNORT_DNS_FIREWALL_UNITTEST_H